@@ -23,6 +23,7 @@
 #include <arch/mm/page_table.h>
 #include <arch/mmu.h>
 #include <mm/mm.h>
+#include <mm/kmalloc.h>
 #include <io/uart.h>
 #include <machine.h>
 #include <irq/irq.h>
@@ -105,6 +106,8 @@ void main(paddr_t boot_flag, void *info)
 #endif
 	kinfo("[ChCore] sched init finished\n");
 
+	init_zero_pool_threads();
+
 	init_fpu_owner_locks();
 
 	/* Other cores are busy looping on the boot_flag, wake up those cores */
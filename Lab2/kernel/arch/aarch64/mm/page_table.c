@@ -269,7 +269,9 @@ void free_page_table(void *pgtbl)
                         /* Iterate each entry in the l2 page table*/
                         for (k = 0; k < PTP_ENTRIES; ++k) {
                                 l2_pte = &l2_ptp->ent[k];
-                                if (IS_PTE_INVALID(l2_pte->pte))
+                                /* Skip 2M blocks: they map user memory */
+                                if (IS_PTE_INVALID(l2_pte->pte)
+                                    || !IS_PTE_TABLE(l2_pte->pte))
                                         continue;
                                 l3_ptp = (ptp_t *)GET_NEXT_PTP(l2_pte);
                                 /* Free the l3 page table page */
@@ -344,6 +346,352 @@ int map_range_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, size_t len,
                 pgtbl, va, pa, len, flags, USER_PTE, rss);
 }
 
+/*
+ * Map nr (possibly non-contiguous) physical pages to consecutive user pages
+ * starting from va. A zero entry in pas leaves the corresponding pte
+ * untouched. The upper levels are only walked again when crossing into a
+ * new L3 page table page, so a batch within one ptp costs a single walk.
+ */
+int map_pages_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pas, int nr,
+                       vmr_prop_t flags, long *rss)
+{
+        ptp_t *l0_ptp, *l1_ptp, *l2_ptp, *l3_ptp = NULL;
+        pte_t *pte, *entry;
+        int i, ret = 0;
+
+        l0_ptp = (ptp_t *)pgtbl;
+
+        for (i = 0; i < nr; i++, va += PAGE_SIZE) {
+                /* Crossing into the next ptp, even if va is a hole */
+                if (GET_L3_INDEX(va) == 0)
+                        l3_ptp = NULL;
+                if (pas[i] == 0)
+                        continue;
+
+                if (l3_ptp == NULL) {
+                        ret = get_next_ptp(
+                                l0_ptp, L0, va, &l1_ptp, &pte, true, rss);
+                        if (ret < 0)
+                                goto out;
+                        ret = get_next_ptp(
+                                l1_ptp, L1, va, &l2_ptp, &pte, true, rss);
+                        if (ret < 0)
+                                goto out;
+                        ret = get_next_ptp(
+                                l2_ptp, L2, va, &l3_ptp, &pte, true, rss);
+                        if (ret < 0)
+                                goto out;
+                        if (ret == BLOCK_PTP) {
+                                ret = -EINVAL;
+                                goto out;
+                        }
+                        ret = 0;
+                }
+
+                entry = &(l3_ptp->ent[GET_L3_INDEX(va)]);
+                if (IS_PTE_INVALID(entry->pte) && rss != NULL)
+                        *rss += PAGE_SIZE;
+
+                entry->pte = 0;
+                entry->l3_page.is_valid = 1;
+                entry->l3_page.is_page = 1;
+                entry->l3_page.pfn = pas[i] >> PAGE_SHIFT;
+                set_pte_flags(entry, flags, USER_PTE);
+        }
+
+out:
+        dsb(ishst);
+        isb();
+        return ret;
+}
+
+/*
+ * Fill an L2 entry with a 2M block descriptor. The attribute bits of an
+ * l2_block share their positions with those of an l3_page, so
+ * set_pte_flags works on both.
+ */
+static void set_huge_pte(pte_t *entry, paddr_t pa, vmr_prop_t flags)
+{
+        entry->pte = 0;
+        entry->l2_block.is_valid = 1;
+        entry->l2_block.is_table = 0;
+        entry->l2_block.pfn = pa >> L2_INDEX_SHIFT;
+        set_pte_flags(entry, flags, USER_PTE);
+}
+
+/*
+ * Map a user range with 2M L2 block descriptors. va, pa and len must be
+ * aligned to HUGE_PAGE_SIZE. An L2 slot already pointing to a non-empty L3
+ * table cannot be replaced and makes the call return -EEXIST; the blocks
+ * installed before that stay mapped and are accounted in rss.
+ */
+int map_huge_range_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, size_t len,
+                            vmr_prop_t flags, long *rss)
+{
+        ptp_t *l0_ptp, *l1_ptp, *l2_ptp, *l3_ptp;
+        pte_t *pte, *entry;
+        vaddr_t end = va + len;
+        int i, ret = 0;
+
+        BUG_ON((va | pa | len) & (HUGE_PAGE_SIZE - 1));
+
+        l0_ptp = (ptp_t *)pgtbl;
+
+        for (; va < end; va += HUGE_PAGE_SIZE, pa += HUGE_PAGE_SIZE) {
+                ret = get_next_ptp(l0_ptp, L0, va, &l1_ptp, &pte, true, rss);
+                if (ret < 0)
+                        goto out;
+                ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, true, rss);
+                if (ret < 0)
+                        goto out;
+                if (ret == BLOCK_PTP) {
+                        ret = -EINVAL;
+                        goto out;
+                }
+                ret = 0;
+
+                entry = &(l2_ptp->ent[GET_L2_INDEX(va)]);
+                if (!IS_PTE_INVALID(entry->pte) && IS_PTE_TABLE(entry->pte)) {
+                        /* Only an empty L3 table may be replaced */
+                        l3_ptp = (ptp_t *)GET_NEXT_PTP(entry);
+                        for (i = 0; i < PTP_ENTRIES; i++) {
+                                if (!IS_PTE_INVALID(l3_ptp->ent[i].pte)) {
+                                        ret = -EEXIST;
+                                        goto out;
+                                }
+                        }
+                        entry->pte = PTE_DESCRIPTOR_INVALID;
+                        kfree(l3_ptp);
+                }
+
+                if (IS_PTE_INVALID(entry->pte) && rss != NULL)
+                        *rss += HUGE_PAGE_SIZE;
+                set_huge_pte(entry, pa, flags);
+        }
+
+out:
+        dsb(ishst);
+        isb();
+        return ret;
+}
+
+/*
+ * Return the L2 entry covering va if it is a 2M block mapping, or NULL.
+ */
+static pte_t *get_huge_pte(ptp_t *l0_ptp, vaddr_t va)
+{
+        ptp_t *l1_ptp, *l2_ptp;
+        pte_t *pte, *entry;
+        int ret;
+
+        ret = get_next_ptp(l0_ptp, L0, va, &l1_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return NULL;
+        ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, false, NULL);
+        if (ret != NORMAL_PTP)
+                return NULL;
+
+        entry = &(l2_ptp->ent[GET_L2_INDEX(va)]);
+        if (IS_PTE_INVALID(entry->pte) || IS_PTE_TABLE(entry->pte))
+                return NULL;
+        return entry;
+}
+
+/*
+ * ASID of pgtbl when it is the page table installed on the current CPU,
+ * which is the case for the vmspace of the calling thread.
+ */
+static unsigned long get_current_pcid(void *pgtbl)
+{
+        u64 ttbr0;
+
+        asm volatile("mrs %0, ttbr0_el1" : "=r"(ttbr0));
+        BUG_ON((ttbr0 & TTBR_BADDR_MASK) != virt_to_phys(pgtbl));
+        return ttbr0 >> ASID_SHIFT;
+}
+
+/*
+ * Replace the L2 block entry covering va by an L3 table mapping the same
+ * 512 pages with the same attributes. The block is invalidated and its
+ * TLB entry in the ASID @pcid dropped before the table is installed, as
+ * required by break-before-make.
+ */
+static int split_huge_pte(pte_t *entry, vaddr_t va, unsigned long pcid)
+{
+        ptp_t *l3_ptp;
+        pte_t new_pte_val;
+        paddr_t pa;
+        u64 arg;
+        int i;
+
+        l3_ptp = get_pages(0);
+        if (l3_ptp == NULL)
+                return -ENOMEM;
+
+        pa = (paddr_t)entry->l2_block.pfn << L2_INDEX_SHIFT;
+        for (i = 0; i < PTP_ENTRIES; i++) {
+                new_pte_val.pte = entry->pte;
+                new_pte_val.l3_page.is_page = 1;
+                new_pte_val.l3_page.pfn = (pa >> PAGE_SHIFT) + i;
+                l3_ptp->ent[i].pte = new_pte_val.pte;
+        }
+
+        entry->pte = PTE_DESCRIPTOR_INVALID;
+        arg = ((u64)pcid << ASID_SHIFT)
+              | ((ROUND_DOWN(va, HUGE_PAGE_SIZE) >> PAGE_SHIFT) & TLBI_VA_MASK);
+        dsb(ishst);
+        asm volatile("tlbi vae1is, %0" : : "r"(arg) : "memory");
+        dsb(ish);
+        isb();
+
+        new_pte_val.pte = 0;
+        new_pte_val.table.is_valid = 1;
+        new_pte_val.table.is_table = 1;
+        new_pte_val.table.next_table_addr = virt_to_phys((vaddr_t)l3_ptp)
+                                            >> PAGE_SHIFT;
+        entry->pte = new_pte_val.pte;
+
+        return 0;
+}
+
+/*
+ * Split the 2M block mappings overlapping [va, va + len) into L3 tables,
+ * so that the L3-only walkers of unmap/mprotect can operate on the range.
+ * With @partial, the blocks lying fully inside the range are left alone
+ * (unmap_range_in_pgtbl clears them). @pcid is the ASID of the vmspace
+ * owning pgtbl. Return -ENOMEM if an L3 table cannot be allocated; the
+ * blocks split before that stay split, which does not change the mapping.
+ */
+int split_huge_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len,
+                              bool partial, unsigned long pcid)
+{
+        pte_t *entry;
+        vaddr_t cur, end = va + len;
+        int ret;
+
+        for (cur = ROUND_DOWN(va, HUGE_PAGE_SIZE); cur < end;
+             cur += HUGE_PAGE_SIZE) {
+                entry = get_huge_pte((ptp_t *)pgtbl, cur);
+                if (entry == NULL)
+                        continue;
+                if (partial && cur >= va && cur + HUGE_PAGE_SIZE <= end)
+                        continue;
+
+                ret = split_huge_pte(entry, cur, pcid);
+                if (ret)
+                        return ret;
+        }
+
+        return 0;
+}
+
+/*
+ * Clear the 2M block mappings lying fully inside [va, va + len). Blocks
+ * crossing the boundary of the range must have been split by the caller
+ * with split_huge_range_in_pgtbl, otherwise -EBUSY is returned.
+ */
+static int clear_huge_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len,
+                                     long *rss)
+{
+        pte_t *entry;
+        vaddr_t cur, end = va + len;
+
+        for (cur = ROUND_DOWN(va, HUGE_PAGE_SIZE); cur < end;
+             cur += HUGE_PAGE_SIZE) {
+                entry = get_huge_pte((ptp_t *)pgtbl, cur);
+                if (entry == NULL)
+                        continue;
+                if (cur < va || cur + HUGE_PAGE_SIZE > end)
+                        return -EBUSY;
+
+                entry->pte = PTE_DESCRIPTOR_INVALID;
+                if (rss != NULL)
+                        *rss -= HUGE_PAGE_SIZE;
+        }
+
+        return 0;
+}
+
+/*
+ * Find the L3 entry of va. Return -ENOMAPPING if va is not mapped and
+ * -EBUSY if it is mapped by a 2M block.
+ */
+static int get_l3_pte(void *pgtbl, vaddr_t va, pte_t **entry)
+{
+        ptp_t *l0_ptp, *l1_ptp, *l2_ptp, *l3_ptp;
+        pte_t *pte;
+        int ret;
+
+        l0_ptp = (ptp_t *)pgtbl;
+        ret = get_next_ptp(l0_ptp, L0, va, &l1_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        if (ret == BLOCK_PTP)
+                return -EBUSY;
+        ret = get_next_ptp(l2_ptp, L2, va, &l3_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        if (ret == BLOCK_PTP)
+                return -EBUSY;
+
+        *entry = &(l3_ptp->ent[GET_L3_INDEX(va)]);
+        if (IS_PTE_INVALID((*entry)->pte))
+                return -ENOMAPPING;
+        return 0;
+}
+
+/*
+ * Invalidate the 4K mapping of va if it maps pa, and save the old entry in
+ * @old so that the page can be migrated and mapped back with
+ * restore_page_in_pgtbl. The caller is responsible for the TLB flush.
+ */
+int isolate_page_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, pte_t *old)
+{
+        pte_t *entry;
+        int ret;
+
+        ret = get_l3_pte(pgtbl, va, &entry);
+        if (ret < 0)
+                return ret;
+        if (((paddr_t)entry->l3_page.pfn << PAGE_SHIFT) != pa)
+                return -ENOMAPPING;
+
+        old->pte = entry->pte;
+        entry->pte = PTE_DESCRIPTOR_INVALID;
+        dsb(ishst);
+        return 0;
+}
+
+/* Install @old again with its page frame replaced by pa. */
+int restore_page_in_pgtbl(void *pgtbl, vaddr_t va, pte_t old, paddr_t pa)
+{
+        ptp_t *l0_ptp, *l1_ptp, *l2_ptp, *l3_ptp;
+        pte_t *pte;
+        int ret;
+
+        l0_ptp = (ptp_t *)pgtbl;
+        ret = get_next_ptp(l0_ptp, L0, va, &l1_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        ret = get_next_ptp(l1_ptp, L1, va, &l2_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        ret = get_next_ptp(l2_ptp, L2, va, &l3_ptp, &pte, false, NULL);
+        if (ret < 0)
+                return ret;
+        if (ret == BLOCK_PTP)
+                return -EBUSY;
+
+        old.l3_page.pfn = pa >> PAGE_SHIFT;
+        l3_ptp->ent[GET_L3_INDEX(va)].pte = old.pte;
+        dsb(ishst);
+        isb();
+        return 0;
+}
+
 /*
  * Try to release a lower level page table page (low_ptp).
  * @high_ptp: the higher level page table page
@@ -388,6 +736,12 @@ __maybe_unused static void recycle_pgtable_entry(ptp_t *l0_ptp, ptp_t *l1_ptp,
 int unmap_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len,
                          __maybe_unused long *rss)
 {
+        int ret;
+
+        ret = clear_huge_range_in_pgtbl(pgtbl, va, len, rss);
+        if (ret)
+                return ret;
+
         /* LAB 2 TODO 4 BEGIN */
         /*
          * Hint: Walk through each level of page table using `get_next_ptp`,
@@ -410,6 +764,17 @@ int unmap_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len,
 
 int mprotect_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, vmr_prop_t flags)
 {
+        int ret;
+
+        /*
+         * Only sys_handle_mprotect calls this, on the vmspace of the calling
+         * thread, so the ASID is the one installed on this CPU.
+         */
+        ret = split_huge_range_in_pgtbl(
+                pgtbl, va, len, false, get_current_pcid(pgtbl));
+        if (ret)
+                return ret;
+
         /* LAB 2 TODO 4 BEGIN */
         /*
          * Hint: Walk through each level of page table using `get_next_ptp`,
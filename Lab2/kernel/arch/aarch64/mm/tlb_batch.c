@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/types.h>
+#include <common/macro.h>
+#include <common/sync.h>
+#include <mm/mm.h>
+#include <mm/vmspace.h>
+#include <arch/machine/smp.h>
+#include <arch/mm/page_table.h>
+#include <arch/sync.h>
+
+/*
+ * On AArch64, TLB maintenance is broadcast by hardware (the *IS variants of
+ * TLBI) instead of IPIs. A batch is therefore shot down with a single
+ * broadcast round, downgraded to local TLBIs when the vmspace has only ever
+ * run on the current CPU, and skipped when it has never run at all.
+ *
+ * This relies on record_history_cpu() ordering its store before the CPU
+ * walks the page table of the vmspace: either the flush below sees the
+ * CPU in history_cpus, or that CPU only walks the updated entries.
+ */
+
+/* Above this number of pages, invalidate the whole ASID instead. */
+#define TLB_BATCH_ASID_THRESHOLD 32
+
+static struct tlb_batch_stats tlb_stats;
+
+void tlb_batch_init(struct tlb_batch *batch, struct vmspace *vmspace)
+{
+        batch->vmspace = vmspace;
+        batch->start = ~0UL;
+        batch->end = 0;
+        batch->nr_ranges = 0;
+}
+
+/* Overlapping or not, ranges are merged into one covering range. */
+void tlb_batch_add(struct tlb_batch *batch, vaddr_t va, size_t len)
+{
+        if (len == 0)
+                return;
+
+        batch->start = MIN(batch->start, ROUND_DOWN(va, PAGE_SIZE));
+        batch->end = MAX(batch->end, ROUND_UP(va + len, PAGE_SIZE));
+        batch->nr_ranges++;
+}
+
+static void tlb_flush_asid(u64 asid, bool local)
+{
+        if (local)
+                asm volatile("tlbi aside1, %0" : : "r"(asid) : "memory");
+        else
+                asm volatile("tlbi aside1is, %0" : : "r"(asid) : "memory");
+}
+
+static void tlb_flush_pages(u64 asid, vaddr_t start, unsigned long nr_pages,
+                            bool local)
+{
+        u64 arg = asid | ((start >> PAGE_SHIFT) & TLBI_VA_MASK);
+        unsigned long i;
+
+        for (i = 0; i < nr_pages; i++, arg++) {
+                if (local)
+                        asm volatile("tlbi vae1, %0" : : "r"(arg) : "memory");
+                else
+                        asm volatile("tlbi vae1is, %0" : : "r"(arg) : "memory");
+        }
+}
+
+void tlb_batch_flush(struct tlb_batch *batch)
+{
+        struct vmspace *vmspace = batch->vmspace;
+        unsigned long nr_pages;
+        unsigned int cpuid, i;
+        bool ran = false, remote = false;
+        u64 asid;
+
+        if (batch->nr_ranges == 0)
+                return;
+
+        atomic_fetch_add_long(&tlb_stats.nr_batches, 1);
+        atomic_fetch_add_long(&tlb_stats.nr_merged, batch->nr_ranges - 1);
+
+        /*
+         * Make the page table updates visible before sampling
+         * history_cpus: a CPU recorded after this point can only walk
+         * the updated page table.
+         */
+        dsb(ish);
+
+        cpuid = smp_get_cpu_id();
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                if (!vmspace->history_cpus[i])
+                        continue;
+                ran = true;
+                if (i != cpuid)
+                        remote = true;
+        }
+
+        if (!ran) {
+                atomic_fetch_add_long(&tlb_stats.nr_avoided, 1);
+                goto out;
+        }
+
+        asid = (u64)vmspace->pcid << ASID_SHIFT;
+        nr_pages = (batch->end - batch->start) >> PAGE_SHIFT;
+        if (nr_pages > TLB_BATCH_ASID_THRESHOLD) {
+                tlb_flush_asid(asid, !remote);
+                atomic_fetch_add_long(&tlb_stats.nr_asid_flushes, 1);
+        } else {
+                tlb_flush_pages(asid, batch->start, nr_pages, !remote);
+                atomic_fetch_add_long(&tlb_stats.nr_page_flushes, nr_pages);
+        }
+
+        if (remote) {
+                dsb(ish);
+                atomic_fetch_add_long(&tlb_stats.nr_shootdowns, 1);
+        } else {
+                dsb(nsh);
+                atomic_fetch_add_long(&tlb_stats.nr_local, 1);
+        }
+        isb();
+
+out:
+        tlb_batch_init(batch, vmspace);
+}
+
+void get_tlb_batch_stats(struct tlb_batch_stats *stats)
+{
+        *stats = tlb_stats;
+}
@@ -14,3 +14,5 @@ chcore_config(CHCORE_KERNEL_RT BOOL OFF "Enable realtime support in kernel?")
 chcore_config(CHCORE_KERNEL_SCHED_PBFIFO BOOL OFF "Use priority-based FIFO?")
 chcore_config(CHCORE_KERNEL_ENABLE_QEMU_VIRTIO_NET BOOL ON "Enable virtio-net nic on x86_64 QEMU?")
 chcore_config(CHCORE_KERNEL_PM_USAGE_TEST BOOL OFF "Whether to enable the challenge test?")
+chcore_config(CHCORE_KERNEL_FAULT_AROUND BOOL ON "Map adjacent pages on anonymous page faults?")
+chcore_config(CHCORE_KERNEL_THP BOOL ON "Map large aligned anonymous/data pmos with 2M huge pages?")
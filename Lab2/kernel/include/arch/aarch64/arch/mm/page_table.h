@@ -73,6 +73,16 @@
 #define L2_BLOCK_MASK   ((L2_PER_ENTRY_PAGES << PAGE_SHIFT) - 1)
 #define L3_PAGE_MASK    ((L3_PER_ENTRY_PAGES << PAGE_SHIFT) - 1)
 
+/* User huge pages are mapped by L2 blocks backed by order-9 chunks */
+#define HUGE_PAGE_SIZE  (L2_PER_ENTRY_PAGES << PAGE_SHIFT)
+#define HUGE_PAGE_ORDER (PAGE_ORDER)
+
+/* The ASID lives in TTBR0_EL1[63:48] and in the same bits of TLBI arguments */
+#define ASID_SHIFT      (48)
+#define TTBR_BADDR_MASK ((1UL << ASID_SHIFT) - 1)
+/* VA[55:12] goes to bits [43:0] of the TLBI argument */
+#define TLBI_VA_MASK    ((1UL << 44) - 1)
+
 #define GET_VA_OFFSET_L1(va)      ((va) & L1_BLOCK_MASK)
 #define GET_VA_OFFSET_L2(va)      ((va) & L2_BLOCK_MASK)
 #define GET_VA_OFFSET_L3(va)      ((va) & L3_PAGE_MASK)
@@ -59,9 +59,17 @@ int map_range_in_pgtbl_kernel(void *pgtbl, vaddr_t va, paddr_t pa,
 		       size_t len, vmr_prop_t flags);
 int map_range_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa,
 		       size_t len, vmr_prop_t flags, long *rss);
+int map_pages_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pas, int nr,
+		       vmr_prop_t flags, long *rss);
+int map_huge_range_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa,
+		       size_t len, vmr_prop_t flags, long *rss);
 int unmap_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, long *rss);
+int split_huge_range_in_pgtbl(void *pgtbl, vaddr_t va, size_t len,
+			      bool partial, unsigned long pcid);
 int query_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t *pa, pte_t **entry);
 int mprotect_in_pgtbl(void *pgtbl, vaddr_t va, size_t len, vmr_prop_t prop);
+int isolate_page_in_pgtbl(void *pgtbl, vaddr_t va, paddr_t pa, pte_t *old);
+int restore_page_in_pgtbl(void *pgtbl, vaddr_t va, pte_t old, paddr_t pa);
 void set_ttbr0_el1(paddr_t ttbr0);
 
 struct vmspace;
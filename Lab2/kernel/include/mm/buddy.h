@@ -16,6 +16,7 @@
 #include <common/types.h>
 #include <common/list.h>
 #include <common/lock.h>
+#include <uapi/memory.h>
 
 #define N_PHYS_MEM_POOLS 3
 
@@ -87,6 +88,106 @@ struct phys_mem_pool {
 /* Disjoint physical memory can be represented by several phys_mem_pools. */
 extern struct phys_mem_pool global_mem[N_PHYS_MEM_POOLS];
 
+/*
+ * Policies to choose the physical memory pool an allocation is served from.
+ * Every policy picks a preferred pool and falls back to the other pools in
+ * ascending order starting right after the preferred one, so that a single
+ * pool is not filled (and fragmented) first while the others stay idle.
+ */
+enum mem_policy {
+        /* Always prefer pool 0 (the original behavior). */
+        MEM_POLICY_FIRST = MEM_POLICY_ID_FIRST,
+        /* Prefer a pool chosen by the current CPU. */
+        MEM_POLICY_LOCAL = MEM_POLICY_ID_LOCAL,
+        /* Rotate the preferred pool on every buddy allocation. */
+        MEM_POLICY_INTERLEAVE = MEM_POLICY_ID_INTERLEAVE,
+        MEM_POLICY_NUM
+};
+
+#define MEM_POLICY_DEFAULT MEM_POLICY_LOCAL
+
+struct mem_pool_stats {
+        /* Buddy allocations (including per-CPU list refills) served. */
+        unsigned long alloc;
+        /* Allocations served here although another pool was preferred. */
+        unsigned long fallback;
+        /* Allocations which found no suitable free chunk here. */
+        unsigned long fail;
+        /* Free memory in bytes and the largest free order, -1 if full. */
+        unsigned long free_size;
+        int max_free_order;
+        /* Number of free chunks of each order. */
+        unsigned long nr_free[BUDDY_MAX_ORDER];
+        /* Fragmentation index of each order, see fragmentation_index(). */
+        int frag_index[BUDDY_MAX_ORDER];
+};
+
+/*
+ * Per-CPU page lists in front of the buddy allocator.
+ *
+ * Small chunks (order < PCP_MAX_ORDER) are cached on the local CPU so that
+ * most get_pages/free_pages calls do not touch buddy_lock at all. Each list
+ * is refilled from (and drained to) the buddy free lists in batches of
+ * PCP_BATCH >> order chunks, and is drained once it holds more than
+ * PCP_HIGH >> order chunks. Recently freed (hot) chunks are kept at the head
+ * of a list and are reused first; drains take the coldest chunks from the
+ * tail.
+ */
+#define PCP_MAX_ORDER (4)
+#define PCP_BATCH     (32)
+#define PCP_HIGH      (128)
+
+struct pcp_stats {
+        /* Allocations served from the per-CPU lists. */
+        unsigned long alloc_hit;
+        /* Allocations that required a refill from the buddy allocator. */
+        unsigned long alloc_miss;
+        /* Frees that were absorbed by the per-CPU lists. */
+        unsigned long free_hit;
+        /* Number of batched refills and drains against the buddy lock. */
+        unsigned long refill;
+        unsigned long drain;
+};
+
+struct per_cpu_pages {
+        /*
+         * Only contended when another CPU drains this one on OOM or
+         * reads the statistics.
+         */
+        struct lock lock;
+        struct list_head lists[PCP_MAX_ORDER];
+        unsigned long count[PCP_MAX_ORDER];
+        struct pcp_stats stats;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+/*
+ * Per-CPU pools of pre-zeroed order-0 pages.
+ *
+ * Zeroing a fresh page is the dominant cost of an anonymous page fault.
+ * Each pool is refilled by a kernel thread bound to its CPU, so that
+ * get_zeroed_page() on the fault path can usually hand out a page without
+ * touching it. get_zeroed_page() wakes the thread once the pool drops below
+ * ZERO_POOL_LOW pages, and the thread fills it back to ZERO_POOL_HIGH.
+ */
+#define ZERO_POOL_LOW  (16)
+#define ZERO_POOL_HIGH (64)
+
+struct zero_pool_stats {
+        /* get_zeroed_page() calls served from the pool. */
+        unsigned long hit;
+        /* get_zeroed_page() calls that zeroed a page inline. */
+        unsigned long miss;
+        /* Pages zeroed by the refill thread. */
+        unsigned long refill;
+};
+
+struct zero_page_pool {
+        struct lock lock;
+        struct list_head pages;
+        unsigned long count;
+        struct zero_pool_stats stats;
+} __attribute__((aligned(CACHELINE_SZ)));
+
 
 /* All interfaces are kernel/mm module internal interfaces. */
 
@@ -95,10 +196,33 @@ void init_buddy(struct phys_mem_pool *, struct page *start_page,
 
 struct page *buddy_get_pages(struct phys_mem_pool *, int order);
 void buddy_free_pages(struct phys_mem_pool *, struct page *page);
+int buddy_get_pages_bulk(struct phys_mem_pool *, int order, int count,
+                         struct list_head *list);
+void buddy_free_pages_bulk(struct phys_mem_pool *, struct list_head *list);
+void buddy_split_pages(struct phys_mem_pool *, struct page *page);
+struct page *buddy_isolate_block(struct phys_mem_pool *, int order,
+                                 struct list_head *isolated);
+int fragmentation_index(const unsigned long *nr_free, int order);
 
 void *page_to_virt(struct page *page);
 struct page *virt_to_page(void* ptr);
 unsigned long get_free_mem_size_from_buddy(struct phys_mem_pool *);
 unsigned long get_total_mem_size_from_buddy(struct phys_mem_pool *);
 
+/* Per-CPU page lists, implemented in kmalloc.c. */
+void init_pcp(void);
+unsigned long get_free_mem_size_from_pcp(void);
+void get_pcp_stats(int cpu, struct pcp_stats *stats);
+
+/* Pool selection policy, implemented in kmalloc.c. */
+int set_mem_policy(enum mem_policy policy);
+enum mem_policy get_mem_policy(void);
+void get_mem_pool_stats(int pool, struct mem_pool_stats *stats);
+void drain_page_caches(void);
+
+/* Per-CPU pre-zeroed page pools, implemented in kmalloc.c. */
+void init_zero_pools(void);
+unsigned long get_free_mem_size_from_zero_pools(void);
+void get_zero_pool_stats(int cpu, struct zero_pool_stats *stats);
+
 #endif /* MM_BUDDY_H */
@@ -29,6 +29,26 @@ void free_pages(void* addr);
 void get_mem_usage_msg(void);
 
 void free_pages_without_record(void *addr);
+void split_pages(void *addr);
+/* Return vaddr of one zero-filled physical page */
+void *get_zeroed_page(void);
+void init_zero_pool_threads(void);
 void get_mem_usage_msg(void);
 
+/*
+ * Dedicated object caches for hot, fixed-size kernel objects.
+ * Objects allocated from a kmem_cache can be released either with
+ * kmem_cache_free() or with kfree().
+ */
+struct kmem_cache;
+
+struct kmem_cache *kmem_cache_create(const char *name, unsigned long size,
+                                     void (*ctor)(void *obj));
+void kmem_cache_destroy(struct kmem_cache *cache);
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void *kmem_cache_zalloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+unsigned long kmem_cache_size(struct kmem_cache *cache);
+void kmem_cache_print_stats(void);
+
 #endif /* MM_KMALLOC_H */
@@ -37,6 +37,49 @@ void flush_tlb_by_vmspace(struct vmspace *);
 void flush_idcache(void);
 void flush_tlb_all(void);
 
+/*
+ * Batched TLB shootdown: invalidations are accumulated with tlb_batch_add
+ * while the page table is modified and issued at once by tlb_batch_flush,
+ * only towards the CPUs recorded in vmspace->history_cpus.
+ */
+struct tlb_batch {
+        struct vmspace *vmspace;
+        vaddr_t start;
+        vaddr_t end;
+        int nr_ranges;
+};
+
+struct tlb_batch_stats {
+        /* Batches flushed (including avoided ones). */
+        unsigned long nr_batches;
+        /* Ranges merged into an earlier range of the same batch. */
+        unsigned long nr_merged;
+        /* Batches needing no flush: the vmspace never ran on any CPU. */
+        unsigned long nr_avoided;
+        /* Batches only flushed on the local CPU. */
+        unsigned long nr_local;
+        /* Batches shot down on remote CPUs (one round each). */
+        unsigned long nr_shootdowns;
+        /* Batches turned into a whole-ASID invalidation. */
+        unsigned long nr_asid_flushes;
+        /* Per-page invalidations issued. */
+        unsigned long nr_page_flushes;
+};
+
+void tlb_batch_init(struct tlb_batch *batch, struct vmspace *vmspace);
+void tlb_batch_add(struct tlb_batch *batch, vaddr_t va, size_t len);
+void tlb_batch_flush(struct tlb_batch *batch);
+void get_tlb_batch_stats(struct tlb_batch_stats *stats);
+
+/*
+ * Memory compaction: pages of the PMO_ANONYM pmos mapped by the vmrs
+ * tracked here may be migrated to rebuild free chunks of a given order.
+ * The result is reported in struct compact_info of uapi/memory.h.
+ */
+void compaction_track_vmr(struct vmregion *vmr);
+void compaction_untrack_vmr(struct vmregion *vmr);
+int compact_memory(int order, struct compact_info *info);
+
 /* Only needed on SPARC */
 void sys_cache_config(unsigned option);
 void plat_cache_config(unsigned option);
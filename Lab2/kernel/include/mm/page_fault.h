@@ -17,6 +17,30 @@
 #include <common/types.h>
 #include <arch/mmu.h>
 
+/*
+ * Size (in pages, power of two) of the aligned window that fault-around
+ * populates on a translation fault of an anonymous/shm pmo.
+ */
+#ifndef FAULT_AROUND_PAGES
+#define FAULT_AROUND_PAGES 16
+#endif
+
+/*
+ * Fault statistics of all the vmspaces, updated atomically. They are not
+ * kept per vmspace since the prebuilt objects allocate struct vmspace with
+ * its original layout.
+ */
+struct pgfault_stats {
+        /* translation faults on anonymous/shm pmos */
+        unsigned long nr_trans_faults;
+        /* pages mapped ahead by fault-around */
+        unsigned long nr_fault_around_pages;
+        /* faults served with a huge page */
+        unsigned long nr_huge_faults;
+};
+
+extern struct pgfault_stats pgfault_stats;
+
 int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr);
 
 int handle_perm_fault(struct vmspace *vmspace, vaddr_t fault_addr,
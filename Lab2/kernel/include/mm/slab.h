@@ -14,6 +14,7 @@
 #define MM_SLAB_H
 
 #include <common/list.h>
+#include <common/lock.h>
 
 /*
  * order range: [SLAB_MIN_ORDER, SLAB_MAX_ORDER]
@@ -47,6 +48,90 @@ struct slab_pointer {
         struct list_head partial_slab_list;
 };
 
+/*
+ * Per-CPU magazine layer in front of the slabs.
+ *
+ * A magazine is a small stack of free objects of one size class. Each CPU
+ * keeps a loaded and a previous magazine per size class, so most
+ * kmalloc/kfree calls only touch CPU-local state. Full and empty magazines
+ * are exchanged with a per-size-class depot, and only magazine misses fall
+ * through to the slabs (and slabs_locks).
+ */
+#define SLAB_MAGAZINE_SIZE  (16)
+/* Magazines themselves are allocated from this size class. */
+#define SLAB_MAGAZINE_ORDER (8)
+/* Full magazines beyond this limit are flushed back to the slabs. */
+#define SLAB_DEPOT_MAX_FULL (8)
+
+struct slab_magazine {
+        /* Node in the depot lists. */
+        struct list_head node;
+        unsigned long rounds;
+        void *objs[SLAB_MAGAZINE_SIZE];
+};
+
+struct slab_cpu_cache {
+        struct slab_magazine *loaded;
+        struct slab_magazine *previous;
+};
+
+struct slab_depot {
+        struct lock lock;
+        struct list_head full_list;
+        struct list_head empty_list;
+        unsigned long nr_full;
+        unsigned long nr_empty;
+};
+
+/*
+ * Dedicated caches for fixed-size kernel objects (see kmem_cache_create).
+ *
+ * Objects are packed with their exact (8-byte aligned) size instead of
+ * being rounded up to a power-of-two size class. A slab of a kmem_cache is
+ * marked with KMEM_CACHE_SLAB_ORDER in slab_header->order so that kfree()
+ * can hand its objects back to the owning cache.
+ */
+#define KMEM_CACHE_SLAB_ORDER (-1)
+#define KMEM_CACHE_ALIGN      (8)
+/* Each slab of a kmem_cache holds at least this number of objects. */
+#define KMEM_CACHE_MIN_OBJS   (8)
+#define KMEM_CACHE_NAME_LEN   (32)
+
+struct kmem_cache_slab {
+        struct slab_header header;
+        struct kmem_cache *cache;
+};
+
+struct kmem_cache {
+        char name[KMEM_CACHE_NAME_LEN];
+        /* Size requested by the user and the actual size of one object. */
+        unsigned long size;
+        unsigned long obj_size;
+        /* Size of one slab and the offset of the first object in it. */
+        unsigned long slab_size;
+        unsigned long obj_offset;
+        /*
+         * Invoked once on each object when a new slab is created. The
+         * constructed state must survive kmem_cache_free(), so the free
+         * list link of such a cache is kept in an extra word past the
+         * object (at @free_offset) instead of in its first word.
+         */
+        void (*ctor)(void *obj);
+        unsigned long free_offset;
+
+        struct lock lock;
+        /* Slabs which have at least one free object. */
+        struct list_head partial_slab_list;
+        /* Node in the global list of kmem_caches. */
+        struct list_head node;
+
+        /* Usage statistics, protected by @lock. */
+        unsigned long nr_slabs;
+        unsigned long nr_active;
+        unsigned long nr_allocs;
+        unsigned long nr_frees;
+};
+
 /* All interfaces are kernel/mm module internal interfaces. */
 void init_slab(void);
 void *alloc_in_slab(unsigned long, size_t *);
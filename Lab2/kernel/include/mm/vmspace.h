@@ -34,6 +34,10 @@ struct vmregion {
         vmr_prop_t perm;
         struct pmobject *pmo;
         struct list_head cow_private_pages;
+        /* Serializes page faults on this vmr (commit, map and CoW) */
+        struct lock fault_lock;
+        /* PMO_ANONYM only: node of the list of vmrs compaction may migrate */
+        struct list_head compact_node;
 };
 
 /* This struct represents one virtual address space */
@@ -65,7 +69,24 @@ struct vmspace {
         long rss;
 };
 
+/*
+ * The vmr lock of a vmspace protects its vmr_list/vmr_tree and the vmr
+ * fields against the page fault handlers, which only take it for read. Any
+ * change to them takes it for write while holding vmspace_lock, so holding
+ * vmspace_lock alone is still enough to look vmrs up.
+ * The locks are hashed by vmspace rather than embedded in it, since the
+ * prebuilt objects allocate struct vmspace with its original layout.
+ */
+struct rwlock *vmspace_vmr_lock(struct vmspace *vmspace);
+
+/*
+ * Protects the mapping_list of a pmo. Hashed for the same reason, as
+ * struct pmobject is allocated by the prebuilt objects too.
+ */
+struct lock *pmo_mapping_lock(struct pmobject *pmo);
+
 /* Interfaces on vmspace management */
+void vmspace_caches_init(void);
 int vmspace_init(struct vmspace *vmspace, unsigned long pcid);
 void vmspace_deinit(void *ptr);
 void plat_vmspace_init(struct vmspace *vmspace);
@@ -63,6 +63,9 @@ int sys_unmap_pmo(cap_t target_cap_group_cap, cap_t pmo_cap,
 unsigned long sys_handle_brk(unsigned long addr, unsigned long heap_start);
 int sys_handle_mprotect(unsigned long addr, unsigned long length, int prot);
 int sys_get_free_mem_size(struct free_mem_info *info);
+int sys_get_tlb_stats(struct tlb_stats_info *info);
+int sys_mem_policy(int policy, int pool, struct mem_pool_info *info);
+int sys_compact_memory(int order, struct compact_info *info);
 
 
 #endif /* OBJECT_MEMORY_H */
@@ -129,6 +129,17 @@ void wait_for_kernel_stack(struct thread *thread);
 
 int sched_init(struct sched_ops *sched_ops);
 
+/*
+ * Kernel threads, bound to @cpuid. @routine runs on the per-CPU stack with
+ * interrupts masked, and restarts from its beginning every time the thread
+ * is scheduled: it must end with kernel_thread_sleep(), which gives up the
+ * CPU until kernel_thread_wakeup() is called on that same CPU.
+ */
+struct thread *create_kernel_thread(void (*routine)(void), unsigned int prio,
+                                    unsigned int cpuid);
+void kernel_thread_sleep(void) __attribute__((noreturn));
+void kernel_thread_wakeup(struct thread *thread);
+
 static inline int sched(void)
 {
         return cur_sched_ops->sched();
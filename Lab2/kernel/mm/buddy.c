@@ -124,20 +124,13 @@ void init_buddy(struct phys_mem_pool *pool, struct page *start_page,
         }
 }
 
-struct page *buddy_get_pages(struct phys_mem_pool *pool, int order)
+/* Must be called with pool->buddy_lock held. */
+static struct page *__buddy_get_pages(struct phys_mem_pool *pool, int order)
 {
         int cur_order;
         struct list_head *free_list;
         struct page *page = NULL;
 
-        if (unlikely(order >= BUDDY_MAX_ORDER)) {
-                kwarn("ChCore does not support allocating such too large "
-                      "continuous physical memory\n");
-                return NULL;
-        }
-
-        lock(&pool->buddy_lock);
-
         /* LAB 2 TODO 1 BEGIN */
         /*
          * Hint: Find a chunk that satisfies the order requirement
@@ -150,15 +143,14 @@ struct page *buddy_get_pages(struct phys_mem_pool *pool, int order)
         /* BLANK END */
         /* LAB 2 TODO 1 END */
 out: __maybe_unused
-        unlock(&pool->buddy_lock);
         return page;
 }
 
-void buddy_free_pages(struct phys_mem_pool *pool, struct page *page)
+/* Must be called with pool->buddy_lock held. */
+static void __buddy_free_pages(struct phys_mem_pool *pool, struct page *page)
 {
         int order;
         struct list_head *free_list;
-        lock(&pool->buddy_lock);
 
         /* LAB 2 TODO 1 BEGIN */
         /*
@@ -170,8 +162,197 @@ void buddy_free_pages(struct phys_mem_pool *pool, struct page *page)
         UNUSED(order);
         /* BLANK END */
         /* LAB 2 TODO 1 END */
+}
+
+struct page *buddy_get_pages(struct phys_mem_pool *pool, int order)
+{
+        struct page *page;
+
+        if (unlikely(order >= BUDDY_MAX_ORDER)) {
+                kwarn("ChCore does not support allocating such too large "
+                      "continuous physical memory\n");
+                return NULL;
+        }
+
+        lock(&pool->buddy_lock);
+        page = __buddy_get_pages(pool, order);
+        unlock(&pool->buddy_lock);
+        return page;
+}
+
+void buddy_free_pages(struct phys_mem_pool *pool, struct page *page)
+{
+        lock(&pool->buddy_lock);
+        __buddy_free_pages(pool, page);
+        unlock(&pool->buddy_lock);
+}
+
+/*
+ * Allocate at most @count chunks of @order with a single acquisition of
+ * buddy_lock and append them to the tail of @list (linked by page->node).
+ * Return the number of chunks actually allocated.
+ */
+int buddy_get_pages_bulk(struct phys_mem_pool *pool, int order, int count,
+                         struct list_head *list)
+{
+        struct page *page;
+        int i;
+
+        if (unlikely(order >= BUDDY_MAX_ORDER))
+                return 0;
+
+        lock(&pool->buddy_lock);
+        for (i = 0; i < count; i++) {
+                page = __buddy_get_pages(pool, order);
+                if (!page)
+                        break;
+                list_append(&page->node, list);
+        }
+        unlock(&pool->buddy_lock);
+
+        return i;
+}
+
+/*
+ * Return every chunk on @list to @pool with a single acquisition of
+ * buddy_lock. All the chunks must belong to @pool.
+ */
+void buddy_free_pages_bulk(struct phys_mem_pool *pool, struct list_head *list)
+{
+        struct page *page;
+
+        lock(&pool->buddy_lock);
+        while (!list_empty(list)) {
+                page = list_entry(list->next, struct page, node);
+                BUG_ON(page->pool != pool);
+                list_del(&page->node);
+                __buddy_free_pages(pool, page);
+        }
+        unlock(&pool->buddy_lock);
+}
+
+/*
+ * Turn an allocated chunk into (1 << order) allocated order-0 pages, so
+ * that each of them can be freed on its own. Freed pages are merged back
+ * by the buddy system as usual.
+ */
+void buddy_split_pages(struct phys_mem_pool *pool, struct page *page)
+{
+        int i, nr;
+
+        lock(&pool->buddy_lock);
+        BUG_ON(!page->allocated);
+        nr = 1 << page->order;
+        for (i = 0; i < nr; i++) {
+                page[i].allocated = 1;
+                page[i].order = 0;
+                page[i].slab = NULL;
+        }
+        unlock(&pool->buddy_lock);
+}
+
+/*
+ * Choose the aligned block of (1 << order) pages in @pool that has the most
+ * free pages while holding nothing but free chunks and allocated order-0
+ * pages, which are the only ones compaction may migrate. The free chunks
+ * of the block are taken off the free lists and appended to @isolated, so
+ * that they are not handed out while the rest of the block is migrated.
+ * Releasing them with buddy_free_pages_bulk() lets the block merge again.
+ *
+ * Return the first page of the block, or NULL if there is no candidate.
+ */
+struct page *buddy_isolate_block(struct phys_mem_pool *pool, int order,
+                                 struct list_head *isolated)
+{
+        unsigned long nr_pages, block_pages, idx, nr_free = 0, best_free = 0;
+        vaddr_t addr, block, cur_block = 0, best = 0;
+        struct page *page, *head;
+        bool movable = false;
+
+        BUG_ON(order <= 0 || order >= BUDDY_MAX_ORDER);
+        block_pages = 1UL << order;
+        nr_pages = pool->pool_phys_page_num;
+
+        lock(&pool->buddy_lock);
+
+        /* Chunks tile the pool, so walking chunk by chunk visits each head */
+        for (idx = 0; idx < nr_pages; idx += 1UL << page->order) {
+                page = pool->page_metadata + idx;
+                addr = (vaddr_t)page_to_virt(page);
+                block = ROUND_DOWN(addr, BUDDY_PAGE_SIZE * block_pages);
+
+                if (block != cur_block) {
+                        if (movable && nr_free > best_free) {
+                                best = cur_block;
+                                best_free = nr_free;
+                        }
+                        cur_block = block;
+                        nr_free = 0;
+                        /* A block crossing the pool boundary never merges */
+                        movable = block >= pool->pool_start_addr
+                                  && block + BUDDY_PAGE_SIZE * block_pages
+                                             <= pool->pool_start_addr
+                                                        + pool->pool_mem_size;
+                }
+
+                if (page->order >= order) {
+                        /* Already a free chunk of @order, or unmovable */
+                        movable = false;
+                } else if (!page->allocated) {
+                        nr_free += 1UL << page->order;
+                } else if (page->order != 0 || page->slab != NULL) {
+                        movable = false;
+                }
+        }
+        if (movable && nr_free > best_free) {
+                best = cur_block;
+                best_free = nr_free;
+        }
+
+        if (best_free == 0) {
+                unlock(&pool->buddy_lock);
+                return NULL;
+        }
+
+        head = virt_to_page((void *)best);
+        for (idx = 0; idx < block_pages; idx += 1UL << page->order) {
+                page = head + idx;
+                if (page->allocated)
+                        continue;
+                list_del(&page->node);
+                pool->free_lists[page->order].nr_free--;
+                page->allocated = 1;
+                list_append(&page->node, isolated);
+        }
 
         unlock(&pool->buddy_lock);
+        return head;
+}
+
+/*
+ * Fragmentation index of @order in thousandths, given the number of free
+ * chunks of each order. It is -1000 when a chunk of @order is free, and
+ * otherwise tends to 0 when an allocation of @order fails for lack of
+ * memory and to 1000 when it fails because free memory is fragmented,
+ * i.e., when compaction may help.
+ */
+int fragmentation_index(const unsigned long *nr_free, int order)
+{
+        unsigned long free_pages = 0, free_chunks = 0;
+        int i;
+
+        for (i = 0; i < BUDDY_MAX_ORDER; i++) {
+                if (i >= order && nr_free[i] != 0)
+                        return -1000;
+                free_pages += nr_free[i] << i;
+                free_chunks += nr_free[i];
+        }
+
+        if (free_chunks == 0)
+                return 0;
+        return 1000
+               - (int)((1000 + free_pages * 1000 / (1UL << order))
+                       / free_chunks);
 }
 
 void *page_to_virt(struct page *page)
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * On-demand memory compaction.
+ *
+ * High-order allocations fail once free memory is fragmented, even if many
+ * order-0 pages are free. A compaction pass picks, in each pool, the
+ * aligned block of the requested order with the most free pages, isolates
+ * its free chunks and migrates the remaining pages out of it so that the
+ * whole block merges when everything is given back to the buddy allocator.
+ *
+ * Only pages of PMO_ANONYM pmos are movable: they are found through the
+ * vmrs mapping such pmos, reached through the pmo radix trees and remapped
+ * through the pmo mapping_list. Any other allocated page makes its block
+ * unsuitable, which is checked by matching the allocated pages of the block
+ * against the pages found in those radix trees. Struct pmobject is also
+ * allocated by the prebuilt objects, so the vmrs are tracked instead of the
+ * pmos themselves.
+ */
+
+#include <common/types.h>
+#include <common/errno.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <common/radix.h>
+#include <common/util.h>
+#include <common/kprint.h>
+#include <mm/mm.h>
+#include <mm/kmalloc.h>
+#include <mm/vmspace.h>
+#include <object/memory.h>
+#include <arch/mmu.h>
+
+/* Give up a page mapped by more vmrs than this */
+#define COMPACT_MAX_MAPPINGS 8
+/* Attempts to get a destination page outside of the block */
+#define COMPACT_ALLOC_RETRY  4
+
+/*
+ * Vmrs of movable pmos, also serializes compaction passes. A vmr, and so
+ * the pmo it maps, cannot go away during a pass, since it is untracked
+ * before being freed.
+ */
+static DEFINE_SPINLOCK(compact_lock);
+static struct list_head compact_vmrs = {&compact_vmrs, &compact_vmrs};
+
+struct compact_page {
+        struct pmobject *pmo;
+        unsigned long index;
+        paddr_t pa;
+};
+
+struct compact_control {
+        paddr_t start;
+        paddr_t end;
+        struct compact_page *pages;
+        unsigned long nr_pages;
+        unsigned long max_pages;
+        /* Isolated free chunks and migrated source pages */
+        struct list_head isolated;
+        struct list_head migrated;
+        /* Pages of the block handed out as destination pages, see below */
+        struct list_head rejected;
+};
+
+struct compact_mapping {
+        struct vmregion *vmr;
+        vaddr_t va;
+        pte_t pte;
+        bool mapped;
+};
+
+void compaction_track_vmr(struct vmregion *vmr)
+{
+        lock(&compact_lock);
+        list_add(&vmr->compact_node, &compact_vmrs);
+        unlock(&compact_lock);
+}
+
+void compaction_untrack_vmr(struct vmregion *vmr)
+{
+        lock(&compact_lock);
+        list_del(&vmr->compact_node);
+        unlock(&compact_lock);
+}
+
+/* A pmo mapped by several vmrs is walked once per vmr */
+static bool page_collected(struct compact_control *cc, paddr_t pa)
+{
+        unsigned long i;
+
+        for (i = 0; i < cc->nr_pages; i++) {
+                if (cc->pages[i].pa == pa)
+                        return true;
+        }
+        return false;
+}
+
+/*
+ * lib/radix.c has no iterator, so the tree is walked here following its
+ * layout: the root consumes the most significant RADIX_NODE_BITS of the
+ * key and the nodes of the last level hold the values.
+ */
+static void collect_radix_node(struct compact_control *cc,
+                               struct pmobject *pmo, struct radix_node *node,
+                               int level, u64 prefix)
+{
+        paddr_t pa;
+        int i;
+
+        for (i = 0; i < RADIX_NODE_SIZE; i++) {
+                if (level == RADIX_LEVELS - 1) {
+                        pa = (paddr_t)node->values[i];
+                        if (pa < cc->start || pa >= cc->end
+                            || page_collected(cc, pa))
+                                continue;
+                        if (cc->nr_pages == cc->max_pages)
+                                return;
+                        cc->pages[cc->nr_pages].pmo = pmo;
+                        cc->pages[cc->nr_pages].index =
+                                (prefix << RADIX_NODE_BITS) | i;
+                        cc->pages[cc->nr_pages].pa = pa;
+                        cc->nr_pages++;
+                } else if (node->children[i] != NULL) {
+                        collect_radix_node(cc,
+                                           pmo,
+                                           node->children[i],
+                                           level + 1,
+                                           (prefix << RADIX_NODE_BITS) | i);
+                }
+        }
+}
+
+static void collect_pmo_pages(struct compact_control *cc, struct pmobject *pmo)
+{
+        struct radix *radix = pmo->radix;
+
+        lock(&radix->radix_lock);
+        if (radix->root != NULL)
+                collect_radix_node(cc, pmo, radix->root, 0, 0);
+        unlock(&radix->radix_lock);
+}
+
+/* Replace the value of @key in @radix if it is still @old */
+static int radix_replace(struct radix *radix, u64 key, paddr_t old,
+                         paddr_t new)
+{
+        struct radix_node *node;
+        int level, index, ret = -ENOENT;
+
+        lock(&radix->radix_lock);
+        node = radix->root;
+        for (level = 0; node != NULL && level < RADIX_LEVELS - 1; level++) {
+                index = (key >> ((RADIX_LEVELS - 1 - level) * RADIX_NODE_BITS))
+                        & RADIX_NODE_MASK;
+                node = node->children[index];
+        }
+        if (node != NULL) {
+                index = key & RADIX_NODE_MASK;
+                if ((paddr_t)node->values[index] == old) {
+                        node->values[index] = (void *)new;
+                        ret = 0;
+                }
+        }
+        unlock(&radix->radix_lock);
+        return ret;
+}
+
+/* Return a free page outside of the block under compaction */
+static void *alloc_target_page(struct compact_control *cc)
+{
+        void *page;
+        paddr_t pa;
+        int i;
+
+        for (i = 0; i < COMPACT_ALLOC_RETRY; i++) {
+                page = get_pages(0);
+                if (page == NULL)
+                        return NULL;
+                pa = virt_to_phys(page);
+                if (pa < cc->start || pa >= cc->end)
+                        return page;
+                /* Freed into the block meanwhile: keep it off the lists */
+                list_append(&virt_to_page(page)->node, &cc->rejected);
+        }
+        return NULL;
+}
+
+static void unlock_mappings(struct compact_mapping *maps, int nr)
+{
+        int i;
+
+        for (i = 0; i < nr; i++) {
+                unlock(&maps[i].vmr->fault_lock);
+                read_unlock(vmspace_vmr_lock(maps[i].vmr->vmspace));
+        }
+}
+
+/*
+ * Move one page of a pmo to @new. Every mapping is invalidated (and its
+ * TLB entries flushed) before the copy and pointed to @new afterwards,
+ * while page faults on the vmrs are held off by their fault_lock.
+ *
+ * Only try-locks are taken on the vmspace and vmr locks, since they are
+ * acquired in the opposite order on the unmap path; a busy page is simply
+ * skipped. Kernel accesses through read/write_pmo are not serialized.
+ */
+static int migrate_page(struct compact_page *cp, void *new)
+{
+        struct compact_mapping maps[COMPACT_MAX_MAPPINGS];
+        struct pmobject *pmo = cp->pmo;
+        struct vmregion *vmr;
+        struct vmspace *vmspace;
+        struct tlb_batch batch;
+        size_t offset = cp->index * PAGE_SIZE;
+        paddr_t dst = virt_to_phys(new);
+        int nr = 0, i, ret = 0;
+
+        lock(pmo_mapping_lock(pmo));
+        for_each_in_list (vmr, struct vmregion, mapping_list_node,
+                          &pmo->mapping_list) {
+                if (nr == COMPACT_MAX_MAPPINGS || vmr->vmspace == NULL) {
+                        ret = -EBUSY;
+                        goto out_unlock;
+                }
+                if (read_try_lock(vmspace_vmr_lock(vmr->vmspace)) != 0) {
+                        ret = -EAGAIN;
+                        goto out_unlock;
+                }
+                if (try_lock(&vmr->fault_lock) != 0) {
+                        read_unlock(vmspace_vmr_lock(vmr->vmspace));
+                        ret = -EAGAIN;
+                        goto out_unlock;
+                }
+                maps[nr].vmr = vmr;
+                maps[nr].mapped = false;
+                nr++;
+        }
+
+        if ((paddr_t)radix_get(pmo->radix, cp->index) != cp->pa) {
+                ret = -EAGAIN;
+                goto out_unlock;
+        }
+
+        for (i = 0; i < nr; i++) {
+                vmr = maps[i].vmr;
+                if (offset < vmr->offset || offset - vmr->offset >= vmr->size)
+                        continue;
+                vmspace = vmr->vmspace;
+                maps[i].va = vmr->start + offset - vmr->offset;
+
+                lock(&vmspace->pgtbl_lock);
+                ret = isolate_page_in_pgtbl(
+                        vmspace->pgtbl, maps[i].va, cp->pa, &maps[i].pte);
+                unlock(&vmspace->pgtbl_lock);
+
+                if (ret == -ENOMAPPING) {
+                        ret = 0;
+                        continue;
+                }
+                if (ret != 0) {
+                        /* e.g., -EBUSY when mapped by a huge page */
+                        dst = cp->pa;
+                        goto out_restore;
+                }
+
+                maps[i].mapped = true;
+                tlb_batch_init(&batch, vmspace);
+                tlb_batch_add(&batch, maps[i].va, PAGE_SIZE);
+                tlb_batch_flush(&batch);
+        }
+
+        memcpy(new, (void *)phys_to_virt(cp->pa), PAGE_SIZE);
+        BUG_ON(radix_replace(pmo->radix, cp->index, cp->pa, dst));
+
+out_restore:
+        for (i = 0; i < nr; i++) {
+                if (!maps[i].mapped)
+                        continue;
+                vmspace = maps[i].vmr->vmspace;
+                lock(&vmspace->pgtbl_lock);
+                BUG_ON(restore_page_in_pgtbl(
+                        vmspace->pgtbl, maps[i].va, maps[i].pte, dst));
+                unlock(&vmspace->pgtbl_lock);
+        }
+out_unlock:
+        unlock_mappings(maps, nr);
+        unlock(pmo_mapping_lock(pmo));
+        return ret;
+}
+
+/* Try to free one block of @order in @pool. Called with compact_lock held. */
+static void compact_pool(struct phys_mem_pool *pool, int order,
+                         struct compact_info *info)
+{
+        struct compact_control cc;
+        struct vmregion *vmr;
+        struct page *head, *page;
+        unsigned long i, nr_allocated;
+        void *new;
+
+        init_list_head(&cc.isolated);
+        init_list_head(&cc.migrated);
+        init_list_head(&cc.rejected);
+        cc.max_pages = 1UL << order;
+        cc.nr_pages = 0;
+        cc.pages = kmalloc(cc.max_pages * sizeof(*cc.pages));
+        if (cc.pages == NULL)
+                return;
+
+        head = buddy_isolate_block(pool, order, &cc.isolated);
+        if (head == NULL)
+                goto out_free;
+        info->nr_blocks++;
+
+        cc.start = virt_to_phys(page_to_virt(head));
+        cc.end = cc.start + (BUDDY_PAGE_SIZE << order);
+
+        nr_allocated = cc.max_pages;
+        for_each_in_list (page, struct page, node, &cc.isolated)
+                nr_allocated -= 1UL << page->order;
+
+        for_each_in_list (vmr, struct vmregion, compact_node, &compact_vmrs)
+                collect_pmo_pages(&cc, vmr->pmo);
+
+        /*
+         * The buddy allocator only knows that the allocated pages of the
+         * block are order-0 pages. Page tables, kernel pages and pages of
+         * other pmos are such pages too, so give up unless every one of
+         * them was found in the radix of a movable pmo.
+         */
+        if (cc.nr_pages != nr_allocated) {
+                info->nr_unsuitable++;
+                goto out_release;
+        }
+
+        for (i = 0; i < cc.nr_pages; i++) {
+                new = alloc_target_page(&cc);
+                if (new == NULL) {
+                        info->nr_failed += cc.nr_pages - i;
+                        break;
+                }
+                if (migrate_page(&cc.pages[i], new) != 0) {
+                        free_pages(new);
+                        info->nr_failed++;
+                        continue;
+                }
+                info->nr_migrated++;
+                page = virt_to_page((void *)phys_to_virt(cc.pages[i].pa));
+                list_append(&page->node, &cc.migrated);
+        }
+
+        /*
+         * Source pages go back to the buddy allocator only now, so that
+         * none of them was reused as a destination page. Rejected
+         * destination pages came from get_pages() as well, so they are
+         * freed the same way to revert their usage record.
+         */
+        while (!list_empty(&cc.migrated)) {
+                page = list_entry(cc.migrated.next, struct page, node);
+                list_del(&page->node);
+                free_pages(page_to_virt(page));
+        }
+out_release:
+        while (!list_empty(&cc.rejected)) {
+                page = list_entry(cc.rejected.next, struct page, node);
+                list_del(&page->node);
+                free_pages(page_to_virt(page));
+        }
+        drain_page_caches();
+        buddy_free_pages_bulk(pool, &cc.isolated);
+
+out_free:
+        kfree(cc.pages);
+}
+
+static bool order_available(int order, int *frag_index)
+{
+        struct mem_pool_stats stats;
+        bool available = false;
+        int i;
+
+        if (frag_index != NULL)
+                *frag_index = -1000;
+        for (i = 0; i < physmem_map_num; i++) {
+                get_mem_pool_stats(i, &stats);
+                if (stats.max_free_order >= order)
+                        available = true;
+                if (frag_index != NULL)
+                        *frag_index = MAX(*frag_index, stats.frag_index[order]);
+        }
+        return available;
+}
+
+/*
+ * Compact memory until a free chunk of @order exists, trying at most one
+ * block per pool. Return 0 on success and -ENOMEM otherwise.
+ */
+int compact_memory(int order, struct compact_info *info)
+{
+        int i;
+
+        if (order <= 0 || order >= BUDDY_MAX_ORDER)
+                return -EINVAL;
+
+        memset(info, 0, sizeof(*info));
+        info->order = order;
+
+        lock(&compact_lock);
+
+        /* Cached pages look allocated to the buddy allocator */
+        drain_page_caches();
+
+        if (!order_available(order, &info->frag_index)) {
+                for (i = 0; i < physmem_map_num; i++) {
+                        compact_pool(&global_mem[i], order, info);
+                        if (order_available(order, NULL))
+                                break;
+                }
+        }
+        info->success = order_available(order, NULL);
+
+        unlock(&compact_lock);
+
+        kdebug("compaction of order %d: %ld blocks (%ld unsuitable), "
+               "%ld migrated, %ld failed\n",
+               order,
+               info->nr_blocks,
+               info->nr_unsuitable,
+               info->nr_migrated,
+               info->nr_failed);
+        return info->success ? 0 : -ENOMEM;
+}
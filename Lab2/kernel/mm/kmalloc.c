@@ -17,25 +17,370 @@
 #include <common/util.h>
 #include <common/kprint.h>
 #include <lib/mem_usage_info_tool.h>
+#include <common/sync.h>
+#include <arch/machine/smp.h>
 
 #include <mm/slab.h>
 #include <mm/buddy.h>
+#include <sched/sched.h>
 
 #define SLAB_MAX_SIZE (1UL << SLAB_MAX_ORDER)
 #define ZERO_SIZE_PTR ((void *)(-1UL))
 
-void *_get_pages(int order, bool is_record)
+static struct per_cpu_pages pcp[PLAT_CPU_NUM];
+static struct zero_page_pool zero_pools[PLAT_CPU_NUM];
+
+static enum mem_policy mem_policy = MEM_POLICY_DEFAULT;
+static unsigned long interleave_next;
+
+/* Updated with atomic adds, only on the buddy slow path. */
+static struct {
+        unsigned long alloc;
+        unsigned long fallback;
+        unsigned long fail;
+} pool_counters[N_PHYS_MEM_POOLS];
+
+int set_mem_policy(enum mem_policy policy)
 {
-        struct page *page = NULL;
+        if (policy < 0 || policy >= MEM_POLICY_NUM)
+                return -EINVAL;
+        mem_policy = policy;
+        return 0;
+}
+
+enum mem_policy get_mem_policy(void)
+{
+        return mem_policy;
+}
+
+/* Return the pool the next buddy allocation should be tried on first. */
+static int preferred_pool(void)
+{
+        unsigned long key;
+
+        if (physmem_map_num <= 1)
+                return 0;
+
+        switch (mem_policy) {
+        case MEM_POLICY_LOCAL:
+                key = smp_get_cpu_id();
+                break;
+        case MEM_POLICY_INTERLEAVE:
+                key = atomic_fetch_add_long(&interleave_next, 1);
+                break;
+        default:
+                key = 0;
+                break;
+        }
+        return key % physmem_map_num;
+}
+
+static inline int nth_pool(int preferred, int n)
+{
+        return (preferred + n) % physmem_map_num;
+}
+
+static void pool_account(int pool, int preferred, bool ok)
+{
+        if (!ok) {
+                atomic_fetch_add_long(&pool_counters[pool].fail, 1);
+                return;
+        }
+        atomic_fetch_add_long(&pool_counters[pool].alloc, 1);
+        if (pool != preferred)
+                atomic_fetch_add_long(&pool_counters[pool].fallback, 1);
+}
+
+void get_mem_pool_stats(int pool, struct mem_pool_stats *stats)
+{
+        struct phys_mem_pool *p;
+        int order;
+
+        BUG_ON(pool < 0 || pool >= physmem_map_num);
+        p = &global_mem[pool];
+
+        stats->alloc = pool_counters[pool].alloc;
+        stats->fallback = pool_counters[pool].fallback;
+        stats->fail = pool_counters[pool].fail;
+        stats->free_size = 0;
+        stats->max_free_order = -1;
+
+        lock(&p->buddy_lock);
+        for (order = 0; order < BUDDY_MAX_ORDER; order++) {
+                stats->nr_free[order] = p->free_lists[order].nr_free;
+                stats->free_size += stats->nr_free[order]
+                                    * (BUDDY_PAGE_SIZE << order);
+                if (stats->nr_free[order])
+                        stats->max_free_order = order;
+        }
+        unlock(&p->buddy_lock);
+
+        for (order = 0; order < BUDDY_MAX_ORDER; order++)
+                stats->frag_index[order] =
+                        fragmentation_index(stats->nr_free, order);
+}
+
+static inline int pcp_batch(int order)
+{
+        return MAX(PCP_BATCH >> order, 1);
+}
+
+static inline unsigned long pcp_high(int order)
+{
+        return MAX(PCP_HIGH >> order, 2 * pcp_batch(order));
+}
+
+void init_pcp(void)
+{
+        int cpu, order;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                BUG_ON(lock_init(&pcp[cpu].lock) != 0);
+                for (order = 0; order < PCP_MAX_ORDER; order++) {
+                        init_list_head(&pcp[cpu].lists[order]);
+                        pcp[cpu].count[order] = 0;
+                }
+                memset(&pcp[cpu].stats, 0, sizeof(pcp[cpu].stats));
+        }
+}
+
+/*
+ * Return the @count coldest chunks of @order on @p to their buddy pools.
+ * Must be called with p->lock held.
+ */
+static void pcp_drain_locked(struct per_cpu_pages *p, int order,
+                             unsigned long count)
+{
+        struct list_head batch[N_PHYS_MEM_POOLS];
+        struct page *page;
         int i;
-        void *addr;
 
-        /* Try to get continuous physical memory pages from one physmem pool. */
+        for (i = 0; i < physmem_map_num; i++)
+                init_list_head(&batch[i]);
+
+        while (count-- > 0 && !list_empty(&p->lists[order])) {
+                page = list_entry(p->lists[order].prev, struct page, node);
+                list_del(&page->node);
+                p->count[order]--;
+                list_append(&page->node,
+                            &batch[page->pool - global_mem]);
+        }
+
+        for (i = 0; i < physmem_map_num; i++) {
+                if (!list_empty(&batch[i])) {
+                        buddy_free_pages_bulk(&global_mem[i], &batch[i]);
+                        p->stats.drain++;
+                }
+        }
+}
+
+/* Refill the list of @order on @p. Must be called with p->lock held. */
+static int pcp_refill_locked(struct per_cpu_pages *p, int order)
+{
+        int i, pool, preferred, got = 0;
+
+        preferred = preferred_pool();
+        for (i = 0; i < physmem_map_num && got == 0; ++i) {
+                pool = nth_pool(preferred, i);
+                got = buddy_get_pages_bulk(&global_mem[pool], order,
+                                           pcp_batch(order), &p->lists[order]);
+                pool_account(pool, preferred, got != 0);
+        }
+
+        p->count[order] += got;
+        p->stats.refill++;
+        return got;
+}
+
+static struct page *pcp_get_page(int order)
+{
+        struct per_cpu_pages *p = &pcp[smp_get_cpu_id()];
+        struct page *page = NULL;
+
+        lock(&p->lock);
+        if (list_empty(&p->lists[order])) {
+                p->stats.alloc_miss++;
+                if (pcp_refill_locked(p, order) == 0)
+                        goto out;
+        } else {
+                p->stats.alloc_hit++;
+        }
+
+        page = list_entry(p->lists[order].next, struct page, node);
+        list_del(&page->node);
+        p->count[order]--;
+out:
+        unlock(&p->lock);
+        return page;
+}
+
+static void pcp_free_page(struct page *page)
+{
+        struct per_cpu_pages *p = &pcp[smp_get_cpu_id()];
+        int order = page->order;
+
+        lock(&p->lock);
+        /* Hot chunks go to the head and will be reused first. */
+        list_add(&page->node, &p->lists[order]);
+        p->count[order]++;
+        p->stats.free_hit++;
+        if (p->count[order] > pcp_high(order))
+                pcp_drain_locked(p, order, pcp_batch(order));
+        unlock(&p->lock);
+}
+
+/* Give back every chunk cached on any CPU. Used as the last resort on OOM. */
+static void pcp_drain_all(void)
+{
+        int cpu, order;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                lock(&pcp[cpu].lock);
+                for (order = 0; order < PCP_MAX_ORDER; order++)
+                        pcp_drain_locked(&pcp[cpu], order,
+                                         pcp[cpu].count[order]);
+                unlock(&pcp[cpu].lock);
+        }
+}
+
+unsigned long get_free_mem_size_from_pcp(void)
+{
+        unsigned long total_size = 0;
+        int cpu, order;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                lock(&pcp[cpu].lock);
+                for (order = 0; order < PCP_MAX_ORDER; order++)
+                        total_size += pcp[cpu].count[order]
+                                      * (BUDDY_PAGE_SIZE << order);
+                unlock(&pcp[cpu].lock);
+        }
+        return total_size;
+}
+
+void get_pcp_stats(int cpu, struct pcp_stats *stats)
+{
+        BUG_ON(cpu < 0 || cpu >= PLAT_CPU_NUM);
+        lock(&pcp[cpu].lock);
+        *stats = pcp[cpu].stats;
+        unlock(&pcp[cpu].lock);
+}
+
+void init_zero_pools(void)
+{
+        int cpu;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                BUG_ON(lock_init(&zero_pools[cpu].lock) != 0);
+                init_list_head(&zero_pools[cpu].pages);
+                zero_pools[cpu].count = 0;
+                memset(&zero_pools[cpu].stats, 0,
+                       sizeof(zero_pools[cpu].stats));
+        }
+}
+
+static void *zero_pool_get_page(void)
+{
+        struct zero_page_pool *zp = &zero_pools[smp_get_cpu_id()];
+        struct page *page = NULL;
+
+        lock(&zp->lock);
+        if (!list_empty(&zp->pages)) {
+                page = list_entry(zp->pages.next, struct page, node);
+                list_del(&page->node);
+                zp->count--;
+                zp->stats.hit++;
+        } else {
+                zp->stats.miss++;
+        }
+        unlock(&zp->lock);
+
+        return page ? page_to_virt(page) : NULL;
+}
+
+/* Give back every pre-zeroed page. Used as the last resort on OOM. */
+static void zero_pool_drain_all(void)
+{
+        struct page *page;
+        int cpu;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                lock(&zero_pools[cpu].lock);
+                while (!list_empty(&zero_pools[cpu].pages)) {
+                        page = list_entry(zero_pools[cpu].pages.next,
+                                          struct page, node);
+                        list_del(&page->node);
+                        zero_pools[cpu].count--;
+                        buddy_free_pages(page->pool, page);
+                }
+                unlock(&zero_pools[cpu].lock);
+        }
+}
+
+/* Return every page cached in front of the buddy allocator to it. */
+void drain_page_caches(void)
+{
+        pcp_drain_all();
+        zero_pool_drain_all();
+}
+
+unsigned long get_free_mem_size_from_zero_pools(void)
+{
+        unsigned long total_size = 0;
+        int cpu;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                lock(&zero_pools[cpu].lock);
+                total_size += zero_pools[cpu].count * BUDDY_PAGE_SIZE;
+                unlock(&zero_pools[cpu].lock);
+        }
+        return total_size;
+}
+
+void get_zero_pool_stats(int cpu, struct zero_pool_stats *stats)
+{
+        BUG_ON(cpu < 0 || cpu >= PLAT_CPU_NUM);
+        lock(&zero_pools[cpu].lock);
+        *stats = zero_pools[cpu].stats;
+        unlock(&zero_pools[cpu].lock);
+}
+
+static struct page *get_pages_from_pools(int order)
+{
+        struct page *page = NULL;
+        int i, pool, preferred;
+
+        /*
+         * Try to get continuous physical memory pages from one physmem pool,
+         * starting from the pool preferred by the current policy.
+         */
+        preferred = preferred_pool();
         for (i = 0; i < physmem_map_num; ++i) {
-                page = buddy_get_pages(&global_mem[i], order);
+                pool = nth_pool(preferred, i);
+                page = buddy_get_pages(&global_mem[pool], order);
+                pool_account(pool, preferred, page != NULL);
                 if (page)
                         break;
         }
+        return page;
+}
+
+void *_get_pages(int order, bool is_record)
+{
+        struct page *page = NULL;
+        void *addr;
+
+        if (order < PCP_MAX_ORDER)
+                page = pcp_get_page(order);
+        else
+                page = get_pages_from_pools(order);
+
+        if (unlikely(!page)) {
+                /* Chunks cached on other CPUs may still be merged. */
+                pcp_drain_all();
+                zero_pool_drain_all();
+                page = get_pages_from_pools(order);
+        }
 
         if (unlikely(!page)) {
                 kwarn("[OOM] Cannot get page from any memory pool!\n");
@@ -70,7 +415,10 @@ void _free_pages(void *addr, bool is_revoke_record)
                 revoke_mem_usage(addr);
 	}
 #endif
-        buddy_free_pages(page->pool, page);
+        if (page->order < PCP_MAX_ORDER)
+                pcp_free_page(page);
+        else
+                buddy_free_pages(page->pool, page);
 }
 
 void free_pages(void *addr)
@@ -83,6 +431,108 @@ void free_pages_without_record(void *addr)
         _free_pages(addr, false);
 }
 
+/*
+ * Zero pages into the pool of the local CPU until it holds ZERO_POOL_HIGH.
+ * The pages are zeroed without holding the pool lock and are not recorded
+ * as used memory until handed out.
+ */
+static void zero_pool_refill(void)
+{
+        struct zero_page_pool *zp = &zero_pools[smp_get_cpu_id()];
+        struct page *page;
+        void *addr;
+
+        while (zp->count < ZERO_POOL_HIGH) {
+                addr = _get_pages(0, false);
+                if (!addr)
+                        return;
+                memset(addr, 0, BUDDY_PAGE_SIZE);
+
+                page = virt_to_page(addr);
+                lock(&zp->lock);
+                list_add(&page->node, &zp->pages);
+                zp->count++;
+                zp->stats.refill++;
+                unlock(&zp->lock);
+        }
+}
+
+static struct thread *zero_pool_threads[PLAT_CPU_NUM];
+
+static void zero_pool_thread_routine(void)
+{
+        zero_pool_refill();
+        kernel_thread_sleep();
+}
+
+/* Start the refill thread of each CPU, which fills its pool right away. */
+void init_zero_pool_threads(void)
+{
+        int cpu;
+
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                zero_pool_threads[cpu] = create_kernel_thread(
+                        zero_pool_thread_routine, MIN_PRIO, cpu);
+                BUG_ON(!zero_pool_threads[cpu]);
+        }
+}
+
+/*
+ * Return the vaddr of one zero-filled physical page, preferably taken from
+ * the pre-zeroed pool of the local CPU. Freed with free_pages or kfree.
+ */
+void *get_zeroed_page(void)
+{
+        struct thread *refill_thread;
+        void *addr;
+
+        addr = zero_pool_get_page();
+
+        /* Only the local CPU touches its refill thread (see sched.h). */
+        refill_thread = zero_pool_threads[smp_get_cpu_id()];
+        if (refill_thread && zero_pools[smp_get_cpu_id()].count < ZERO_POOL_LOW)
+                kernel_thread_wakeup(refill_thread);
+
+        if (!addr) {
+                addr = _get_pages(0, false);
+                if (!addr)
+                        return NULL;
+                memset(addr, 0, BUDDY_PAGE_SIZE);
+        }
+
+#if ENABLE_MEMORY_USAGE_COLLECTING == ON
+        if (collecting_switch)
+                record_mem_usage(BUDDY_PAGE_SIZE, addr);
+#endif
+        return addr;
+}
+
+/*
+ * Split a chunk returned by get_pages(order) into order-0 pages that are
+ * freed one by one with free_pages (e.g., huge pages recorded page by page
+ * in a pmo).
+ */
+void split_pages(void *addr)
+{
+        struct page *page;
+        __maybe_unused int nr;
+
+        page = virt_to_page(addr);
+        BUG_ON(!page || !page->pool);
+        nr = 1 << page->order;
+        buddy_split_pages(page->pool, page);
+
+#if ENABLE_MEMORY_USAGE_COLLECTING == ON
+        /* Each page is revoked on its own when freed, so record them so */
+        if (collecting_switch) {
+                revoke_mem_usage(addr);
+                for (int i = 0; i < nr; i++)
+                        record_mem_usage(BUDDY_PAGE_SIZE,
+                                         addr + i * BUDDY_PAGE_SIZE);
+        }
+#endif
+}
+
 __maybe_unused static int size_to_page_order(unsigned long size)
 {
         unsigned long order;
@@ -172,6 +622,8 @@ void _kfree(void *ptr, bool is_revoke_record)
 #endif
         if (page && page->slab)
                 free_in_slab(ptr);
+        else if (page && page->pool && page->order < PCP_MAX_ORDER)
+                pcp_free_page(page);
         else if (page && page->pool)
                 buddy_free_pages(page->pool, page);
         else
@@ -85,8 +85,15 @@ void mm_init(void *physmem_info)
              ++physmem_map_idx)
                 init_buddy_for_one_physmem_map(physmem_map_idx);
 
-        /* Step-3: init the slab allocator. */
+        /* Step-3: init the per-CPU page lists in front of the buddy. */
+        init_pcp();
+        init_zero_pools();
+
+        /* Step-4: init the slab allocator. */
         init_slab();
+
+        /* Step-5: init the dedicated caches of mm objects. */
+        vmspace_caches_init();
 }
 
 unsigned long get_free_mem_size(void)
@@ -95,6 +102,9 @@ unsigned long get_free_mem_size(void)
         int i;
 
         size = get_free_mem_size_from_slab();
+        /* Chunks cached on per-CPU lists are free as well. */
+        size += get_free_mem_size_from_pcp();
+        size += get_free_mem_size_from_zero_pools();
         for (i = 0; i < physmem_map_num; ++i)
                 size += get_free_mem_size_from_buddy(&global_mem[i]);
 
@@ -23,6 +23,9 @@
 #include <object/user_fault.h>
 #include <object/thread.h>
 #include <mm/page_fault.h>
+#include <common/sync.h>
+
+struct pgfault_stats pgfault_stats;
 
 static void dump_pgfault_error(void)
 {
@@ -51,6 +54,7 @@ static int __do_general_cow(struct vmspace *vmspace, struct vmregion *vmr,
                             struct common_pte_t *pte_info)
 {
         vaddr_t kva, user_vpa;
+        struct tlb_batch batch;
         void *new_page;
         paddr_t new_pa;
         struct common_pte_t new_pte_attr;
@@ -86,7 +90,9 @@ static int __do_general_cow(struct vmspace *vmspace, struct vmregion *vmr,
 
         /* Step-6: Flush TLB of user virtual page(user_vpa) */
         user_vpa = ROUND_DOWN(fault_addr, PAGE_SIZE);
-        flush_tlb_by_range(vmspace, user_vpa, PAGE_SIZE);
+        tlb_batch_init(&batch, vmspace);
+        tlb_batch_add(&batch, user_vpa, PAGE_SIZE);
+        tlb_batch_flush(&batch);
 
         return 0;
 out_free_page:
@@ -152,6 +158,154 @@ static int check_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
         return 0;
 }
 
+#ifdef CHCORE_KERNEL_FAULT_AROUND
+/*
+ * Fault-around: after the faulting page is committed and mapped, populate
+ * the other pages in the FAULT_AROUND_PAGES aligned window around it, so
+ * that sequentially touching a fresh buffer does not trap once per page.
+ * The window is clipped to the vmr and the pmo, pages already committed
+ * in the pmo are left alone, and all new pages are mapped in one walk.
+ *
+ * Called with vmr_lock (read) and vmr->fault_lock held.
+ */
+static void do_fault_around(struct vmspace *vmspace, struct vmregion *vmr,
+                            vaddr_t fault_addr)
+{
+        struct pmobject *pmo = vmr->pmo;
+        paddr_t pas[FAULT_AROUND_PAGES];
+        vaddr_t start, end, va;
+        unsigned long offset;
+        void *page;
+        long rss = 0;
+        int i, nr, nr_new = 0;
+        int ret;
+
+        start = ROUND_DOWN(fault_addr, FAULT_AROUND_PAGES * PAGE_SIZE);
+        end = start + FAULT_AROUND_PAGES * PAGE_SIZE;
+        start = MAX(start, vmr->start);
+        end = MIN(end, vmr->start + vmr->size);
+        nr = (end - start) / PAGE_SIZE;
+
+        memset(pas, 0, sizeof(pas));
+        for (i = 0, va = start; i < nr; i++, va += PAGE_SIZE) {
+                if (va == fault_addr)
+                        continue;
+
+                offset = va - vmr->start + vmr->offset;
+                if (offset >= pmo->size)
+                        break;
+                if (get_page_from_pmo(pmo, offset / PAGE_SIZE) != 0)
+                        continue;
+
+                /* Fault-around is best effort: stop on memory pressure */
+                page = get_zeroed_page();
+                if (page == NULL)
+                        break;
+
+                pas[i] = virt_to_phys(page);
+                commit_page_to_pmo(pmo, offset / PAGE_SIZE, pas[i]);
+                nr_new++;
+        }
+
+        if (nr_new == 0)
+                return;
+
+        lock(&vmspace->pgtbl_lock);
+        ret = map_pages_in_pgtbl(
+                vmspace->pgtbl, start, pas, nr, vmr->perm, &rss);
+        vmspace->rss += rss;
+        unlock(&vmspace->pgtbl_lock);
+
+        /*
+         * The pages stay committed in the pmo on failure,
+         * so later faults on them simply map them.
+         */
+        if (ret) {
+                kwarn("%s: map failed (%d) at 0x%lx\n", __func__, ret, start);
+                return;
+        }
+
+        atomic_fetch_add_long(&pgfault_stats.nr_fault_around_pages, nr_new);
+
+        if (vmr->perm & VMR_EXEC) {
+                arch_flush_cache(start, nr * PAGE_SIZE, SYNC_IDCACHE);
+        }
+}
+#endif
+
+#ifdef CHCORE_KERNEL_THP
+/*
+ * Back the whole HUGE_PAGE_SIZE aligned window around fault_addr with one
+ * order-9 chunk mapped by a block descriptor. Only done for (non-CoW)
+ * PMO_ANONYM when the window lies in both the vmr and the pmo, has the
+ * same alignment in the pmo and contains no committed page yet.
+ * Return 0 if the fault has been handled.
+ *
+ * Called with vmr_lock (read) and vmr->fault_lock held.
+ */
+static int do_huge_fault(struct vmspace *vmspace, struct vmregion *vmr,
+                         vaddr_t fault_addr)
+{
+        struct pmobject *pmo = vmr->pmo;
+        unsigned long offset, index, i;
+        vaddr_t huge_va;
+        void *page;
+        paddr_t pa;
+        long rss = 0;
+        int ret;
+
+        if (pmo->type != PMO_ANONYM || (vmr->perm & VMR_COW))
+                return -EINVAL;
+
+        huge_va = ROUND_DOWN(fault_addr, HUGE_PAGE_SIZE);
+        if (huge_va < vmr->start
+            || huge_va + HUGE_PAGE_SIZE > vmr->start + vmr->size)
+                return -EINVAL;
+
+        offset = huge_va - vmr->start + vmr->offset;
+        if ((offset % HUGE_PAGE_SIZE) || offset + HUGE_PAGE_SIZE > pmo->size)
+                return -EINVAL;
+
+        index = offset / PAGE_SIZE;
+        for (i = 0; i < L2_PER_ENTRY_PAGES; i++) {
+                if (get_page_from_pmo(pmo, index + i) != 0)
+                        return -EEXIST;
+        }
+
+        page = get_pages(HUGE_PAGE_ORDER);
+        if (page == NULL)
+                return -ENOMEM;
+        memset(page, 0, HUGE_PAGE_SIZE);
+        pa = virt_to_phys(page);
+
+        lock(&vmspace->pgtbl_lock);
+        ret = map_huge_range_in_pgtbl(
+                vmspace->pgtbl, huge_va, pa, HUGE_PAGE_SIZE, vmr->perm, &rss);
+        vmspace->rss += rss;
+        unlock(&vmspace->pgtbl_lock);
+        if (ret) {
+                free_pages(page);
+                return ret;
+        }
+
+        /*
+         * The pmo records (and finally frees) its memory page by page,
+         * which also keeps a later split of the mapping trivial.
+         */
+        split_pages(page);
+        for (i = 0; i < L2_PER_ENTRY_PAGES; i++)
+                commit_page_to_pmo(pmo, index + i, pa + i * PAGE_SIZE);
+
+        atomic_fetch_add_long(&pgfault_stats.nr_huge_faults, 1);
+
+        if (vmr->perm & VMR_EXEC) {
+                arch_flush_cache(huge_va, HUGE_PAGE_SIZE, SYNC_IDCACHE);
+        }
+
+        return 0;
+}
+#endif
+
 int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
 {
         struct vmregion *vmr;
@@ -162,19 +316,18 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
         int ret = 0;
 
         /*
-         * Grab lock here.
-         * Because two threads (in same process) on different cores
-         * may fault on the same page, so we need to prevent them
-         * from adding the same mapping twice.
+         * Only read-lock the vmrs here, so that faults on different vmrs
+         * of one process are handled in parallel. The vmr found cannot be
+         * removed, resized or split until read_unlock.
          */
-        lock(&vmspace->vmspace_lock);
+        read_lock(vmspace_vmr_lock(vmspace));
         vmr = find_vmr_for_va(vmspace, fault_addr);
 
         if (vmr == NULL) {
                 kinfo("handle_trans_fault: no vmr found for va 0x%lx!\n",
                       fault_addr);
                 dump_pgfault_error();
-                unlock(&vmspace->vmspace_lock);
+                read_unlock(vmspace_vmr_lock(vmspace));
 
 #if defined(CHCORE_ARCH_AARCH64) || defined(CHCORE_ARCH_SPARC)
                 /* kernel fault fixup is only supported on AArch64 and Sparc */
@@ -195,12 +348,27 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
                 /* Boundary check */
                 BUG_ON(offset >= pmo->size);
 
+                /*
+                 * Two threads (in same process) on different cores may
+                 * fault on the same page, so we need to prevent them
+                 * from committing and adding the same page twice.
+                 */
+                lock(&vmr->fault_lock);
+
+                atomic_fetch_add_long(&pgfault_stats.nr_trans_faults, 1);
+
                 /* Get the index in the pmo radix for faulting addr */
                 index = offset / PAGE_SIZE;
 
                 fault_addr = ROUND_DOWN(fault_addr, PAGE_SIZE);
 
                 pa = get_page_from_pmo(pmo, index);
+#ifdef CHCORE_KERNEL_THP
+                if (pa == 0 && do_huge_fault(vmspace, vmr, fault_addr) == 0) {
+                        unlock(&vmr->fault_lock);
+                        break;
+                }
+#endif
                 if (pa == 0) {
                         /*
                          * Not committed before. Then, allocate the physical
@@ -224,6 +392,9 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
 
                         /* BLANK END */
                         unlock(&vmspace->pgtbl_lock);
+#ifdef CHCORE_KERNEL_FAULT_AROUND
+                        do_fault_around(vmspace, vmr, fault_addr);
+#endif
                 } else {
                         /*
                          * pa != 0: the faulting address has be committed a
@@ -261,10 +432,11 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
                         arch_flush_cache(fault_addr, PAGE_SIZE, SYNC_IDCACHE);
                 }
 
+                unlock(&vmr->fault_lock);
                 break;
         }
         case PMO_FILE: {
-                unlock(&vmspace->vmspace_lock);
+                read_unlock(vmspace_vmr_lock(vmspace));
                 fault_addr = ROUND_DOWN(fault_addr, PAGE_SIZE);
                 handle_user_fault(pmo, ROUND_DOWN(fault_addr, PAGE_SIZE));
                 BUG("Should never be here!\n");
@@ -274,7 +446,7 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
                 kinfo("Forbidden memory access (pmo->type is PMO_FORBID).\n");
                 dump_pgfault_error();
 
-                unlock(&vmspace->vmspace_lock);
+                read_unlock(vmspace_vmr_lock(vmspace));
                 sys_exit_group(-1);
 
                 BUG("should not reach here");
@@ -287,7 +459,7 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
                       fault_addr);
                 dump_pgfault_error();
 
-                unlock(&vmspace->vmspace_lock);
+                read_unlock(vmspace_vmr_lock(vmspace));
                 sys_exit_group(-1);
 
                 BUG("should not reach here");
@@ -295,7 +467,7 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
         }
         }
 
-        unlock(&vmspace->vmspace_lock);
+        read_unlock(vmspace_vmr_lock(vmspace));
         return ret;
 }
 
@@ -349,14 +521,14 @@ int handle_perm_fault(struct vmspace *vmspace, vaddr_t fault_addr,
         struct vmregion *vmr;
         vmr_prop_t declared_perm;
 
-        lock(&vmspace->vmspace_lock);
+        read_lock(vmspace_vmr_lock(vmspace));
         vmr = find_vmr_for_va(vmspace, fault_addr);
 
         if (vmr == NULL) {
                 kinfo("handle_perm_fault: no vmr found for va 0x%lx!\n",
                       fault_addr);
                 dump_pgfault_error();
-                unlock(&vmspace->vmspace_lock);
+                read_unlock(vmspace_vmr_lock(vmspace));
 #if defined(CHCORE_ARCH_AARCH64) || defined(CHCORE_ARCH_SPARC)
                 return -EFAULT;
 #else
@@ -371,7 +543,9 @@ int handle_perm_fault(struct vmspace *vmspace, vaddr_t fault_addr,
         if ((declared_perm & VMR_READ) && desired_perm == VMR_WRITE) {
                 // Handle COW here
                 if (declared_perm & VMR_COW) {
+                        lock(&vmr->fault_lock);
                         ret = do_cow(vmspace, vmr, fault_addr);
+                        unlock(&vmr->fault_lock);
                         if (ret != 0 && ret != -EFAULT) {
                                 goto out_illegal;
                         } else if (ret == -EFAULT) {
@@ -395,7 +569,7 @@ int handle_perm_fault(struct vmspace *vmspace, vaddr_t fault_addr,
                 goto out_illegal;
         }
 out_succ:
-        unlock(&vmspace->vmspace_lock);
+        read_unlock(vmspace_vmr_lock(vmspace));
         return ret;
 out_illegal:
         // Illegal access permission, kill process
@@ -403,7 +577,7 @@ out_illegal:
               fault_addr,
               desired_perm);
         dump_pgfault_error();
-        unlock(&vmspace->vmspace_lock);
+        read_unlock(vmspace_vmr_lock(vmspace));
 #if defined(CHCORE_ARCH_AARCH64) || defined(CHCORE_ARCH_SPARC)
         return -EPERM;
 #else
@@ -419,7 +593,7 @@ out_trans_fault:
          * they detect such cases, and treat it as a translation fault then
          * handle it atomically.
          */
-        unlock(&vmspace->vmspace_lock);
+        read_unlock(vmspace_vmr_lock(vmspace));
         ret = handle_trans_fault(vmspace, fault_addr);
         return ret;
 }
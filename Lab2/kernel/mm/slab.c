@@ -15,15 +15,30 @@
 #include <common/kprint.h>
 #include <common/lock.h>
 #include <common/debug.h>
+#include <common/util.h>
 #include <mm/kmalloc.h>
 #include <mm/slab.h>
 #include <mm/buddy.h>
+#include <arch/machine/smp.h>
 
 /* slab_pool is also static. We do not add the static modifier due to unit test.
  */
 struct slab_pointer slab_pool[SLAB_MAX_ORDER + 1];
 static struct lock slabs_locks[SLAB_MAX_ORDER + 1];
 
+/*
+ * Per-CPU magazines are only accessed by the owning CPU, which runs kernel
+ * code with interrupts disabled, so no lock is needed for them.
+ */
+static struct slab_cpu_cache slab_cpu_caches[PLAT_CPU_NUM][SLAB_MAX_ORDER + 1];
+static struct slab_depot slab_depots[SLAB_MAX_ORDER + 1];
+
+/* All the kmem_caches, protected by kmem_caches_lock. */
+static struct list_head kmem_caches;
+static struct lock kmem_caches_lock;
+
+static unsigned long get_free_mem_size_from_kmem_caches(void);
+
 /*
 static inline int order_to_index(int order)
 {
@@ -226,24 +241,251 @@ static void try_return_slab_to_buddy(struct slab_header *slab, int order)
         free_pages_without_record(slab);
 }
 
+static void free_in_slab_impl(struct slab_header *slab, void *addr)
+{
+        struct slab_slot_list *slot;
+        int order;
+
+        slot = (struct slab_slot_list *)addr;
+        order = slab->order;
+        lock(&slabs_locks[order]);
+
+        try_insert_full_slab_to_partial(slab);
+
+#if ENABLE_DETECTING_DOUBLE_FREE_IN_SLAB == ON
+        /*
+         * SLAB double free detection: check whether the slot to free is
+         * already in the free list.
+         */
+        if (check_slot_is_free(slab, slot) == 1) {
+                kinfo("SLAB: double free detected. Address is %p\n",
+                      (unsigned long)slot);
+                BUG_ON(1);
+        }
+#endif
+
+        /* LAB 2 TODO 2 BEGIN */
+        /*
+         * Hint: Free an allocated slot and put it back to the free list.
+         */
+        /* BLANK BEGIN */
+
+        UNUSED(slot);
+        /* BLANK END */
+        /* LAB 2 TODO 2 END */
+
+        try_return_slab_to_buddy(slab, order);
+
+        unlock(&slabs_locks[order]);
+}
+
+static struct slab_header *addr_to_slab(void *addr)
+{
+        struct page *page;
+
+        page = virt_to_page(addr);
+        if (!page) {
+                kdebug("invalid page in %s", __func__);
+                return NULL;
+        }
+        return page->slab;
+}
+
+static struct slab_magazine *alloc_magazine(void)
+{
+        struct slab_magazine *mag;
+
+        mag = alloc_in_slab_impl(SLAB_MAGAZINE_ORDER);
+        if (mag)
+                mag->rounds = 0;
+        return mag;
+}
+
+static void free_magazine(struct slab_magazine *mag)
+{
+        BUG_ON(mag->rounds != 0);
+        free_in_slab_impl(addr_to_slab(mag), mag);
+}
+
+/* Return every object held by @mag to its slab. */
+static void flush_magazine(struct slab_magazine *mag)
+{
+        void *obj;
+
+        while (mag->rounds > 0) {
+                obj = mag->objs[--mag->rounds];
+                free_in_slab_impl(addr_to_slab(obj), obj);
+        }
+}
+
+static void *magazine_alloc(int order)
+{
+        struct slab_cpu_cache *cc = &slab_cpu_caches[smp_get_cpu_id()][order];
+        struct slab_depot *depot = &slab_depots[order];
+        struct slab_magazine *mag;
+
+        if (cc->loaded == NULL)
+                return NULL;
+
+        if (cc->loaded->rounds > 0)
+                return cc->loaded->objs[--cc->loaded->rounds];
+
+        if (cc->previous->rounds > 0) {
+                mag = cc->loaded;
+                cc->loaded = cc->previous;
+                cc->previous = mag;
+                return cc->loaded->objs[--cc->loaded->rounds];
+        }
+
+        /* Both magazines are empty: swap an empty one for a full one. */
+        lock(&depot->lock);
+        if (list_empty(&depot->full_list)) {
+                unlock(&depot->lock);
+                return NULL;
+        }
+        mag = list_entry(depot->full_list.next, struct slab_magazine, node);
+        list_del(&mag->node);
+        depot->nr_full--;
+        list_add(&cc->previous->node, &depot->empty_list);
+        depot->nr_empty++;
+        unlock(&depot->lock);
+
+        cc->previous = cc->loaded;
+        cc->loaded = mag;
+        return cc->loaded->objs[--cc->loaded->rounds];
+}
+
+/* Return 0 if @addr is cached in a magazine, -1 otherwise. */
+__maybe_unused static int magazine_free(int order, void *addr)
+{
+        struct slab_cpu_cache *cc = &slab_cpu_caches[smp_get_cpu_id()][order];
+        struct slab_depot *depot = &slab_depots[order];
+        struct slab_magazine *mag, *excess = NULL;
+
+        if (unlikely(cc->loaded == NULL)) {
+                cc->loaded = alloc_magazine();
+                cc->previous = alloc_magazine();
+                if (!cc->loaded || !cc->previous)
+                        goto out_fail;
+        }
+
+        if (cc->loaded->rounds < SLAB_MAGAZINE_SIZE)
+                goto out_push;
+
+        if (cc->previous->rounds == 0) {
+                mag = cc->loaded;
+                cc->loaded = cc->previous;
+                cc->previous = mag;
+                goto out_push;
+        }
+
+        /* Both magazines are full: swap a full one for an empty one. */
+        lock(&depot->lock);
+        if (!list_empty(&depot->empty_list)) {
+                mag = list_entry(
+                        depot->empty_list.next, struct slab_magazine, node);
+                list_del(&mag->node);
+                depot->nr_empty--;
+        } else {
+                unlock(&depot->lock);
+                mag = alloc_magazine();
+                if (!mag)
+                        return -1;
+                lock(&depot->lock);
+        }
+        list_add(&cc->previous->node, &depot->full_list);
+        depot->nr_full++;
+        if (depot->nr_full > SLAB_DEPOT_MAX_FULL) {
+                excess = list_entry(
+                        depot->full_list.prev, struct slab_magazine, node);
+                list_del(&excess->node);
+                depot->nr_full--;
+        }
+        unlock(&depot->lock);
+
+        cc->previous = cc->loaded;
+        cc->loaded = mag;
+
+        /* Trim the depot so that idle size classes do not hoard memory. */
+        if (excess) {
+                flush_magazine(excess);
+                free_magazine(excess);
+        }
+
+out_push:
+        cc->loaded->objs[cc->loaded->rounds++] = addr;
+        return 0;
+
+out_fail:
+        if (cc->loaded)
+                free_magazine(cc->loaded);
+        if (cc->previous)
+                free_magazine(cc->previous);
+        cc->loaded = cc->previous = NULL;
+        return -1;
+}
+
+/* Size of the free objects held by all the magazines of @order. */
+static unsigned long get_free_mem_size_from_magazines(int order)
+{
+        struct slab_depot *depot = &slab_depots[order];
+        struct slab_magazine *mag;
+        unsigned long rounds = 0;
+        int cpu;
+
+        /* Remote per-CPU magazines are read racily, which is fine here. */
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                mag = slab_cpu_caches[cpu][order].loaded;
+                if (mag)
+                        rounds += mag->rounds;
+                mag = slab_cpu_caches[cpu][order].previous;
+                if (mag)
+                        rounds += mag->rounds;
+        }
+
+        lock(&depot->lock);
+        for_each_in_list (mag, struct slab_magazine, node, &depot->full_list)
+                rounds += mag->rounds;
+        unlock(&depot->lock);
+
+        return rounds * order_to_size(order);
+}
+
 /* Interfaces exported to the kernel/mm module */
 
 void init_slab(void)
 {
-        int order;
+        int order, cpu;
+
+        BUG_ON(sizeof(struct slab_magazine)
+               > order_to_size(SLAB_MAGAZINE_ORDER));
 
         /* slab obj size: 32, 64, 128, 256, 512, 1024, 2048 */
         for (order = SLAB_MIN_ORDER; order <= SLAB_MAX_ORDER; order++) {
                 lock_init(&slabs_locks[order]);
                 slab_pool[order].current_slab = NULL;
                 init_list_head(&(slab_pool[order].partial_slab_list));
+
+                lock_init(&slab_depots[order].lock);
+                init_list_head(&slab_depots[order].full_list);
+                init_list_head(&slab_depots[order].empty_list);
+                slab_depots[order].nr_full = 0;
+                slab_depots[order].nr_empty = 0;
+                for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                        slab_cpu_caches[cpu][order].loaded = NULL;
+                        slab_cpu_caches[cpu][order].previous = NULL;
+                }
         }
+
+        init_list_head(&kmem_caches);
+        lock_init(&kmem_caches_lock);
         kdebug("mm: finish initing slab allocators\n");
 }
 
 void *alloc_in_slab(unsigned long size, size_t *real_size)
 {
         int order;
+        void *addr;
 
         BUG_ON(size > order_to_size(SLAB_MAX_ORDER));
 
@@ -256,55 +498,32 @@ void *alloc_in_slab(unsigned long size, size_t *real_size)
                 *real_size = 1 << order;
 #endif
 
+        addr = magazine_alloc(order);
+        if (addr)
+                return addr;
+
         return alloc_in_slab_impl(order);
 }
 
 void free_in_slab(void *addr)
 {
-        struct page *page;
         struct slab_header *slab;
-        struct slab_slot_list *slot;
-        int order;
 
-        slot = (struct slab_slot_list *)addr;
-        page = virt_to_page(addr);
-        if (!page) {
-                kdebug("invalid page in %s", __func__);
+        slab = addr_to_slab(addr);
+        if (!slab)
                 return;
-        }
-
-
-        slab = page->slab;
-        order = slab->order;
-        lock(&slabs_locks[order]);
-
-        try_insert_full_slab_to_partial(slab);
 
-#if ENABLE_DETECTING_DOUBLE_FREE_IN_SLAB == ON
-        /*
-         * SLAB double free detection: check whether the slot to free is
-         * already in the free list.
-         */
-        if (check_slot_is_free(slab, slot) == 1) {
-                kinfo("SLAB: double free detected. Address is %p\n",
-                      (unsigned long)slot);
-                BUG_ON(1);
+        if (slab->order == KMEM_CACHE_SLAB_ORDER) {
+                kmem_cache_free(((struct kmem_cache_slab *)slab)->cache, addr);
+                return;
         }
-#endif
-
-        /* LAB 2 TODO 2 BEGIN */
-        /*
-         * Hint: Free an allocated slot and put it back to the free list.
-         */
-        /* BLANK BEGIN */
-
-        UNUSED(slot);
-        /* BLANK END */
-        /* LAB 2 TODO 2 END */
 
-        try_return_slab_to_buddy(slab, order);
-
-        unlock(&slabs_locks[order]);
+#if ENABLE_DETECTING_DOUBLE_FREE_IN_SLAB == OFF
+        /* Double free detection needs every free slot in the slab lists. */
+        if (magazine_free(slab->order, addr) == 0)
+                return;
+#endif
+        free_in_slab_impl(slab, addr);
 }
 
 /* This interface is not marked as static because it is needed in the unit test.
@@ -363,11 +582,254 @@ unsigned long get_free_mem_size_from_slab(void)
                 current_slot_size = order_to_size(order);
                 slot_num = get_free_slot_number(order);
                 total_size += (current_slot_size * slot_num);
+                total_size += get_free_mem_size_from_magazines(order);
 
                 kdebug("slab memory chunk size : 0x%lx, num : %d\n",
                        current_slot_size,
                        slot_num);
         }
 
+        total_size += get_free_mem_size_from_kmem_caches();
+
+        return total_size;
+}
+
+/* kmem_cache: dedicated caches for fixed-size kernel objects */
+
+struct kmem_cache *kmem_cache_create(const char *name, unsigned long size,
+                                     void (*ctor)(void *obj))
+{
+        struct kmem_cache *cache;
+        unsigned long obj_size, obj_offset, slab_size, free_offset;
+        int order;
+
+        BUG_ON(size == 0);
+
+        obj_size = ROUND_UP(size, KMEM_CACHE_ALIGN);
+        if (ctor) {
+                free_offset = obj_size;
+                obj_size += sizeof(struct slab_slot_list);
+        } else {
+                free_offset = 0;
+        }
+        obj_offset = ROUND_UP(sizeof(struct kmem_cache_slab), KMEM_CACHE_ALIGN);
+
+        /* Use the smallest slab which holds KMEM_CACHE_MIN_OBJS objects. */
+        order = 0;
+        while ((BUDDY_PAGE_SIZE << order) - obj_offset
+               < KMEM_CACHE_MIN_OBJS * obj_size)
+                order++;
+        slab_size = BUDDY_PAGE_SIZE << order;
+        if (order >= BUDDY_MAX_ORDER
+            || (slab_size - obj_offset) / obj_size > 0xFFFF) {
+                kwarn("%s: unsupported object size 0x%lx\n", __func__, size);
+                return NULL;
+        }
+
+        cache = kzalloc(sizeof(*cache));
+        if (!cache)
+                return NULL;
+
+        memcpy(cache->name, name, MIN(strlen(name), KMEM_CACHE_NAME_LEN - 1));
+        cache->size = size;
+        cache->obj_size = obj_size;
+        cache->slab_size = slab_size;
+        cache->obj_offset = obj_offset;
+        cache->ctor = ctor;
+        cache->free_offset = free_offset;
+        lock_init(&cache->lock);
+        init_list_head(&cache->partial_slab_list);
+
+        lock(&kmem_caches_lock);
+        list_append(&cache->node, &kmem_caches);
+        unlock(&kmem_caches_lock);
+
+        return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache *cache)
+{
+        struct kmem_cache_slab *slab, *tmp;
+
+        lock(&kmem_caches_lock);
+        list_del(&cache->node);
+        unlock(&kmem_caches_lock);
+
+        BUG_ON(cache->nr_active != 0);
+        for_each_in_list_safe (slab, tmp, header.node, &cache->partial_slab_list) {
+                list_del(&slab->header.node);
+                set_or_clear_slab_in_page(slab, cache->slab_size, false);
+                free_pages_without_record(slab);
+        }
+        kfree(cache);
+}
+
+static inline struct slab_slot_list *kmem_cache_slot(struct kmem_cache *cache,
+                                                     void *obj)
+{
+        return (struct slab_slot_list *)(obj + cache->free_offset);
+}
+
+static struct kmem_cache_slab *kmem_cache_grow(struct kmem_cache *cache)
+{
+        struct kmem_cache_slab *slab;
+        struct slab_slot_list *slot;
+        unsigned long cnt, i;
+        void *obj;
+
+        slab = alloc_slab_memory(cache->slab_size);
+        if (unlikely(slab == NULL))
+                return NULL;
+
+        cnt = (cache->slab_size - cache->obj_offset) / cache->obj_size;
+        slab->cache = cache;
+        slab->header.order = KMEM_CACHE_SLAB_ORDER;
+        slab->header.total_free_cnt = cnt;
+        slab->header.current_free_cnt = cnt;
+        slab->header.free_list_head = NULL;
+
+        /* Link the objects in address order. */
+        for (i = cnt; i > 0; i--) {
+                obj = (void *)slab + cache->obj_offset
+                      + (i - 1) * cache->obj_size;
+                if (cache->ctor)
+                        cache->ctor(obj);
+                slot = kmem_cache_slot(cache, obj);
+                slot->next_free = slab->header.free_list_head;
+                slab->header.free_list_head = obj;
+        }
+
+        cache->nr_slabs++;
+        return slab;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+        struct kmem_cache_slab *slab;
+        void *obj;
+
+        lock(&cache->lock);
+
+        if (list_empty(&cache->partial_slab_list)) {
+                slab = kmem_cache_grow(cache);
+                if (!slab) {
+                        unlock(&cache->lock);
+                        return NULL;
+                }
+                list_add(&slab->header.node, &cache->partial_slab_list);
+        } else {
+                slab = list_entry(cache->partial_slab_list.next,
+                                  struct kmem_cache_slab,
+                                  header.node);
+        }
+
+        obj = slab->header.free_list_head;
+        slab->header.free_list_head = kmem_cache_slot(cache, obj)->next_free;
+        slab->header.current_free_cnt--;
+        /* A full slab is not tracked until one of its objects is freed. */
+        if (slab->header.current_free_cnt == 0)
+                list_del(&slab->header.node);
+
+        cache->nr_active++;
+        cache->nr_allocs++;
+        unlock(&cache->lock);
+
+        return obj;
+}
+
+void *kmem_cache_zalloc(struct kmem_cache *cache)
+{
+        void *obj;
+
+        /* Zeroing would destroy the constructed state of the object. */
+        BUG_ON(cache->ctor);
+
+        obj = kmem_cache_alloc(cache);
+        if (obj)
+                memset(obj, 0, cache->size);
+        return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+        struct kmem_cache_slab *slab;
+        struct slab_slot_list *slot;
+
+        slab = (struct kmem_cache_slab *)addr_to_slab(obj);
+        BUG_ON(!slab || slab->header.order != KMEM_CACHE_SLAB_ORDER
+               || slab->cache != cache);
+
+        lock(&cache->lock);
+
+        if (slab->header.current_free_cnt == 0)
+                list_add(&slab->header.node, &cache->partial_slab_list);
+
+        slot = kmem_cache_slot(cache, obj);
+        slot->next_free = slab->header.free_list_head;
+        slab->header.free_list_head = obj;
+        slab->header.current_free_cnt++;
+
+        cache->nr_active--;
+        cache->nr_frees++;
+
+        /* Keep the last partial slab to avoid thrashing the buddy system. */
+        if (slab->header.current_free_cnt == slab->header.total_free_cnt
+            && cache->partial_slab_list.next != cache->partial_slab_list.prev) {
+                list_del(&slab->header.node);
+                cache->nr_slabs--;
+                set_or_clear_slab_in_page(slab, cache->slab_size, false);
+                free_pages_without_record(slab);
+        }
+
+        unlock(&cache->lock);
+}
+
+unsigned long kmem_cache_size(struct kmem_cache *cache)
+{
+        return cache->size;
+}
+
+static unsigned long get_free_mem_size_from_kmem_caches(void)
+{
+        struct kmem_cache *cache;
+        struct kmem_cache_slab *slab;
+        unsigned long total_size = 0;
+
+        lock(&kmem_caches_lock);
+        for_each_in_list (cache, struct kmem_cache, node, &kmem_caches) {
+                lock(&cache->lock);
+                for_each_in_list (slab,
+                                  struct kmem_cache_slab,
+                                  header.node,
+                                  &cache->partial_slab_list) {
+                        total_size += slab->header.current_free_cnt
+                                      * cache->obj_size;
+                }
+                unlock(&cache->lock);
+        }
+        unlock(&kmem_caches_lock);
+
         return total_size;
 }
+
+void kmem_cache_print_stats(void)
+{
+        struct kmem_cache *cache;
+
+        lock(&kmem_caches_lock);
+        for_each_in_list (cache, struct kmem_cache, node, &kmem_caches) {
+                lock(&cache->lock);
+                kinfo("kmem_cache %s: obj size %ld (%ld), slabs %ld (0x%lx "
+                      "bytes), active %ld, allocs %ld, frees %ld\n",
+                      cache->name,
+                      cache->size,
+                      cache->obj_size,
+                      cache->nr_slabs,
+                      cache->nr_slabs * cache->slab_size,
+                      cache->nr_active,
+                      cache->nr_allocs,
+                      cache->nr_frees);
+                unlock(&cache->lock);
+        }
+        unlock(&kmem_caches_lock);
+}
@@ -18,6 +18,7 @@
 #include <mm/mm.h>
 #include <mm/uaccess.h>
 #include <arch/mmu.h>
+#include <arch/sync.h>
 
 struct cow_private_page {
         struct list_head node;
@@ -25,12 +26,63 @@ struct cow_private_page {
         void *page;
 };
 
+static struct kmem_cache *vmregion_cache;
+
+/*
+ * The vmr locks are hashed by vmspace (see vmspace.h), so unrelated
+ * vmspaces may share one. Page faults only take it for read and do not
+ * block each other, but a process changing its vmrs (mmap, munmap,
+ * mprotect) stalls the faults of any other process on the same lock, and
+ * the lock's cache line bounces between their CPUs. At most PLAT_CPU_NUM
+ * vmspaces run at a time, so the table is sized by the CPU count: with
+ * VMR_LOCKS_PER_CPU locks per CPU, two running vmspaces share a lock with
+ * a probability of roughly PLAT_CPU_NUM / (2 * VMR_LOCKS_PER_CPU).
+ */
+#define VMR_LOCKS_PER_CPU 64
+#define VMR_LOCK_NR       (PLAT_CPU_NUM * VMR_LOCKS_PER_CPU)
+
+static struct {
+        struct rwlock lock;
+} __attribute__((aligned(CACHELINE_SZ))) vmr_locks[VMR_LOCK_NR];
+
+/*
+ * Objects come from slabs and share their low address bits, so mix the
+ * address (Fibonacci hashing) before reducing it to a table index.
+ */
+static inline unsigned long lock_hash(void *obj, unsigned long nr)
+{
+        return (((unsigned long)obj * 0x9E3779B97F4A7C15UL) >> 32) % nr;
+}
+
+struct rwlock *vmspace_vmr_lock(struct vmspace *vmspace)
+{
+        return &vmr_locks[lock_hash(vmspace, VMR_LOCK_NR)].lock;
+}
+
+#define PMO_MAPPING_LOCK_NR 61
+
+static struct {
+        struct lock lock;
+} __attribute__((aligned(CACHELINE_SZ))) pmo_mapping_locks[PMO_MAPPING_LOCK_NR];
+
+struct lock *pmo_mapping_lock(struct pmobject *pmo)
+{
+        return &pmo_mapping_locks[lock_hash(pmo, PMO_MAPPING_LOCK_NR)].lock;
+}
+
+void vmspace_caches_init(void)
+{
+        vmregion_cache = kmem_cache_create(
+                "vmregion", sizeof(struct vmregion), NULL);
+        BUG_ON(vmregion_cache == NULL);
+}
+
 static struct vmregion *alloc_vmregion(vaddr_t start, size_t len, size_t offset,
                                        vmr_prop_t perm, struct pmobject *pmo)
 {
         struct vmregion *vmr;
 
-        vmr = kmalloc(sizeof(*vmr));
+        vmr = kmem_cache_alloc(vmregion_cache);
         if (vmr == NULL)
                 return NULL;
 
@@ -39,7 +91,11 @@ static struct vmregion *alloc_vmregion(vaddr_t start, size_t len, size_t offset,
         vmr->offset = offset;
         vmr->perm = perm;
         vmr->pmo = pmo;
+        /* Set once the vmr is added to a vmspace */
+        vmr->vmspace = NULL;
+        lock(pmo_mapping_lock(pmo));
         list_add(&vmr->mapping_list_node, &pmo->mapping_list);
+        unlock(pmo_mapping_lock(pmo));
 
         if (pmo->type == PMO_DEVICE)
                 vmr->perm |= VMR_DEVICE;
@@ -47,6 +103,10 @@ static struct vmregion *alloc_vmregion(vaddr_t start, size_t len, size_t offset,
                 vmr->perm |= VMR_NOCACHE;
 
         init_list_head(&vmr->cow_private_pages);
+        lock_init(&vmr->fault_lock);
+        /* Anonymous pages can be migrated by memory compaction */
+        if (pmo->type == PMO_ANONYM)
+                compaction_track_vmr(vmr);
 
         return vmr;
 }
@@ -78,8 +138,12 @@ static void free_vmregion(struct vmregion *vmr)
         for_each_in_list_safe (cur_record, tmp, node, &vmr->cow_private_pages) {
                 free_cow_private_page(cur_record);
         }
+        if (vmr->pmo->type == PMO_ANONYM)
+                compaction_untrack_vmr(vmr);
+        lock(pmo_mapping_lock(vmr->pmo));
         list_del(&vmr->mapping_list_node);
-        kfree((void *)vmr);
+        unlock(pmo_mapping_lock(vmr->pmo));
+        kmem_cache_free(vmregion_cache, vmr);
 }
 
 /*
@@ -216,6 +280,64 @@ static void del_vmr_from_vmspace(struct vmspace *vmspace, struct vmregion *vmr)
         free_vmregion(vmr);
 }
 
+#ifdef CHCORE_KERNEL_THP
+/*
+ * Map a physically contiguous pmo with 2M blocks where va and pa share the
+ * same offset inside a huge page, and with 4K pages for the unaligned head
+ * and tail. Falls back to 4K pages for a chunk that cannot take a block.
+ *
+ * Called with pgtbl_lock held.
+ */
+static int fill_page_table_huge(struct vmspace *vmspace, vaddr_t va,
+                                paddr_t pa, size_t len, vmr_prop_t perm)
+{
+        size_t head, body;
+        long rss = 0;
+        int ret = 0;
+
+        if ((va % HUGE_PAGE_SIZE) != (pa % HUGE_PAGE_SIZE)) {
+                head = len;
+                body = 0;
+        } else {
+                head = MIN(ROUND_UP(va, HUGE_PAGE_SIZE) - va, len);
+                body = ROUND_DOWN(len - head, HUGE_PAGE_SIZE);
+        }
+
+        if (head) {
+                ret = map_range_in_pgtbl(
+                        vmspace->pgtbl, va, pa, head, perm, &rss);
+                if (ret)
+                        goto out;
+                va += head;
+                pa += head;
+                len -= head;
+        }
+
+        for (; body; body -= HUGE_PAGE_SIZE, len -= HUGE_PAGE_SIZE) {
+                ret = map_huge_range_in_pgtbl(
+                        vmspace->pgtbl, va, pa, HUGE_PAGE_SIZE, perm, &rss);
+                if (ret == -EEXIST)
+                        ret = map_range_in_pgtbl(vmspace->pgtbl,
+                                                 va,
+                                                 pa,
+                                                 HUGE_PAGE_SIZE,
+                                                 perm,
+                                                 &rss);
+                if (ret)
+                        goto out;
+                va += HUGE_PAGE_SIZE;
+                pa += HUGE_PAGE_SIZE;
+        }
+
+        if (len)
+                ret = map_range_in_pgtbl(
+                        vmspace->pgtbl, va, pa, len, perm, &rss);
+out:
+        vmspace->rss += rss;
+        return ret;
+}
+#endif
+
 static int fill_page_table(struct vmspace *vmspace, struct vmregion *vmr)
 {
         size_t pm_size;
@@ -229,6 +351,14 @@ static int fill_page_table(struct vmspace *vmspace, struct vmregion *vmr)
         va = vmr->start;
 
         lock(&vmspace->pgtbl_lock);
+#ifdef CHCORE_KERNEL_THP
+        /* CoW pages are tracked page by page, keep them in 4K mappings */
+        if (vmr->pmo->type == PMO_DATA && !(vmr->perm & VMR_COW)) {
+                ret = fill_page_table_huge(vmspace, va, pa, pm_size, vmr->perm);
+                unlock(&vmspace->pgtbl_lock);
+                return ret;
+        }
+#endif
         ret = map_range_in_pgtbl(
                 vmspace->pgtbl, va, pa, pm_size, vmr->perm, &rss);
         vmspace->rss += rss;
@@ -261,8 +391,9 @@ int vmspace_init(struct vmspace *vmspace, unsigned long pcid)
         arch_vmspace_init(vmspace);
 
         /*
-         * Note: acquire vmspace_lock before pgtbl_lock
-         * when locking them together.
+         * Note: acquire vmspace_lock before vmr_lock, and vmr_lock
+         * (then vmr->fault_lock) before pgtbl_lock when locking them
+         * together.
          */
         lock_init(&vmspace->vmspace_lock);
         lock_init(&vmspace->pgtbl_lock);
@@ -322,7 +453,9 @@ int vmspace_map_range(struct vmspace *vmspace, vaddr_t va, size_t len,
          * Each operation on the vmspace should be protected by
          * the per-vmspace lock, i.e., vmspace_lock.
          */
+        write_lock(vmspace_vmr_lock(vmspace));
         ret = add_vmr_to_vmspace(vmspace, vmr);
+        write_unlock(vmspace_vmr_lock(vmspace));
 
         if (ret < 0) {
                 kdebug("add_vmr_to_vmspace fails\n");
@@ -345,30 +478,63 @@ out_fail:
         return ret;
 }
 
+/*
+ * Remove the vmrs in [va, va + len) and record in @batch the ranges which
+ * may have been mapped in the page table.
+ */
 static void __vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va,
-                                  size_t len)
+                                  size_t len, struct tlb_batch *batch)
 {
         struct vmregion *vmr;
         size_t cur_size = 0;
 
+        write_lock(vmspace_vmr_lock(vmspace));
         while (cur_size < len) {
                 vmr = find_vmr_for_va(vmspace, va);
+                /* PMO_FORBID is never mapped */
+                if (vmr->pmo->type != PMO_FORBID)
+                        tlb_batch_add(batch, vmr->start, vmr->size);
                 va += vmr->size;
                 cur_size += vmr->size;
                 del_vmr_from_vmspace(vmspace, vmr);
         }
+        write_unlock(vmspace_vmr_lock(vmspace));
+}
+
+/*
+ * Split the huge mappings crossing the boundary of [va, va + len), which
+ * unmap_range_in_pgtbl cannot clear partially. Done before any vmr is
+ * removed, so that a failure leaves the vmspace untouched.
+ */
+static int split_huge_boundary(struct vmspace *vmspace, vaddr_t va, size_t len)
+{
+#ifdef CHCORE_KERNEL_THP
+        int ret;
+
+        lock(&vmspace->pgtbl_lock);
+        ret = split_huge_range_in_pgtbl(
+                vmspace->pgtbl, va, len, true, vmspace->pcid);
+        unlock(&vmspace->pgtbl_lock);
+        return ret;
+#else
+        return 0;
+#endif
 }
 
 static void __vmspace_unmap_range_pgtbl(struct vmspace *vmspace, vaddr_t va,
-                                        size_t len)
+                                        size_t len, struct tlb_batch *batch)
 {
+        int ret;
+
         if (len != 0) {
                 long rss = 0;
                 lock(&vmspace->pgtbl_lock);
-                unmap_range_in_pgtbl(vmspace->pgtbl, va, len, &rss);
+                /* Cannot fail once split_huge_boundary has succeeded */
+                ret = unmap_range_in_pgtbl(vmspace->pgtbl, va, len, &rss);
+                BUG_ON(ret);
                 vmspace->rss += rss;
                 unlock(&vmspace->pgtbl_lock);
-                flush_tlb_by_range(vmspace, va, len);
+                tlb_batch_flush(batch);
         }
 }
 
@@ -411,8 +577,11 @@ static int check_unmap(struct vmspace *vmspace, vaddr_t va, size_t len,
  */
 int vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va, size_t len)
 {
+        struct tlb_batch batch;
         int ret = 0;
 
+        tlb_batch_init(&batch, vmspace);
+
         lock(&vmspace->vmspace_lock);
 
         if (check_unmap(vmspace, va, len, NULL)) {
@@ -420,11 +589,15 @@ int vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va, size_t len)
                 goto out_unlock;
         }
 
-        __vmspace_unmap_range(vmspace, va, len);
+        ret = split_huge_boundary(vmspace, va, len);
+        if (ret)
+                goto out_unlock;
+
+        __vmspace_unmap_range(vmspace, va, len, &batch);
         unlock(&vmspace->vmspace_lock);
 
         /* Remove the potential mappings in the page table. */
-        __vmspace_unmap_range_pgtbl(vmspace, va, len);
+        __vmspace_unmap_range_pgtbl(vmspace, va, len, &batch);
         return 0;
 
 out_unlock:
@@ -435,8 +608,10 @@ out_unlock:
 int vmspace_unmap_pmo(struct vmspace *vmspace, vaddr_t va, size_t len,
                       struct pmobject *pmo)
 {
+        struct tlb_batch batch;
         int ret = 0;
 
+        tlb_batch_init(&batch, vmspace);
         lock(&vmspace->vmspace_lock);
 
         if (check_unmap(vmspace, va, pmo->size, pmo)) {
@@ -444,11 +619,15 @@ int vmspace_unmap_pmo(struct vmspace *vmspace, vaddr_t va, size_t len,
                 goto out_unlock;
         }
 
-        __vmspace_unmap_range(vmspace, va, pmo->size);
+        ret = split_huge_boundary(vmspace, va, pmo->size);
+        if (ret)
+                goto out_unlock;
+
+        __vmspace_unmap_range(vmspace, va, pmo->size, &batch);
         unlock(&vmspace->vmspace_lock);
 
         /* Remove the potential mappings in the page table. */
-        __vmspace_unmap_range_pgtbl(vmspace, va, pmo->size);
+        __vmspace_unmap_range_pgtbl(vmspace, va, pmo->size, &batch);
         return 0;
 
 out_unlock:
@@ -456,7 +635,7 @@ out_unlock:
         return ret;
 }
 
-/* This function should be surrounded with the vmspace_lock. */
+/* This function should be surrounded with the vmspace_lock or vmr_lock. */
 __maybe_unused struct vmregion *find_vmr_for_va(struct vmspace *vmspace,
                                                 vaddr_t addr)
 {
@@ -499,6 +678,7 @@ int split_vmr_locked(struct vmspace *vmspace, struct vmregion *old_vmr,
                 return -ENOMEM;
         }
 
+        write_lock(vmspace_vmr_lock(vmspace));
         for_each_in_list_safe (
                 cur_record, tmp, node, &old_vmr->cow_private_pages) {
                 if (cur_record->vaddr >= split_vaddr) {
@@ -521,6 +701,7 @@ int split_vmr_locked(struct vmspace *vmspace, struct vmregion *old_vmr,
         old_vmr->size = old_vmr_size;
         add_vmr_to_vmspace(vmspace, old_vmr);
         add_vmr_to_vmspace(vmspace, new_vmr);
+        write_unlock(vmspace_vmr_lock(vmspace));
         return 0;
 }
 
@@ -535,6 +716,7 @@ int adjust_heap_vmr(struct vmspace *vmspace, unsigned long add_len)
 {
         struct vmregion *vmr;
         struct vmregion tmp_vmr;
+        int ret;
 
         vmr = vmspace->heap_boundary_vmr;
 
@@ -546,10 +728,14 @@ int adjust_heap_vmr(struct vmspace *vmspace, unsigned long add_len)
                 return -EINVAL;
         }
 
+        write_lock(vmspace_vmr_lock(vmspace));
         remove_vmr_from_vmspace(vmspace, vmr);
         vmr->size += add_len;
         vmr->pmo->size += add_len;
-        return add_vmr_to_vmspace(vmspace, vmr);
+        ret = add_vmr_to_vmspace(vmspace, vmr);
+        write_unlock(vmspace_vmr_lock(vmspace));
+
+        return ret;
 }
 
 /* Dumping all the vmrs of one vmspace. */
@@ -580,7 +766,15 @@ void kprint_vmr(struct vmspace *vmspace)
 void record_history_cpu(struct vmspace *vmspace, unsigned int cpuid)
 {
         BUG_ON(cpuid >= PLAT_CPU_NUM);
+        if (vmspace->history_cpus[cpuid])
+                return;
         vmspace->history_cpus[cpuid] = 1;
+        /*
+         * Pairs with the barrier in tlb_batch_flush(): the record must be
+         * visible before this CPU walks the page table of the vmspace, or a
+         * concurrent flush could skip it while it caches a stale entry.
+         */
+        dsb(ish);
 }
 
 void clear_history_cpu(struct vmspace *vmspace, unsigned int cpuid)
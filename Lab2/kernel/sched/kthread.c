@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <sched/sched.h>
+#include <sched/context.h>
+#include <object/thread.h>
+#include <object/object.h>
+#include <object/cap_group.h>
+#include <mm/kmalloc.h>
+#include <mm/vmspace.h>
+#include <common/util.h>
+
+void kernel_thread_entry(void (*routine)(void));
+
+static struct cap_group *kernel_cap_group;
+static struct vmspace *kernel_vmspace;
+
+static void init_kernel_cap_group(void)
+{
+        const char *name = "KERNEL-THREAD";
+        unsigned int name_len = strlen(name);
+
+        /* Like the idle threads, a fake cap group only stores the name */
+        kernel_cap_group = kzalloc(sizeof(*kernel_cap_group));
+        BUG_ON(!kernel_cap_group);
+        name_len = MIN(name_len, MAX_GROUP_NAME_LEN);
+        memcpy(kernel_cap_group->cap_group_name, name, name_len);
+        init_list_head(&kernel_cap_group->thread_list);
+
+        kernel_vmspace = create_idle_vmspace();
+}
+
+struct thread *create_kernel_thread(void (*routine)(void), unsigned int prio,
+                                    unsigned int cpuid)
+{
+        struct thread *thread;
+
+        BUG_ON(cpuid >= PLAT_CPU_NUM);
+        if (!kernel_cap_group)
+                init_kernel_cap_group();
+
+        thread = obj_alloc(TYPE_THREAD, sizeof(*thread));
+        if (!thread)
+                return NULL;
+        /* Never freed: the ready queues take and drop their own references */
+        obj_ref(thread);
+
+        thread->thread_ctx = create_thread_ctx(TYPE_KERNEL);
+        BUG_ON(!thread->thread_ctx);
+        init_thread_ctx(thread, 0, 0, prio, TYPE_KERNEL, cpuid);
+        arch_idle_ctx_init(thread->thread_ctx,
+                           (void (*)(void))kernel_thread_entry);
+        arch_set_thread_arg0(thread, (unsigned long)routine);
+
+        thread->cap_group = kernel_cap_group;
+        thread->vmspace = kernel_vmspace;
+        list_add(&thread->node, &kernel_cap_group->thread_list);
+
+        BUG_ON(sched_enqueue(thread));
+        return thread;
+}
+
+void kernel_thread_sleep(void)
+{
+        thread_set_ts_blocking(current_thread);
+        sched();
+        eret_to_thread(switch_context());
+        BUG("[FATAL] Should never be here!\n");
+}
+
+void kernel_thread_wakeup(struct thread *thread)
+{
+        BUG_ON(thread->thread_ctx->affinity != smp_get_cpu_id());
+        if (thread_is_ts_blocking(thread))
+                BUG_ON(sched_enqueue(thread));
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/lock.h>
+#include <arch/machine/smp.h>
+#include <arch/sync.h>
+
+#include "tests.h"
+
+/*
+ * Wait until all the CPUs arrive. The barrier can be passed repeatedly, since
+ * each pass bumps the generation which the CPUs are waiting on.
+ */
+void test_barrier_wait(struct test_barrier *barrier)
+{
+        int generation;
+
+        lock(&big_kernel_lock);
+        generation = barrier->generation;
+        if (++barrier->arrived == PLAT_CPU_NUM) {
+                barrier->arrived = 0;
+                barrier->generation = generation + 1;
+                unlock(&big_kernel_lock);
+                return;
+        }
+        unlock(&big_kernel_lock);
+
+        while (barrier->generation == generation)
+                ;
+        smp_mb();
+}
+
+/* Called on every CPU after it finishes booting */
+void run_test(void)
+{
+        tst_kmem_cache();
+        tst_kmalloc_scale();
+        tst_pgfault_scale();
+}
@@ -30,4 +30,16 @@ extern char serial_number[4096];
                 while (1)                                          \
                         ;                                          \
         }
+
+/* Multi-core tests run by every CPU, see smp_tests.c */
+struct test_barrier {
+        volatile int arrived;
+        volatile int generation;
+};
+
+void test_barrier_wait(struct test_barrier *barrier);
+
+void tst_kmalloc_scale(void);
+void tst_pgfault_scale(void);
+void tst_kmem_cache(void);
 #endif /* KERNEL_TESTS_RUNTIME_TESTS_H */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <arch/machine/smp.h>
+#include <arch/machine/pmu.h>
+#include <mm/kmalloc.h>
+
+#include "tests.h"
+
+/* Objects allocated by each CPU in one batch */
+#define KMALLOC_SCALE_BATCH 64
+#define KMALLOC_SCALE_ROUND 20000
+
+/* Typical sizes of kernel objects (thread, cap, vmregion, ...) */
+static const int kmalloc_scale_sizes[] = {32, 48, 96, 160, 256, 512};
+
+static struct test_barrier kmalloc_scale_barrier;
+static volatile u64 kmalloc_scale_cycles[PLAT_CPU_NUM];
+
+static u64 kmalloc_scale_run(void)
+{
+        void *buf[KMALLOC_SCALE_BATCH];
+        int nr_sizes = sizeof(kmalloc_scale_sizes) / sizeof(int);
+        u64 start, end;
+
+        start = pmu_read_real_cycle();
+        for (int round = 0; round < KMALLOC_SCALE_ROUND; round++) {
+                for (int i = 0; i < KMALLOC_SCALE_BATCH; i++) {
+                        buf[i] = kmalloc(
+                                kmalloc_scale_sizes[(round + i) % nr_sizes]);
+                        BUG_ON(!buf[i]);
+                        *(int *)buf[i] = i;
+                }
+                for (int i = 0; i < KMALLOC_SCALE_BATCH; i++) {
+                        BUG_ON(*(int *)buf[i] != i);
+                        kfree(buf[i]);
+                }
+        }
+        end = pmu_read_real_cycle();
+
+        return end - start;
+}
+
+/*
+ * Measure kmalloc/kfree throughput while 1, 2, ..., PLAT_CPU_NUM CPUs
+ * allocate concurrently. CPUs which do not take part in a phase simply wait
+ * for the next barrier.
+ */
+void tst_kmalloc_scale(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 ops, max_cycles;
+        int nr_cpus, i;
+
+        for (nr_cpus = 1; nr_cpus <= PLAT_CPU_NUM; nr_cpus++) {
+                test_barrier_wait(&kmalloc_scale_barrier);
+
+                if (cpuid < nr_cpus)
+                        kmalloc_scale_cycles[cpuid] = kmalloc_scale_run();
+
+                test_barrier_wait(&kmalloc_scale_barrier);
+
+                if (cpuid == 0) {
+                        max_cycles = 0;
+                        for (i = 0; i < nr_cpus; i++)
+                                max_cycles = MAX(max_cycles,
+                                                 kmalloc_scale_cycles[i]);
+                        ops = (u64)nr_cpus * KMALLOC_SCALE_ROUND
+                              * KMALLOC_SCALE_BATCH;
+                        kinfo("[TEST] kmalloc/kfree on %d CPUs: %ld ops in "
+                              "%ld cycles, %ld ops per Mcycle\n",
+                              nr_cpus,
+                              ops,
+                              max_cycles,
+                              ops * 1000000 / (max_cycles + 1));
+                }
+        }
+
+        if (cpuid == 0) {
+                kinfo("[TEST] kmalloc scale succ!\n");
+        }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <arch/machine/smp.h>
+#include <mm/kmalloc.h>
+
+#include "tests.h"
+
+#define KMEM_CACHE_TEST_OBJS 256
+#define KMEM_CACHE_TEST_MAGIC 0x6b6d656dUL
+
+struct kmem_cache_test_obj {
+        unsigned long magic;
+        unsigned long payload[5];
+};
+
+static int kmem_cache_test_nr_ctor;
+
+static void kmem_cache_test_ctor(void *obj)
+{
+        ((struct kmem_cache_test_obj *)obj)->magic = KMEM_CACHE_TEST_MAGIC;
+        kmem_cache_test_nr_ctor++;
+}
+
+/*
+ * Objects handed out by a cache with a constructor must still be in the
+ * constructed state after being freed and allocated again.
+ */
+void tst_kmem_cache(void)
+{
+        struct kmem_cache *cache;
+        struct kmem_cache_test_obj *objs[KMEM_CACHE_TEST_OBJS];
+        int nr_ctor = 0;
+
+        if (smp_get_cpu_id() != 0)
+                return;
+
+        cache = kmem_cache_create("test_obj",
+                                  sizeof(struct kmem_cache_test_obj),
+                                  kmem_cache_test_ctor);
+        BUG_ON(!cache);
+
+        for (int round = 0; round < 2; round++) {
+                for (int i = 0; i < KMEM_CACHE_TEST_OBJS; i++) {
+                        objs[i] = kmem_cache_alloc(cache);
+                        BUG_ON(!objs[i]);
+                        BUG_ON(objs[i]->magic != KMEM_CACHE_TEST_MAGIC);
+                        objs[i]->payload[0] = i;
+                }
+                /* The second round must be served by the same slabs. */
+                if (round == 0)
+                        nr_ctor = kmem_cache_test_nr_ctor;
+                for (int i = 0; i < KMEM_CACHE_TEST_OBJS; i++) {
+                        BUG_ON(objs[i]->payload[0] != i);
+                        kmem_cache_free(cache, objs[i]);
+                }
+        }
+        BUG_ON(kmem_cache_test_nr_ctor != nr_ctor);
+
+        kmem_cache_print_stats();
+        kmem_cache_destroy(cache);
+
+        kinfo("[TEST] kmem_cache ctor succ!\n");
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <arch/machine/smp.h>
+#include <arch/machine/pmu.h>
+#include <arch/mmu.h>
+#include <mm/mm.h>
+#include <mm/vmspace.h>
+#include <mm/page_fault.h>
+#include <object/cap_group.h>
+#include <object/memory.h>
+#include <object/object.h>
+
+#include "tests.h"
+
+/* Pages touched by each CPU in one phase, each CPU owns one vmr */
+#define PGFAULT_SCALE_PAGES  1024
+#define PGFAULT_SCALE_ROUND  4
+#define PGFAULT_SCALE_BASE   0x100000000UL
+#define PGFAULT_SCALE_STRIDE 0x10000000UL
+
+int cap_group_init(struct cap_group *cap_group, unsigned int size,
+                   badge_t badge);
+
+static struct test_barrier pgfault_scale_barrier;
+static volatile u64 pgfault_scale_cycles[PLAT_CPU_NUM];
+static volatile u64 pgfault_scale_faults[PLAT_CPU_NUM];
+static struct cap_group *volatile pgfault_scale_cap_group;
+static struct vmspace *volatile pgfault_scale_vmspace;
+
+/*
+ * Map a fresh anonymous pmo and touch each of its pages. Like the MMU, only
+ * the pages not mapped yet fault, so fault-around and huge pages show up as
+ * fewer faults.
+ */
+static u64 pgfault_scale_run(struct vmspace *vmspace, vaddr_t va, u64 *faults)
+{
+        size_t len = PGFAULT_SCALE_PAGES * PAGE_SIZE;
+        struct pmobject *pmo;
+        paddr_t pa;
+        pte_t *pte;
+        u64 start, cycles = 0;
+        cap_t pmo_cap;
+        int round, i, ret;
+
+        *faults = 0;
+        for (round = 0; round < PGFAULT_SCALE_ROUND; round++) {
+                pmo_cap = create_pmo(len,
+                                     PMO_ANONYM,
+                                     pgfault_scale_cap_group,
+                                     0,
+                                     &pmo,
+                                     PMO_ALL_RIGHTS);
+                BUG_ON(pmo_cap < 0);
+                ret = vmspace_map_range(
+                        vmspace, va, len, VMR_READ | VMR_WRITE, pmo);
+                BUG_ON(ret);
+
+                start = pmu_read_real_cycle();
+                for (i = 0; i < PGFAULT_SCALE_PAGES; i++) {
+                        ret = query_in_pgtbl(
+                                vmspace->pgtbl, va + i * PAGE_SIZE, &pa, &pte);
+                        if (ret != -ENOMAPPING)
+                                continue;
+                        ret = handle_trans_fault(vmspace, va + i * PAGE_SIZE);
+                        BUG_ON(ret);
+                        (*faults)++;
+                }
+                cycles += pmu_read_real_cycle() - start;
+
+                ret = vmspace_unmap_range(vmspace, va, len);
+                BUG_ON(ret);
+                /* Drops the last reference, which frees the pmo */
+                ret = cap_free(pgfault_scale_cap_group, pmo_cap);
+                BUG_ON(ret);
+        }
+
+        return cycles;
+}
+
+static void pgfault_scale_init(void)
+{
+        struct cap_group *cap_group;
+        struct vmspace *vmspace;
+        int ret;
+
+        cap_group = obj_alloc(TYPE_CAP_GROUP, sizeof(*cap_group));
+        BUG_ON(!cap_group);
+        ret = cap_group_init(cap_group, BASE_OBJECT_NUM, 0);
+        BUG_ON(ret);
+
+        vmspace = obj_alloc(TYPE_VMSPACE, sizeof(*vmspace));
+        BUG_ON(!vmspace);
+        ret = vmspace_init(vmspace, 0);
+        BUG_ON(ret);
+
+        pgfault_scale_cap_group = cap_group;
+        pgfault_scale_vmspace = vmspace;
+}
+
+static void pgfault_scale_deinit(void)
+{
+        vmspace_deinit(pgfault_scale_vmspace);
+        obj_free(pgfault_scale_vmspace);
+        cap_group_deinit(pgfault_scale_cap_group);
+        obj_free(pgfault_scale_cap_group);
+}
+
+/*
+ * Measure translation fault throughput while 1, 2, ..., PLAT_CPU_NUM CPUs
+ * fault concurrently on their own vmrs of one shared vmspace. CPUs which
+ * do not take part in a phase simply wait for the next barrier.
+ */
+void tst_pgfault_scale(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 faults, pages, max_cycles;
+        int nr_cpus, i;
+
+        if (cpuid == 0)
+                pgfault_scale_init();
+        test_barrier_wait(&pgfault_scale_barrier);
+
+        for (nr_cpus = 1; nr_cpus <= PLAT_CPU_NUM; nr_cpus++) {
+                test_barrier_wait(&pgfault_scale_barrier);
+
+                if (cpuid < nr_cpus) {
+                        pgfault_scale_cycles[cpuid] = pgfault_scale_run(
+                                pgfault_scale_vmspace,
+                                PGFAULT_SCALE_BASE
+                                        + cpuid * PGFAULT_SCALE_STRIDE,
+                                &faults);
+                        pgfault_scale_faults[cpuid] = faults;
+                }
+
+                test_barrier_wait(&pgfault_scale_barrier);
+
+                if (cpuid == 0) {
+                        max_cycles = 0;
+                        faults = 0;
+                        for (i = 0; i < nr_cpus; i++) {
+                                max_cycles = MAX(max_cycles,
+                                                 pgfault_scale_cycles[i]);
+                                faults += pgfault_scale_faults[i];
+                        }
+                        pages = (u64)nr_cpus * PGFAULT_SCALE_ROUND
+                                * PGFAULT_SCALE_PAGES;
+                        kinfo("[TEST] page faults on %d CPUs: %ld pages "
+                              "with %ld faults in %ld cycles, "
+                              "%ld pages per Mcycle\n",
+                              nr_cpus,
+                              pages,
+                              faults,
+                              max_cycles,
+                              pages * 1000000 / (max_cycles + 1));
+                }
+        }
+
+        if (cpuid == 0) {
+                pgfault_scale_deinit();
+                kinfo("[TEST] faults=%lu fault-around pages=%lu "
+                      "huge faults=%lu\n",
+                      pgfault_stats.nr_trans_faults,
+                      pgfault_stats.nr_fault_around_pages,
+                      pgfault_stats.nr_huge_faults);
+                kinfo("[TEST] pgfault scale succ!\n");
+        }
+}
@@ -55,6 +55,58 @@ typedef unsigned long vmr_prop_t;
 struct free_mem_info {
     unsigned long free_mem_size; // in bytes
     unsigned long total_mem_size; // in bytes
+    /* Per-CPU page lists, summed over all CPUs */
+    unsigned long pcp_free_size; // in bytes, included in free_mem_size
+    unsigned long pcp_alloc_hit;
+    unsigned long pcp_alloc_miss;
+    unsigned long pcp_free_hit;
+    unsigned long pcp_refill;
+    unsigned long pcp_drain;
+};
+
+/* Batched TLB shootdowns, see CHCORE_SYS_get_tlb_stats */
+struct tlb_stats_info {
+    unsigned long nr_batches;
+    unsigned long nr_merged;
+    /* No flush needed: the vmspace never ran on any CPU */
+    unsigned long nr_avoided;
+    /* Only flushed on the calling CPU */
+    unsigned long nr_local;
+    /* Broadcast to the other CPUs, one round per batch */
+    unsigned long nr_shootdowns;
+    unsigned long nr_asid_flushes;
+    unsigned long nr_page_flushes;
+};
+
+/* Physical memory pool policies, see CHCORE_SYS_mem_policy */
+#define MEM_POLICY_ID_FIRST      0 /* always prefer pool 0 */
+#define MEM_POLICY_ID_LOCAL      1 /* prefer a pool chosen by the CPU */
+#define MEM_POLICY_ID_INTERLEAVE 2 /* rotate the preferred pool */
+
+#define MEM_POOL_INFO_ORDERS 16
+
+struct mem_pool_info {
+    int nr_pools;
+    int max_free_order; // -1 if the pool is full
+    unsigned long alloc;
+    /* Served here although another pool was preferred */
+    unsigned long fallback;
+    unsigned long fail;
+    unsigned long free_size; // in bytes
+    unsigned long nr_free[MEM_POOL_INFO_ORDERS];
+    /* Fragmentation index of each order (x1000), -1000 if one is free */
+    int frag_index[MEM_POOL_INFO_ORDERS];
+};
+
+/* Result of CHCORE_SYS_compact_memory */
+struct compact_info {
+    int order; /* requested order */
+    int success; /* a free chunk of order is available afterwards */
+    int frag_index; /* max fragmentation index of order (x1000) before */
+    unsigned long nr_blocks; /* blocks compacted */
+    unsigned long nr_unsuitable; /* blocks holding unmovable pages */
+    unsigned long nr_migrated; /* pages migrated */
+    unsigned long nr_failed; /* pages which could not be migrated */
 };
 #endif
 
@@ -110,4 +110,9 @@
 /* OpenTrustee */
 #define CHCORE_SYS_opentrustee             59
 
+/* Memory management statistics and policies */
+#define CHCORE_SYS_get_tlb_stats           61
+#define CHCORE_SYS_mem_policy              62
+#define CHCORE_SYS_compact_memory          63
+
 #endif /* UAPI_SYSCALL_NUM_H */
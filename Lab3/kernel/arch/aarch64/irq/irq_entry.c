@@ -32,13 +32,22 @@ void arch_disable_irqno(int irq)
 	plat_disable_irqno(irq);
 }
 
+/* EL0 access to the physical counter, for the time page */
+#define CNTKCTL_EL1_EL0PCTEN (1 << 0)
+
 void arch_interrupt_init_per_cpu(void)
 {
+	u64 cntkctl;
+
 	disable_irq();
 
 	/* platform dependent init */
 	set_exception_vector();
 	plat_interrupt_init();
+
+	asm volatile ("mrs %0, cntkctl_el1":"=r" (cntkctl));
+	cntkctl |= CNTKCTL_EL1_EL0PCTEN;
+	asm volatile ("msr cntkctl_el1, %0"::"r" (cntkctl));
 }
 
 void arch_interrupt_init(void)
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef ARCH_AARCH64_ARCH_FUTEX_H
+#define ARCH_AARCH64_ARCH_FUTEX_H
+
+#include <common/errno.h>
+#include <ipc/futex.h>
+
+/*
+ * Atomically update the user word at @uaddr with @insn, which computes the
+ * new value %w3 from the old value %w1 and the operand %w4. The exclusive
+ * load and store are in the exception table like the accesses of
+ * __copy_from_user, so a fault on @uaddr which cannot be handled makes
+ * @ret -EFAULT.
+ */
+// clang-format off
+#define __futex_atomic_op_user(insn, ret, oldval, uaddr, oparg)		\
+do {									\
+        u32 __newval;							\
+        asm volatile (  "   prfm    pstl1strm, %2\n"			\
+                        "1: ldxr    %w1, %2\n"				\
+                        insn "\n"					\
+                        "2: stlxr   %w0, %w3, %2\n"			\
+                        "   cbnz    %w0, 1b\n"				\
+                        "   dmb     ish\n"				\
+                        "   b       4f\n"				\
+                        "3: mov     %w0, %w5\n"				\
+                        "4:\n"						\
+                        "   .pushsection .extable, \"a\"\n"		\
+                        "   .align  4\n"				\
+                        "   .quad   1b, 3b\n"				\
+                        "   .quad   2b, 3b\n"				\
+                        "   .popsection\n"				\
+                        :"=&r"(ret), "=&r"(oldval), "+Q"(*(uaddr)),	\
+                         "=&r"(__newval)				\
+                        :"r"(oparg), "r"(-EFAULT)			\
+                        :"memory");					\
+} while (0)
+// clang-format on
+
+/*
+ * Apply the FUTEX_WAKE_OP operation @op with @oparg to the user word at
+ * @uaddr, and return its old value in @oldval.
+ * @uaddr should be a checked and aligned user address.
+ */
+static inline int arch_futex_atomic_op_user(int op, int oparg, int *uaddr,
+                                            int *oldval)
+{
+        int ret, old = 0;
+
+        switch (op) {
+        case FUTEX_OP_SET:
+                __futex_atomic_op_user("   mov     %w3, %w4",
+                                       ret, old, uaddr, oparg);
+                break;
+        case FUTEX_OP_ADD:
+                __futex_atomic_op_user("   add     %w3, %w1, %w4",
+                                       ret, old, uaddr, oparg);
+                break;
+        case FUTEX_OP_OR:
+                __futex_atomic_op_user("   orr     %w3, %w1, %w4",
+                                       ret, old, uaddr, oparg);
+                break;
+        case FUTEX_OP_ANDN:
+                __futex_atomic_op_user("   bic     %w3, %w1, %w4",
+                                       ret, old, uaddr, oparg);
+                break;
+        case FUTEX_OP_XOR:
+                __futex_atomic_op_user("   eor     %w3, %w1, %w4",
+                                       ret, old, uaddr, oparg);
+                break;
+        default:
+                return -ENOSYS;
+        }
+
+        if (ret == 0)
+                *oldval = old;
+        return ret;
+}
+
+#endif /* ARCH_AARCH64_ARCH_FUTEX_H */
@@ -2,8 +2,9 @@
 #define IPC_FUTEX_H
 
 #include <common/types.h>
-#include <common/hashtable.h>
-#include <ipc/notification.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <common/macro.h>
 
 #define FUTEX_WAIT		0
 #define FUTEX_WAKE		1
@@ -15,27 +16,91 @@
 #define FUTEX_UNLOCK_PI		7
 #define FUTEX_TRYLOCK_PI	8
 #define FUTEX_WAIT_BITSET	9
+#define FUTEX_WAKE_BITSET	10
 
 #define FUTEX_PRIVATE 128
 
 #define FUTEX_CLOCK_REALTIME 256
 
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
 
-struct futex_entry {
-        struct notification *notific;
-        int *uaddr;
-        int waiter_count;
-        struct hlist_node hash_node;
+/* Encoding of val3 in FUTEX_WAKE_OP, the same as Linux */
+#define FUTEX_OP_SET		0 /* uaddr2 = oparg */
+#define FUTEX_OP_ADD		1 /* uaddr2 += oparg */
+#define FUTEX_OP_OR		2 /* uaddr2 |= oparg */
+#define FUTEX_OP_ANDN		3 /* uaddr2 &= ~oparg */
+#define FUTEX_OP_XOR		4 /* uaddr2 ^= oparg */
+#define FUTEX_OP_OPARG_SHIFT	8 /* Use (1 << oparg) as operand */
+
+#define FUTEX_OP_CMP_EQ		0
+#define FUTEX_OP_CMP_NE		1
+#define FUTEX_OP_CMP_LT		2
+#define FUTEX_OP_CMP_LE		3
+#define FUTEX_OP_CMP_GT		4
+#define FUTEX_OP_CMP_GE		5
+
+/*
+ * The futex table of a process is sharded into buckets, each with its own
+ * lock and queue of waiters. The table grows with the number of threads.
+ */
+#define FUTEX_MIN_BUCKETS		16
+#define FUTEX_MAX_BUCKETS		1024
+#define FUTEX_BUCKETS_PER_THREAD	4
+
+/* Shared futexes of all processes are in one table of a fixed size */
+#define FUTEX_SHARED_BUCKET_BITS	8
+
+/*
+ * The waiter of a thread, queued in the bucket of its futex. A private
+ * futex is keyed by its uaddr and a shared one by its physical address.
+ */
+struct futex_waiter {
+        u64 key;
+        bool shared;
+        bool queued;
+        /*
+         * Set by the timer, which cannot lock the bucket. The waiter then
+         * stays queued until its thread or a waker dequeues it.
+         */
+        bool timed_out;
+        u32 bitset;
+        struct list_head node;
+};
+
+struct futex_bucket {
+        struct lock lock;
+        struct list_head waiters;
+        char pad[pad_to_cache_line(sizeof(struct lock)
+                                   + sizeof(struct list_head))];
+};
+
+struct futex_table {
+        /* The table has (1 << bucket_bits) buckets */
+        unsigned int bucket_bits;
+        /*
+         * Set when a larger table replaces this one. The old table is only
+         * freed in futex_deinit, so a stale pointer is always safe to lock.
+         */
+        volatile bool stale;
+        struct futex_table *prev;
+        struct futex_bucket buckets[];
 };
 
 struct cap_group;
+struct thread;
 void futex_deinit(struct cap_group *cap_group);
 void futex_init(struct cap_group *cap_group);
+/* Dequeue the waiter of an exiting thread */
+void futex_thread_exit(struct thread *thread);
+/* Wake at most @nr_wake waiters of @uaddr whose bitsets intersect @bitset */
+int futex_wake_bitset(struct cap_group *cap_group, int *uaddr, int nr_wake,
+                      u32 bitset);
 
 /* Syscalls */
 int sys_futex_wait(int *uaddr, int futex_op, int val, struct timespec *timeout);
 int sys_futex_wake(int *uaddr, int futex_op, int val);
-int sys_futex_requeue(int *uaddr, int *uaddr2, int nr_wake, int nr_requeue);
+int sys_futex_requeue(int *uaddr, int *uaddr2, int futex_op, int nr_wake,
+                      int nr_requeue);
 int sys_futex(int *uaddr, int futex_op, int val, struct timespec *timeout, int *uaddr2, int val3);
 
 #endif /* IPC_FUTEX_H */
@@ -82,8 +82,9 @@ struct cap_group {
 	char cap_group_name[MAX_GROUP_NAME_LEN + 1];
 
 	/* Each Process has its own futex status */
-	struct lock futex_lock;
-	struct htable futex_entries;
+	struct futex_table *futex_table;
+	/* Serialize growing futex_table */
+	struct lock futex_resize_lock;
 
 #ifdef CHCORE_OPENTRUSTEE
 	TEE_UUID uuid;
@@ -119,6 +120,8 @@ static inline void install_slot(struct cap_group *cap_group, cap_t slot_id,
 				struct object_slot *slot)
 {
 	BUG_ON(!get_bit(slot_id, cap_group->slot_table.slots_bmp));
+	/* Lookups without table_guard see an initialized slot */
+	smp_wmb();
 	cap_group->slot_table.slots[slot_id] = slot;
 }
 
@@ -127,6 +130,8 @@ void *get_opaque(struct cap_group *cap_group, cap_t slot_id, bool type_valid,
 
 int __cap_free(struct cap_group *cap_group, cap_t slot_id,
 	       bool slot_table_locked, bool copies_list_locked);
+/* Wait until all the lock-free slot lookups in progress finish */
+void slot_table_synchronize(void);
 
 struct cap_group *create_root_cap_group(char *, size_t);
 
@@ -20,6 +20,8 @@
 #include <common/tee_uuid.h>
 #endif /* CHCORE_OPENTRUSTEE */
 
+struct vmspace;
+
 #ifdef CHCORE_OPENTRUSTEE
 struct tee_shm_private {
         struct tee_uuid uuid;
@@ -51,13 +53,16 @@ paddr_t get_page_from_pmo(struct pmobject *pmo, unsigned long index);
 int map_pmo_in_current_cap_group(cap_t pmo_cap, unsigned long addr,
                                  unsigned long perm);
 void pmo_deinit(void *pmo_ptr);
+int map_time_page(struct cap_group *cap_group, struct vmspace *vmspace);
 
 /* syscalls */
 cap_t sys_create_pmo(unsigned long size, pmo_type_t type, unsigned long val, cap_right_t rights);
+int sys_create_pmos(unsigned long user_buf, int cnt);
 int sys_write_pmo(cap_t pmo_cap, unsigned long offset, unsigned long user_ptr, unsigned long len);
 int sys_read_pmo(cap_t pmo_cap, unsigned long offset, unsigned long user_ptr, unsigned long len);
 int sys_get_phys_addr(vaddr_t va, paddr_t *pa_buf);
 int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr, unsigned long perm, unsigned long len);
+int sys_map_pmos(cap_t target_cap_group_cap, unsigned long user_buf, int cnt);
 int sys_unmap_pmo(cap_t target_cap_group_cap, cap_t pmo_cap,
                   unsigned long addr, size_t size);
 unsigned long sys_handle_brk(unsigned long addr, unsigned long heap_start);
@@ -19,6 +19,7 @@
 #include <object/cap_group.h>
 #include <arch/machine/smp.h>
 #include <ipc/connection.h>
+#include <ipc/futex.h>
 #include <irq/timer.h>
 #include <common/debug.h>
 
@@ -70,6 +71,9 @@ struct thread {
 
         /* Used for wake other threads in thread_exit */
         int *clear_child_tid;
+
+        /* Used when the thread waits on a futex */
+        struct futex_waiter futex_waiter;
 };
 
 #define thread_set_ts_ready(thread)                              \
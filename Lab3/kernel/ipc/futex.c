@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Futexes.
+ *
+ * Waiters are queued in the bucket which their futex hashes to, so that
+ * futexes in different buckets never contend on a lock. A waiter checks
+ * the futex value and blocks while holding its bucket lock, and a waker
+ * dequeues waiters under the same lock, thus no wakeup is lost.
+ *
+ * Private futexes are keyed by uaddr in the table of their process. The
+ * table grows when the process has more threads. Growing locks all the
+ * buckets of the old table, moves the waiters and marks the old table
+ * stale. Everyone locking a bucket checks the staleness afterwards and
+ * retries on the new table.
+ *
+ * Shared futexes are keyed by physical address in one global table, which
+ * never grows, so that processes mapping the same page share the futex.
+ *
+ * A timed wait also puts the thread on the sleep list of the timer. The
+ * timer locks the sleep list before the queue_lock of the thread, and thus
+ * cannot lock the bucket. It only marks the waiter timed out and wakes the
+ * thread. Wakers skip such a waiter, and the thread dequeues it on its next
+ * wait or on exit.
+ */
+
+#include <common/errno.h>
+#include <common/kprint.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <common/macro.h>
+#include <arch/sync.h>
+#include <arch/futex.h>
+#include <arch/mmu.h>
+#include <irq/timer.h>
+#include <mm/kmalloc.h>
+#include <mm/uaccess.h>
+#include <mm/vmspace.h>
+#include <object/cap_group.h>
+#include <object/thread.h>
+#include <sched/context.h>
+#include <sched/sched.h>
+#include <ipc/futex.h>
+
+/* Longer timeouts are cut, which keeps the tick computation from overflow */
+#define FUTEX_MAX_TIMEOUT_S (1UL << 32)
+
+static struct futex_table *futex_shared_table;
+
+static struct futex_table *futex_alloc_table(unsigned int bucket_bits)
+{
+        struct futex_table *table;
+        int i;
+
+        table = kmalloc(sizeof(*table)
+                        + sizeof(struct futex_bucket) * (1UL << bucket_bits));
+        if (!table)
+                return NULL;
+
+        table->bucket_bits = bucket_bits;
+        table->stale = false;
+        table->prev = NULL;
+        for (i = 0; i < (1 << bucket_bits); i++) {
+                lock_init(&table->buckets[i].lock);
+                init_list_head(&table->buckets[i].waiters);
+        }
+        return table;
+}
+
+static struct futex_bucket *futex_bucket_of(struct futex_table *table, u64 key)
+{
+        key /= sizeof(int);
+
+        /* Multiplicative hashing, using the golden ratio */
+        key *= 0x9e3779b97f4a7c15UL;
+        return &table->buckets[key >> (64 - table->bucket_bits)];
+}
+
+static struct futex_table *futex_table_of(struct cap_group *cap_group,
+                                          bool shared)
+{
+        return shared ? futex_shared_table : cap_group->futex_table;
+}
+
+static struct futex_bucket *futex_lock_bucket(struct cap_group *cap_group,
+                                              bool shared, u64 key)
+{
+        struct futex_table *table;
+        struct futex_bucket *bucket;
+
+        while (true) {
+                table = futex_table_of(cap_group, shared);
+                bucket = futex_bucket_of(table, key);
+                lock(&bucket->lock);
+                if (!table->stale)
+                        return bucket;
+                unlock(&bucket->lock);
+        }
+}
+
+/* Lock the buckets of two futexes, which may be the same bucket */
+static void futex_lock_two_buckets(struct cap_group *cap_group, bool shared,
+                                   u64 key1, u64 key2,
+                                   struct futex_bucket **bucket1,
+                                   struct futex_bucket **bucket2)
+{
+        struct futex_table *table;
+        struct futex_bucket *b1, *b2;
+
+        while (true) {
+                table = futex_table_of(cap_group, shared);
+                b1 = futex_bucket_of(table, key1);
+                b2 = futex_bucket_of(table, key2);
+                /* Lock in address order for avoiding dead lock */
+                if (b1 == b2) {
+                        lock(&b1->lock);
+                } else {
+                        lock(&MIN(b1, b2)->lock);
+                        lock(&MAX(b1, b2)->lock);
+                }
+                if (!table->stale)
+                        break;
+                unlock(&b1->lock);
+                if (b1 != b2)
+                        unlock(&b2->lock);
+        }
+
+        *bucket1 = b1;
+        *bucket2 = b2;
+}
+
+static void futex_unlock_two_buckets(struct futex_bucket *bucket1,
+                                     struct futex_bucket *bucket2)
+{
+        unlock(&bucket1->lock);
+        if (bucket1 != bucket2)
+                unlock(&bucket2->lock);
+}
+
+/*
+ * Get the key of the futex at @uaddr of the current process. A shared
+ * futex is keyed by the physical address, which is the same in all the
+ * processes mapping it.
+ */
+static int futex_get_key(int *uaddr, bool shared, u64 *key)
+{
+        struct vmspace *vmspace;
+        paddr_t pa;
+        int uval, ret;
+
+        if (!shared) {
+                *key = (u64)uaddr;
+                return 0;
+        }
+
+        if ((vaddr_t)uaddr % sizeof(*uaddr) != 0)
+                return -EINVAL;
+        /* Fault the page in before looking up the page table */
+        if (copy_from_user(&uval, uaddr, sizeof(uval)) != 0)
+                return -EFAULT;
+
+        vmspace = current_thread->vmspace;
+        lock(&vmspace->pgtbl_lock);
+        ret = query_in_pgtbl(vmspace->pgtbl, (vaddr_t)uaddr, &pa, NULL);
+        unlock(&vmspace->pgtbl_lock);
+        if (ret < 0)
+                return -EFAULT;
+
+        *key = pa;
+        return 0;
+}
+
+static unsigned int futex_bucket_bits_for(int nr_threads)
+{
+        unsigned long nr_buckets;
+        unsigned int bits = 0;
+
+        nr_buckets = (unsigned long)nr_threads * FUTEX_BUCKETS_PER_THREAD;
+        nr_buckets = MIN(MAX(nr_buckets, (unsigned long)FUTEX_MIN_BUCKETS),
+                         (unsigned long)FUTEX_MAX_BUCKETS);
+        while ((1UL << bits) < nr_buckets)
+                bits++;
+        return bits;
+}
+
+/* Grow the table if the process has more threads than it is sized for */
+static void futex_try_grow(struct cap_group *cap_group)
+{
+        struct futex_table *old, *new;
+        struct futex_waiter *waiter, *tmp;
+        unsigned int bits;
+        int i;
+
+        bits = futex_bucket_bits_for(cap_group->thread_cnt);
+        if (bits <= cap_group->futex_table->bucket_bits)
+                return;
+
+        /* Someone else is growing the table */
+        if (try_lock(&cap_group->futex_resize_lock) != 0)
+                return;
+
+        old = cap_group->futex_table;
+        if (bits <= old->bucket_bits)
+                goto out_unlock;
+
+        new = futex_alloc_table(bits);
+        if (!new) {
+                /* Keep working with the old table */
+                kwarn("%s: no memory for %d futex buckets\n",
+                      __func__, 1 << bits);
+                goto out_unlock;
+        }
+
+        for (i = 0; i < (1 << old->bucket_bits); i++)
+                lock(&old->buckets[i].lock);
+
+        /* The waiters of one futex are moved in order */
+        for (i = 0; i < (1 << old->bucket_bits); i++) {
+                for_each_in_list_safe (
+                        waiter, tmp, node, &old->buckets[i].waiters) {
+                        list_del(&waiter->node);
+                        list_append(&waiter->node,
+                                    &futex_bucket_of(new, waiter->key)
+                                             ->waiters);
+                }
+        }
+
+        new->prev = old;
+        old->stale = true;
+        smp_wmb();
+        cap_group->futex_table = new;
+
+        for (i = 0; i < (1 << old->bucket_bits); i++)
+                unlock(&old->buckets[i].lock);
+
+out_unlock:
+        unlock(&cap_group->futex_resize_lock);
+}
+
+void futex_init(struct cap_group *cap_group)
+{
+        /* The first futex_init runs at boot, before any futex is used */
+        if (!futex_shared_table) {
+                futex_shared_table =
+                        futex_alloc_table(FUTEX_SHARED_BUCKET_BITS);
+                BUG_ON(!futex_shared_table);
+        }
+
+        lock_init(&cap_group->futex_resize_lock);
+        cap_group->futex_table =
+                futex_alloc_table(futex_bucket_bits_for(0));
+        BUG_ON(!cap_group->futex_table);
+}
+
+static void futex_unqueue(struct futex_waiter *waiter)
+{
+        list_del(&waiter->node);
+        waiter->queued = false;
+}
+
+void futex_deinit(struct cap_group *cap_group)
+{
+        struct futex_table *table, *prev;
+        struct futex_waiter *waiter, *tmp;
+        int i;
+
+        table = cap_group->futex_table;
+        if (!table)
+                return;
+
+        /* Waiters left by threads which are not freed yet */
+        for (i = 0; i < (1 << table->bucket_bits); i++) {
+                for_each_in_list_safe (
+                        waiter, tmp, node, &table->buckets[i].waiters)
+                        futex_unqueue(waiter);
+        }
+
+        /* Waiters have all been moved out of the stale tables */
+        while (table) {
+                prev = table->prev;
+                kfree(table);
+                table = prev;
+        }
+        cap_group->futex_table = NULL;
+}
+
+/*
+ * Dequeue the waiter of @thread if it is still queued, which is the case
+ * after a timeout or when the thread exits while waiting.
+ */
+static void futex_unqueue_stale(struct thread *thread)
+{
+        struct futex_waiter *waiter = &thread->futex_waiter;
+        struct futex_bucket *bucket;
+        u64 key;
+
+        /* Only the thread itself queues its waiter */
+        while (waiter->queued) {
+                key = waiter->key;
+                bucket = futex_lock_bucket(
+                        thread->cap_group, waiter->shared, key);
+                /* Otherwise it was requeued before the bucket is locked */
+                if (waiter->queued && waiter->key == key)
+                        futex_unqueue(waiter);
+                unlock(&bucket->lock);
+        }
+}
+
+void futex_thread_exit(struct thread *thread)
+{
+        futex_unqueue_stale(thread);
+}
+
+/* Runs with the sleep list and the queue_lock of @thread locked */
+static void futex_timer_cb(struct thread *thread)
+{
+        thread->futex_waiter.timed_out = true;
+        arch_set_thread_return(thread, -ETIMEDOUT);
+        BUG_ON(sched_enqueue(thread));
+}
+
+/*
+ * Dequeue @waiter, whose bucket is locked, and wake its thread. Return
+ * false if the waiter has timed out, which is dequeued only.
+ */
+static bool futex_wake_waiter(struct futex_waiter *waiter)
+{
+        struct thread *thread;
+
+        thread = container_of(waiter, struct thread, futex_waiter);
+retry:
+        lock(&thread->sleep_state.queue_lock);
+        if (waiter->timed_out) {
+                futex_unqueue(waiter);
+                unlock(&thread->sleep_state.queue_lock);
+                return false;
+        }
+        /*
+         * Cancel the timeout. The timer may be expiring it and waiting for
+         * the queue_lock, thus retry rather than block, like sys_notify.
+         */
+        if (thread->sleep_state.cb != NULL && !try_dequeue_sleeper(thread)) {
+                unlock(&thread->sleep_state.queue_lock);
+                goto retry;
+        }
+        futex_unqueue(waiter);
+        BUG_ON(sched_enqueue(thread));
+        unlock(&thread->sleep_state.queue_lock);
+        return true;
+}
+
+/* Wake at most @nr_wake waiters of @key in @bucket, which is locked */
+static int futex_wake_locked(struct futex_bucket *bucket, u64 key,
+                             int nr_wake, u32 bitset)
+{
+        struct futex_waiter *waiter, *tmp;
+        int woken = 0;
+
+        for_each_in_list_safe (waiter, tmp, node, &bucket->waiters) {
+                if (woken >= nr_wake)
+                        break;
+                if (waiter->key != key || !(waiter->bitset & bitset))
+                        continue;
+                if (futex_wake_waiter(waiter))
+                        woken++;
+        }
+        return woken;
+}
+
+/*
+ * Wait on @uaddr if it still holds @val. @timeout is relative, or the
+ * absolute mono time if @abs_timeout. All the clocks of ChCore are the
+ * mono time, so is the deadline of FUTEX_CLOCK_REALTIME.
+ */
+static int futex_wait(int *uaddr, bool shared, int val, u32 bitset,
+                      struct timespec *timeout, bool abs_timeout)
+{
+        struct thread *thread = current_thread;
+        struct futex_waiter *waiter = &thread->futex_waiter;
+        struct futex_bucket *bucket;
+        struct timespec ts;
+        u64 key, deadline, now;
+        int uval, ret;
+
+        if (bitset == 0)
+                return -EINVAL;
+
+        if (timeout != NULL) {
+                if (copy_from_user(&ts, timeout, sizeof(ts)) != 0)
+                        return -EFAULT;
+                if (ts.tv_nsec < 0 || ts.tv_nsec >= NS_IN_S)
+                        return -EINVAL;
+                ts.tv_sec = MIN(ts.tv_sec, FUTEX_MAX_TIMEOUT_S);
+        }
+
+        futex_unqueue_stale(thread);
+
+        ret = futex_get_key(uaddr, shared, &key);
+        if (ret < 0)
+                return ret;
+
+        if (!shared)
+                futex_try_grow(thread->cap_group);
+        bucket = futex_lock_bucket(thread->cap_group, shared, key);
+
+        if (copy_from_user(&uval, uaddr, sizeof(uval)) != 0) {
+                unlock(&bucket->lock);
+                return -EFAULT;
+        }
+        if (uval != val) {
+                unlock(&bucket->lock);
+                return -EAGAIN;
+        }
+
+        if (timeout != NULL && abs_timeout) {
+                deadline = ts.tv_sec * NS_IN_S + ts.tv_nsec;
+                now = plat_get_mono_time();
+                if (deadline <= now) {
+                        unlock(&bucket->lock);
+                        return -ETIMEDOUT;
+                }
+                ts.tv_sec = (deadline - now) / NS_IN_S;
+                ts.tv_nsec = (deadline - now) % NS_IN_S;
+        } else if (timeout != NULL && ts.tv_sec == 0 && ts.tv_nsec == 0) {
+                unlock(&bucket->lock);
+                return -ETIMEDOUT;
+        }
+
+        waiter->key = key;
+        waiter->shared = shared;
+        waiter->bitset = bitset;
+        waiter->timed_out = false;
+        waiter->queued = true;
+        list_append(&waiter->node, &bucket->waiters);
+
+        /* Same as blocking on a notification */
+        lock(&thread->sleep_state.queue_lock);
+        BUG_ON(!thread_is_ts_running(thread));
+        thread->thread_ctx->state = TS_WAITING;
+        arch_set_thread_return(thread, 0);
+        if (timeout != NULL)
+                BUG_ON(enqueue_sleeper(thread, &ts, futex_timer_cb) != 0);
+
+        /* current_thread changes, and wakers wait for the bucket lock */
+        sched();
+
+        unlock(&thread->sleep_state.queue_lock);
+        unlock(&bucket->lock);
+        eret_to_thread(switch_context());
+        BUG("futex_wait should not return\n");
+        return 0;
+}
+
+static int futex_wake_key(struct cap_group *cap_group, bool shared, u64 key,
+                          int nr_wake, u32 bitset)
+{
+        struct futex_bucket *bucket;
+        int woken;
+
+        if (bitset == 0)
+                return -EINVAL;
+
+        bucket = futex_lock_bucket(cap_group, shared, key);
+        woken = futex_wake_locked(bucket, key, nr_wake, bitset);
+        unlock(&bucket->lock);
+
+        return woken;
+}
+
+static int futex_wake(int *uaddr, bool shared, int nr_wake, u32 bitset)
+{
+        u64 key;
+        int ret;
+
+        ret = futex_get_key(uaddr, shared, &key);
+        if (ret < 0)
+                return ret;
+        return futex_wake_key(current_cap_group, shared, key, nr_wake, bitset);
+}
+
+int futex_wake_bitset(struct cap_group *cap_group, int *uaddr, int nr_wake,
+                      u32 bitset)
+{
+        return futex_wake_key(cap_group, false, (u64)uaddr, nr_wake, bitset);
+}
+
+int sys_futex_wait(int *uaddr, int futex_op, int val, struct timespec *timeout)
+{
+        return futex_wait(uaddr,
+                          !(futex_op & FUTEX_PRIVATE),
+                          val,
+                          FUTEX_BITSET_MATCH_ANY,
+                          timeout,
+                          false);
+}
+
+int sys_futex_wake(int *uaddr, int futex_op, int val)
+{
+        return futex_wake(
+                uaddr, !(futex_op & FUTEX_PRIVATE), val, FUTEX_BITSET_MATCH_ANY);
+}
+
+/*
+ * Wake at most @nr_wake waiters of @uaddr and move at most @nr_requeue of
+ * the others to @uaddr2. Return the number of woken and moved waiters.
+ */
+int sys_futex_requeue(int *uaddr, int *uaddr2, int futex_op, int nr_wake,
+                      int nr_requeue)
+{
+        struct futex_bucket *bucket, *bucket2;
+        struct futex_waiter *waiter, *tmp;
+        bool shared = !(futex_op & FUTEX_PRIVATE);
+        u64 key, key2;
+        int woken, moved = 0, ret;
+
+        if (nr_wake < 0 || nr_requeue < 0)
+                return -EINVAL;
+        if ((ret = futex_get_key(uaddr, shared, &key)) < 0)
+                return ret;
+        if ((ret = futex_get_key(uaddr2, shared, &key2)) < 0)
+                return ret;
+        if (key == key2)
+                return -EINVAL;
+
+        futex_lock_two_buckets(
+                current_cap_group, shared, key, key2, &bucket, &bucket2);
+
+        woken = futex_wake_locked(bucket, key, nr_wake, FUTEX_BITSET_MATCH_ANY);
+        for_each_in_list_safe (waiter, tmp, node, &bucket->waiters) {
+                if (moved >= nr_requeue)
+                        break;
+                /* A timed out waiter is left for its thread to dequeue */
+                if (waiter->key != key || waiter->timed_out)
+                        continue;
+                list_del(&waiter->node);
+                waiter->key = key2;
+                list_append(&waiter->node, &bucket2->waiters);
+                moved++;
+        }
+
+        futex_unlock_two_buckets(bucket, bucket2);
+        return woken + moved;
+}
+
+/*
+ * Update *uaddr2 as encoded in @encoded_op and return its old value in
+ * @oldval. The update is an atomic read-modify-write of the user word, so
+ * it is also atomic to atomic instructions in user space.
+ */
+static int futex_do_op(int *uaddr2, int encoded_op, int *oldval)
+{
+        int op = (encoded_op >> 28) & 0x7;
+        /* Sign extend the 12-bit oparg */
+        int oparg = (int)((unsigned int)encoded_op << 8) >> 20;
+
+        if ((encoded_op >> 28) & FUTEX_OP_OPARG_SHIFT) {
+                if (oparg < 0 || oparg > 31)
+                        return -EINVAL;
+                oparg = 1 << oparg;
+        }
+
+        if (check_user_addr_range((vaddr_t)uaddr2, sizeof(*uaddr2)) != 0)
+                return -EFAULT;
+        /* Exclusive accesses to a misaligned address cannot be fixed up */
+        if ((vaddr_t)uaddr2 % sizeof(*uaddr2) != 0)
+                return -EINVAL;
+
+        return arch_futex_atomic_op_user(op, oparg, uaddr2, oldval);
+}
+
+static int futex_cmp(int oldval, int encoded_op)
+{
+        int cmp = (encoded_op >> 24) & 0xf;
+        /* Sign extend the 12-bit cmparg */
+        int cmparg = (int)((unsigned int)encoded_op << 20) >> 20;
+
+        switch (cmp) {
+        case FUTEX_OP_CMP_EQ:
+                return oldval == cmparg;
+        case FUTEX_OP_CMP_NE:
+                return oldval != cmparg;
+        case FUTEX_OP_CMP_LT:
+                return oldval < cmparg;
+        case FUTEX_OP_CMP_LE:
+                return oldval <= cmparg;
+        case FUTEX_OP_CMP_GT:
+                return oldval > cmparg;
+        case FUTEX_OP_CMP_GE:
+                return oldval >= cmparg;
+        default:
+                return -ENOSYS;
+        }
+}
+
+/*
+ * Update *uaddr2, wake at most @nr_wake waiters of @uaddr, and also wake at
+ * most @nr_wake2 waiters of @uaddr2 if the old value of *uaddr2 passes the
+ * comparison. Return the total number of woken waiters.
+ */
+static int futex_wake_op(int *uaddr, int *uaddr2, bool shared, int nr_wake,
+                         int nr_wake2, int encoded_op)
+{
+        struct futex_bucket *bucket, *bucket2;
+        u64 key, key2;
+        int oldval, woken, cmp, ret;
+
+        if ((ret = futex_get_key(uaddr, shared, &key)) < 0)
+                return ret;
+        if ((ret = futex_get_key(uaddr2, shared, &key2)) < 0)
+                return ret;
+
+        futex_lock_two_buckets(
+                current_cap_group, shared, key, key2, &bucket, &bucket2);
+
+        ret = futex_do_op(uaddr2, encoded_op, &oldval);
+        if (ret < 0)
+                goto out_unlock;
+
+        cmp = futex_cmp(oldval, encoded_op);
+        if (cmp < 0) {
+                ret = cmp;
+                goto out_unlock;
+        }
+
+        woken = futex_wake_locked(bucket, key, nr_wake, FUTEX_BITSET_MATCH_ANY);
+        if (cmp)
+                woken += futex_wake_locked(
+                        bucket2, key2, nr_wake2, FUTEX_BITSET_MATCH_ANY);
+        ret = woken;
+
+out_unlock:
+        futex_unlock_two_buckets(bucket, bucket2);
+        return ret;
+}
+
+int sys_futex(int *uaddr, int futex_op, int val, struct timespec *timeout,
+              int *uaddr2, int val3)
+{
+        bool shared = !(futex_op & FUTEX_PRIVATE);
+        int cmd;
+
+        cmd = futex_op & ~(FUTEX_PRIVATE | FUTEX_CLOCK_REALTIME);
+
+        switch (cmd) {
+        case FUTEX_WAIT:
+                return sys_futex_wait(uaddr, futex_op, val, timeout);
+        case FUTEX_WAKE:
+                return sys_futex_wake(uaddr, futex_op, val);
+        case FUTEX_REQUEUE:
+                /* The timeout argument carries nr_requeue */
+                return sys_futex_requeue(
+                        uaddr, uaddr2, futex_op, val, (int)(long)timeout);
+        case FUTEX_WAKE_OP:
+                /* The timeout argument carries nr_wake2 */
+                return futex_wake_op(
+                        uaddr, uaddr2, shared, val, (int)(long)timeout, val3);
+        case FUTEX_WAIT_BITSET:
+                return futex_wait(uaddr, shared, val, (u32)val3, timeout, true);
+        case FUTEX_WAKE_BITSET:
+                return futex_wake(uaddr, shared, val, (u32)val3);
+        default:
+                return -ENOSYS;
+        }
+}
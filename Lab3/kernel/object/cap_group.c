@@ -24,19 +24,57 @@
 #include <ipc/notification.h>
 #include <ipc/futex.h>
 #include <syscall/syscall_hooks.h>
+#include <arch/machine/smp.h>
 
 struct cap_group *root_cap_group;
 
-/* tool functions */
-static bool is_valid_slot_id(struct slot_table *slot_table, cap_t slot_id)
+/*
+ * Lock-free slot lookups (RCU style).
+ *
+ * get_opaque reads the slot table without table_guard. Each CPU counts its
+ * lookups in slot_read_states, whose seq is odd during a lookup. Writers
+ * still hold table_guard. They unpublish a slot or an old slots array
+ * first, then wait in slot_table_synchronize for every lookup in progress
+ * to finish, and only then free it or drop the reference the slot holds.
+ */
+struct slot_read_state {
+        volatile u64 seq;
+        char pad[pad_to_cache_line(sizeof(u64))];
+};
+
+static struct slot_read_state slot_read_states[PLAT_CPU_NUM];
+
+static inline struct slot_read_state *slot_read_begin(void)
 {
-        if (slot_id < 0 || slot_id >= slot_table->slots_size)
-                return false;
-        if (!get_bit(slot_id, slot_table->slots_bmp))
-                return false;
-        if (slot_table->slots[slot_id] == NULL)
-                BUG("slot NULL while bmp is not\n");
-        return true;
+        struct slot_read_state *state = &slot_read_states[smp_get_cpu_id()];
+
+        state->seq++;
+        /* Pairs with the barrier in slot_table_synchronize */
+        smp_mb();
+        return state;
+}
+
+static inline void slot_read_end(struct slot_read_state *state)
+{
+        smp_mb();
+        state->seq++;
+}
+
+void slot_table_synchronize(void)
+{
+        u64 seq;
+        int cpu;
+
+        smp_mb();
+        for (cpu = 0; cpu < PLAT_CPU_NUM; cpu++) {
+                seq = slot_read_states[cpu].seq;
+                if (!(seq & 1))
+                        continue;
+                /* Lookups never block, so this wait is short */
+                while (slot_read_states[cpu].seq == seq)
+                        ;
+        }
+        smp_mb();
 }
 
 static int slot_table_init(struct slot_table *slot_table, unsigned int size)
@@ -164,15 +202,27 @@ void cap_group_deinit(void *ptr)
         futex_deinit(cap_group);
 }
 
-/* slot allocation */
+/*
+ * slot allocation
+ *
+ * The slot table doubles when it is full, so that allocating n slots copies
+ * O(n) entries in total. The layout stays flat since prebuilt modules
+ * access slots and slots_bmp directly through get_slot and the bitmaps.
+ */
+/* Slot ids are non-negative ints */
+#define MAX_SLOT_TABLE_SIZE (1U << 30)
+
 static int expand_slot_table(struct slot_table *slot_table)
 {
         unsigned int new_size, old_size;
         struct slot_table new_slot_table;
+        struct object_slot **old_slots;
         int r;
 
         old_size = slot_table->slots_size;
-        new_size = old_size + BASE_OBJECT_NUM;
+        if (old_size >= MAX_SLOT_TABLE_SIZE)
+                return -ENOMEM;
+        new_size = MAX(old_size * 2, (unsigned int)BASE_OBJECT_NUM);
         r = slot_table_init(&new_slot_table, new_size);
         if (r < 0)
                 return r;
@@ -186,13 +236,22 @@ static int expand_slot_table(struct slot_table *slot_table)
         memcpy(new_slot_table.full_slots_bmp,
                slot_table->full_slots_bmp,
                BITS_TO_LONGS(BITS_TO_LONGS(old_size)) * sizeof(unsigned long));
-        slot_table->slots_size = new_size;
-        kfree(slot_table->slots);
+        /*
+         * Publish the new slots before the new size, see get_opaque.
+         * Lock-free lookups may still read the old slots until
+         * slot_table_synchronize returns.
+         */
+        old_slots = slot_table->slots;
         slot_table->slots = new_slot_table.slots;
+        smp_wmb();
+        slot_table->slots_size = new_size;
         kfree(slot_table->slots_bmp);
         slot_table->slots_bmp = new_slot_table.slots_bmp;
         kfree(slot_table->full_slots_bmp);
         slot_table->full_slots_bmp = new_slot_table.full_slots_bmp;
+
+        slot_table_synchronize();
+        kfree(old_slots);
         return 0;
 }
 
@@ -242,31 +301,38 @@ void *get_opaque(struct cap_group *cap_group, cap_t slot_id, bool type_valid,
                  int type, cap_right_t mask, cap_right_t rights)
 {
         struct slot_table *slot_table = &cap_group->slot_table;
+        struct slot_read_state *state;
+        struct object_slot **slots;
         struct object_slot *slot;
-        void *obj;
+        unsigned int slots_size;
+        void *obj = NULL;
 
-        read_lock(&slot_table->table_guard);
-        if (!is_valid_slot_id(slot_table, slot_id)) {
-                obj = NULL;
-                goto out_unlock_table;
-        }
+        state = slot_read_begin();
 
-        slot = get_slot(cap_group, slot_id);
-        BUG_ON(slot == NULL);
+        /* A new size guarantees the new slots, see expand_slot_table */
+        slots_size = slot_table->slots_size;
+        smp_rmb();
+        slots = slot_table->slots;
+        if (slot_id < 0 || slot_id >= slots_size)
+                goto out_end_read;
+
+        slot = ((struct object_slot *volatile *)slots)[slot_id];
+        if (!slot)
+                goto out_end_read;
         BUG_ON(slot->object == NULL);
 
         if ((!type_valid || slot->object->type == type)
             && cap_rights_equal(slot->rights, rights, mask)) {
                 obj = slot->object->opaque;
-        } else {
-                obj = NULL;
-                goto out_unlock_table;
+                /*
+                 * The slot holds a reference until the lookup ends, so the
+                 * refcount is never 0 here.
+                 */
+                atomic_fetch_add_long(&slot->object->refcount, 1);
         }
 
-        atomic_fetch_add_long(&slot->object->refcount, 1);
-
-out_unlock_table:
-        read_unlock(&slot_table->table_guard);
+out_end_read:
+        slot_read_end(state);
         return obj;
 }
 
@@ -398,6 +464,14 @@ cap_t sys_create_cap_group(unsigned long cap_group_args_p)
                 goto out_free_obj_vmspace;
         }
 
+        r = map_time_page(new_cap_group, vmspace);
+        if (r < 0) {
+                /* Drop the caps new_cap_group holds on itself and vmspace */
+                cap_free(new_cap_group, VMSPACE_OBJ_ID);
+                cap_free(new_cap_group, CAP_GROUP_OBJ_ID);
+                goto out_free_cap_grp_current;
+        }
+
         return cap;
 out_free_obj_vmspace:
         obj_free(vmspace);
@@ -446,6 +520,8 @@ struct cap_group *create_root_cap_group(char *name, size_t name_len)
 
         BUG_ON(slot_id != VMSPACE_OBJ_ID);
 
+        BUG_ON(map_time_page(cap_group, vmspace) != 0);
+
         /* Set the cap_group_name (process_name) for easing debugging */
         memset(cap_group->cap_group_name, 0, MAX_GROUP_NAME_LEN + 1);
         if (name_len > MAX_GROUP_NAME_LEN)
@@ -228,6 +228,9 @@ int __cap_free(struct cap_group *cap_group, cap_t slot_id,
         if (!slot_table_locked)
                 write_unlock(&slot_table->table_guard);
 
+        /* Lock-free lookups may still see the slot, see get_opaque */
+        slot_table_synchronize();
+
         /* Step-2: remove the slot in the copies-list of the object and free the
          * slot */
         object = slot->object;
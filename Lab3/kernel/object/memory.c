@@ -24,12 +24,18 @@
 #include <object/user_fault.h>
 #include <syscall/syscall_hooks.h>
 #include <mm/cache.h>
+#include <irq/timer.h>
+#include <uapi/time.h>
 
 #include "mmap.h"
 
 static int pmo_init(struct pmobject *pmo, pmo_type_t type, size_t len,
                     paddr_t paddr);
 void pmo_deinit(void *pmo_ptr);
+static int map_pmo_in_cap_group(struct cap_group *target_cap_group,
+                                struct vmspace *vmspace, cap_t pmo_cap,
+                                unsigned long addr, unsigned long perm,
+                                unsigned long len);
 
 CAP_ALLOC_IMPL(create_pmo,
                TYPE_PMO,
@@ -237,6 +243,77 @@ cap_t sys_create_pmo(unsigned long size, pmo_type_t type, unsigned long val, cap
         return r;
 }
 
+/*
+ * Create @cnt pmos in one syscall. The cap (or the error) of each pmo is
+ * returned in its ret_cap, and the first error (if any) is returned. A pmo
+ * whose map_addr is not 0 is also mapped into the caller with map_perm, so
+ * that mmap only takes one syscall.
+ */
+int sys_create_pmos(unsigned long user_buf, int cnt)
+{
+        struct pmo_request *ureqs = (struct pmo_request *)user_buf;
+        struct pmo_request req;
+        struct vmspace *vmspace;
+        int i, first_err = 0;
+        cap_t cap;
+        int r;
+
+        if (cnt <= 0 || cnt > PMO_BATCH_MAX)
+                return -EINVAL;
+        if (check_user_addr_range(user_buf, cnt * sizeof(req)) != 0)
+                return -EINVAL;
+
+        vmspace = obj_get(current_cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
+        BUG_ON(vmspace == NULL);
+
+        for (i = 0; i < cnt; i++) {
+                if (copy_from_user(&req, &ureqs[i], sizeof(req)) != 0) {
+                        first_err = first_err ?: -EINVAL;
+                        break;
+                }
+
+                /* Device and TrustZone pmos need an address */
+                if (req.size == 0 || req.type == PMO_DEVICE
+#ifdef CHCORE_OPENTRUSTEE
+                    || req.type == PMO_TZ_NS || req.type == PMO_TZ_SHM
+#endif /* CHCORE_OPENTRUSTEE */
+                ) {
+                        cap = -EINVAL;
+                } else if ((cap = hook_sys_create_pmo(req.size, req.type, 0))
+                           == 0) {
+                        cap = CAP_ALLOC_CALL(create_pmo,
+                                             current_cap_group,
+                                             PMO_ALL_RIGHTS,
+                                             req.type,
+                                             req.size,
+                                             0);
+                }
+
+                if (cap >= 0 && req.map_addr) {
+                        r = map_pmo_in_cap_group(current_cap_group,
+                                                 vmspace,
+                                                 cap,
+                                                 req.map_addr,
+                                                 req.map_perm,
+                                                 -1);
+                        if (r < 0) {
+                                cap_free(current_cap_group, cap);
+                                cap = r;
+                        }
+                }
+
+                if (cap < 0 && first_err == 0)
+                        first_err = cap;
+                if (copy_to_user(&ureqs[i].ret_cap, &cap, sizeof(cap)) != 0) {
+                        first_err = first_err ?: -EINVAL;
+                        break;
+                }
+        }
+
+        obj_put(vmspace);
+        return first_err;
+}
+
 #define WRITE 0
 #define READ  1
 static int read_write_pmo(cap_t pmo_cap, unsigned long offset,
@@ -426,23 +503,22 @@ int trans_uva_to_kva(vaddr_t user_va, vaddr_t *kernel_va)
 }
 
 /*
- * A process can not only map a PMO into its private address space,
- * but also can map a PMO to some others (e.g., load code for others).
+ * Map the pmo of @pmo_cap (in the current cap_group) into @vmspace of
+ * @target_cap_group, and copy the cap to the target if it is not the current
+ * cap_group.
  */
-int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
-                unsigned long perm, unsigned long len)
+static int map_pmo_in_cap_group(struct cap_group *target_cap_group,
+                                struct vmspace *vmspace, cap_t pmo_cap,
+                                unsigned long addr, unsigned long perm,
+                                unsigned long len)
 {
-        struct vmspace *vmspace;
         struct pmobject *pmo;
-        struct cap_group *target_cap_group;
         int r;
 
         pmo = obj_get_with_rights(
                 current_cap_group, pmo_cap, TYPE_PMO, perm, perm);
-        if (!pmo) {
-                r = -ECAPBILITY;
-                goto out_fail;
-        }
+        if (!pmo)
+                return -ECAPBILITY;
 
         /* set default length (-1) to pmo_size */
         if (likely(len == -1))
@@ -453,16 +529,6 @@ int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
                 goto out_obj_put_pmo;
         }
 
-        /* map the pmo to the target cap_group */
-        target_cap_group = obj_get(
-                current_cap_group, target_cap_group_cap, TYPE_CAP_GROUP);
-        if (!target_cap_group) {
-                r = -ECAPBILITY;
-                goto out_obj_put_pmo;
-        }
-        vmspace = obj_get(target_cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
-        BUG_ON(vmspace == NULL);
-
 #ifdef CHCORE_OPENTRUSTEE
         if (pmo->type == PMO_TZ_SHM) {
                 struct tee_shm_private *priv;
@@ -473,7 +539,7 @@ int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
                               sizeof(struct tee_uuid))
                                != 0) {
                         r = -EINVAL;
-                        goto out_obj_put_vmspace;
+                        goto out_obj_put_pmo;
                 }
         }
 #endif /* CHCORE_OPENTRUSTEE */
@@ -481,7 +547,7 @@ int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
         r = vmspace_map_range(vmspace, addr, len, perm, pmo);
         if (r != 0) {
                 r = -EPERM;
-                goto out_obj_put_vmspace;
+                goto out_obj_put_pmo;
         }
 
         /*
@@ -498,15 +564,87 @@ int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
         else
                 r = 0;
 
-out_obj_put_vmspace:
-        obj_put(vmspace);
-        obj_put(target_cap_group);
 out_obj_put_pmo:
         obj_put(pmo);
-out_fail:
         return r;
 }
 
+/*
+ * A process can not only map a PMO into its private address space,
+ * but also can map a PMO to some others (e.g., load code for others).
+ */
+int sys_map_pmo(cap_t target_cap_group_cap, cap_t pmo_cap, unsigned long addr,
+                unsigned long perm, unsigned long len)
+{
+        struct vmspace *vmspace;
+        struct cap_group *target_cap_group;
+        int r;
+
+        /* map the pmo to the target cap_group */
+        target_cap_group = obj_get(
+                current_cap_group, target_cap_group_cap, TYPE_CAP_GROUP);
+        if (!target_cap_group)
+                return -ECAPBILITY;
+        vmspace = obj_get(target_cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
+        BUG_ON(vmspace == NULL);
+
+        r = map_pmo_in_cap_group(
+                target_cap_group, vmspace, pmo_cap, addr, perm, len);
+
+        obj_put(vmspace);
+        obj_put(target_cap_group);
+        return r;
+}
+
+/*
+ * Map @cnt pmos into the target cap_group in one syscall, e.g., all the
+ * segments of a new process. The result of each request is returned in its
+ * ret, and the first error (if any) is returned.
+ */
+int sys_map_pmos(cap_t target_cap_group_cap, unsigned long user_buf, int cnt)
+{
+        struct pmo_map_request *ureqs = (struct pmo_map_request *)user_buf;
+        struct pmo_map_request req;
+        struct vmspace *vmspace;
+        struct cap_group *target_cap_group;
+        int i, r, first_err = 0;
+
+        if (cnt <= 0 || cnt > PMO_BATCH_MAX)
+                return -EINVAL;
+        if (check_user_addr_range(user_buf, cnt * sizeof(req)) != 0)
+                return -EINVAL;
+
+        target_cap_group = obj_get(
+                current_cap_group, target_cap_group_cap, TYPE_CAP_GROUP);
+        if (!target_cap_group)
+                return -ECAPBILITY;
+        vmspace = obj_get(target_cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
+        BUG_ON(vmspace == NULL);
+
+        for (i = 0; i < cnt; i++) {
+                if (copy_from_user(&req, &ureqs[i], sizeof(req)) != 0) {
+                        first_err = first_err ?: -EINVAL;
+                        break;
+                }
+                r = map_pmo_in_cap_group(target_cap_group,
+                                         vmspace,
+                                         req.pmo_cap,
+                                         req.addr,
+                                         req.perm,
+                                         -1);
+                if (r < 0 && first_err == 0)
+                        first_err = r;
+                if (copy_to_user(&ureqs[i].ret, &r, sizeof(r)) != 0) {
+                        first_err = first_err ?: -EINVAL;
+                        break;
+                }
+        }
+
+        obj_put(vmspace);
+        obj_put(target_cap_group);
+        return first_err;
+}
+
 /* Example usage: Used in ipc/connection.c for mapping ipc_shm */
 int map_pmo_in_current_cap_group(cap_t pmo_cap, unsigned long addr,
                                  unsigned long perm)
@@ -788,6 +926,39 @@ void pmo_deinit(void *pmo_ptr)
         /* The pmo struct itself will be free in __free_object */
 }
 
+/*
+ * Map the time page of @cap_group (see uapi/time.h) into @vmspace. Its
+ * fields never change, so each cap_group gets a private copy rather than
+ * all of them sharing one pmo, whose mapping_list every process creation
+ * and exit would then update concurrently.
+ */
+int map_time_page(struct cap_group *cap_group, struct vmspace *vmspace)
+{
+        struct pmobject *pmo;
+        struct time_page *time_page;
+        u64 tick, mono_ns;
+        cap_t pmo_cap;
+        int ret;
+
+        pmo_cap = create_pmo(PAGE_SIZE, PMO_DATA, cap_group, 0, &pmo, PMO_READ);
+        if (pmo_cap < 0)
+                return pmo_cap;
+
+        /* The timer only exports the mono time, derive its start from it */
+        tick = plat_get_current_tick();
+        mono_ns = plat_get_mono_time();
+        time_page = (struct time_page *)phys_to_virt(pmo->start);
+        time_page->tick_per_us = tick_per_us;
+        time_page->boot_tick = tick - mono_ns * tick_per_us / NS_IN_US;
+        time_page->magic = TIME_PAGE_MAGIC;
+
+        ret = vmspace_map_range(
+                vmspace, TIME_PAGE_VADDR, PAGE_SIZE, VMR_READ, pmo);
+        if (ret < 0)
+                cap_free(cap_group, pmo_cap);
+        return ret;
+}
+
 unsigned long sys_handle_brk(unsigned long addr, unsigned long heap_start)
 {
         struct vmspace *vmspace;
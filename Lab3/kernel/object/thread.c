@@ -81,6 +81,8 @@ int thread_init(struct thread *thread, struct cap_group *cap_group,
 
         lock_init(&thread->sleep_state.queue_lock);
 
+        thread->futex_waiter.queued = false;
+
         return 0;
 }
 
@@ -101,6 +103,8 @@ void thread_deinit(void *thread_ptr)
         if (thread->general_ipc_config)
                 kfree(thread->general_ipc_config);
 
+        futex_thread_exit(thread);
+
         destroy_thread_ctx(thread);
 
         /* The thread struct itself will be freed in __free_object */
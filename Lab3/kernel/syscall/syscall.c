@@ -137,7 +137,9 @@ const void *syscall_table[NR_SYSCALL] = {
 
         /* PMO */
         [CHCORE_SYS_create_pmo] = sys_create_pmo,
+        [CHCORE_SYS_create_pmos] = sys_create_pmos,
         [CHCORE_SYS_map_pmo] = sys_map_pmo,
+        [CHCORE_SYS_map_pmos] = sys_map_pmos,
         [CHCORE_SYS_unmap_pmo] = sys_unmap_pmo,
         [CHCORE_SYS_write_pmo] = sys_write_pmo,
         [CHCORE_SYS_read_pmo] = sys_read_pmo,
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/lock.h>
+#include <common/kprint.h>
+#include <common/bitops.h>
+#include <arch/machine/smp.h>
+#include <common/macro.h>
+#include <mm/kmalloc.h>
+#include <object/cap_group.h>
+#include <object/object.h>
+#include <arch/machine/pmu.h>
+
+#include "tests.h"
+
+#define CAP_LOOKUP_TEST_NUM 1000000
+/* Caps allocated by CPU 0 while the others look up, forcing expansions */
+#define CAP_LOOKUP_EXPAND_NUM (4 * BASE_OBJECT_NUM)
+#define CAP_ALLOC_TEST_NUM    100000
+#define CAP_ALLOC_REPORT_NUM  10000
+
+static struct test_barrier cap_lookup_barrier;
+static volatile int cap_lookup_expanding;
+static volatile u64 cap_lookup_cycles[PLAT_CPU_NUM];
+static struct cap_group *volatile cap_lookup_cap_group;
+static void *volatile cap_lookup_objs[PLAT_CPU_NUM];
+static volatile cap_t cap_lookup_caps[PLAT_CPU_NUM];
+static cap_t cap_lookup_expand_caps[CAP_LOOKUP_EXPAND_NUM];
+
+/* A cap_group with only a slot table, which is all the lookups need */
+static struct cap_group *cap_lookup_create_cap_group(void)
+{
+        struct cap_group *cap_group;
+        struct slot_table *slot_table;
+
+        cap_group = kzalloc(sizeof(*cap_group));
+        BUG_ON(!cap_group);
+        slot_table = &cap_group->slot_table;
+        slot_table->slots_size = BASE_OBJECT_NUM;
+        slot_table->slots =
+                kzalloc(BASE_OBJECT_NUM * sizeof(*slot_table->slots));
+        slot_table->slots_bmp = kzalloc(
+                BITS_TO_LONGS(BASE_OBJECT_NUM) * sizeof(unsigned long));
+        slot_table->full_slots_bmp = kzalloc(sizeof(unsigned long));
+        BUG_ON(!slot_table->slots || !slot_table->slots_bmp
+               || !slot_table->full_slots_bmp);
+        rwlock_init(&slot_table->table_guard);
+
+        return cap_group;
+}
+
+static cap_t cap_lookup_alloc_cap(struct cap_group *cap_group, void **objp)
+{
+        void *obj;
+        cap_t cap;
+
+        obj = obj_alloc(TYPE_NO_TYPE, sizeof(u64));
+        BUG_ON(!obj);
+        cap = cap_alloc(cap_group, obj);
+        BUG_ON(cap < 0);
+        if (objp)
+                *objp = obj;
+        return cap;
+}
+
+static void cap_lookup_run(const char *name, cap_t cap, void *obj)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct cap_group *cap_group = cap_lookup_cap_group;
+        u64 start, max_cycles = 0;
+        int i;
+
+        test_barrier_wait(&cap_lookup_barrier);
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < CAP_LOOKUP_TEST_NUM; i++) {
+                BUG_ON(obj_get(cap_group, cap, TYPE_NO_TYPE) != obj);
+                obj_put(obj);
+        }
+        cap_lookup_cycles[cpuid] = pmu_read_real_cycle() - start;
+
+        test_barrier_wait(&cap_lookup_barrier);
+
+        if (cpuid == 0) {
+                for (i = 0; i < PLAT_CPU_NUM; i++)
+                        max_cycles = MAX(max_cycles, cap_lookup_cycles[i]);
+                kinfo("[TEST] cap lookup on %s: %ld cycles per obj_get\n",
+                      name,
+                      max_cycles / CAP_LOOKUP_TEST_NUM);
+        }
+}
+
+/* CPU 0 expands the slot table while the other CPUs keep looking up */
+static void cap_lookup_run_expanding(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct cap_group *cap_group = cap_lookup_cap_group;
+        void *obj = cap_lookup_objs[cpuid];
+        cap_t cap = cap_lookup_caps[cpuid];
+        int i;
+
+        test_barrier_wait(&cap_lookup_barrier);
+
+        if (cpuid == 0) {
+                for (i = 0; i < CAP_LOOKUP_EXPAND_NUM; i++)
+                        cap_lookup_expand_caps[i] =
+                                cap_lookup_alloc_cap(cap_group, NULL);
+                cap_lookup_expanding = 0;
+        } else {
+                while (cap_lookup_expanding) {
+                        BUG_ON(obj_get(cap_group, cap, TYPE_NO_TYPE) != obj);
+                        obj_put(obj);
+                }
+        }
+
+        test_barrier_wait(&cap_lookup_barrier);
+}
+
+/*
+ * All CPUs look up one shared cap, then each CPU looks up its own cap.
+ * Lookups do not take table_guard, so only the refcount of a shared
+ * object is still contended.
+ */
+void tst_cap_lookup(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct cap_group *cap_group;
+        void *obj;
+        int i;
+
+        if (cpuid == 0) {
+                cap_group = cap_lookup_create_cap_group();
+                for (i = 0; i < PLAT_CPU_NUM; i++) {
+                        cap_lookup_caps[i] =
+                                cap_lookup_alloc_cap(cap_group, &obj);
+                        cap_lookup_objs[i] = obj;
+                }
+                cap_lookup_expanding = 1;
+                cap_lookup_cap_group = cap_group;
+        }
+        test_barrier_wait(&cap_lookup_barrier);
+
+        cap_lookup_run("one cap", cap_lookup_caps[0], cap_lookup_objs[0]);
+        cap_lookup_run("per-CPU caps",
+                       cap_lookup_caps[cpuid],
+                       cap_lookup_objs[cpuid]);
+        cap_lookup_run_expanding();
+
+        if (cpuid == 0) {
+                cap_group = cap_lookup_cap_group;
+                for (i = 0; i < CAP_LOOKUP_EXPAND_NUM; i++)
+                        BUG_ON(cap_free(cap_group, cap_lookup_expand_caps[i]));
+                for (i = 0; i < PLAT_CPU_NUM; i++) {
+                        BUG_ON(obj_get(cap_group,
+                                       cap_lookup_caps[i],
+                                       TYPE_NO_TYPE)
+                               != cap_lookup_objs[i]);
+                        obj_put(cap_lookup_objs[i]);
+                        BUG_ON(cap_free(cap_group, cap_lookup_caps[i]));
+                        BUG_ON(obj_get(cap_group,
+                                       cap_lookup_caps[i],
+                                       TYPE_NO_TYPE)
+                               != NULL);
+                }
+                kfree(cap_group->slot_table.slots);
+                kfree(cap_group->slot_table.slots_bmp);
+                kfree(cap_group->slot_table.full_slots_bmp);
+                kfree(cap_group);
+                kinfo("[TEST] cap lookup succ!\n");
+        }
+}
+
+/*
+ * Allocate many caps in one cap_group. The slot table grows geometrically,
+ * so the cycles per allocation should stay flat as the table gets larger.
+ */
+void tst_cap_alloc(void)
+{
+        struct cap_group *cap_group;
+        cap_t *caps;
+        u64 start;
+        int i;
+
+        if (smp_get_cpu_id() != 0)
+                return;
+
+        cap_group = cap_lookup_create_cap_group();
+        caps = kmalloc(CAP_ALLOC_TEST_NUM * sizeof(*caps));
+        BUG_ON(!caps);
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < CAP_ALLOC_TEST_NUM; i++) {
+                caps[i] = cap_lookup_alloc_cap(cap_group, NULL);
+                BUG_ON(caps[i] != i);
+                if ((i + 1) % CAP_ALLOC_REPORT_NUM == 0) {
+                        kinfo("[TEST] cap alloc at %d caps: %ld cycles per cap\n",
+                              i + 1,
+                              (pmu_read_real_cycle() - start)
+                                      / CAP_ALLOC_REPORT_NUM);
+                        start = pmu_read_real_cycle();
+                }
+        }
+
+        for (i = 0; i < CAP_ALLOC_TEST_NUM; i++)
+                BUG_ON(cap_free(cap_group, caps[i]));
+        kfree(caps);
+        kfree(cap_group->slot_table.slots);
+        kfree(cap_group->slot_table.slots_bmp);
+        kfree(cap_group->slot_table.full_slots_bmp);
+        kfree(cap_group);
+        kinfo("[TEST] cap alloc succ!\n");
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/lock.h>
+#include <common/kprint.h>
+#include <arch/machine/smp.h>
+#include <common/macro.h>
+#include <mm/kmalloc.h>
+#include <mm/mm.h>
+#include <object/cap_group.h>
+#include <ipc/futex.h>
+#include <arch/machine/pmu.h>
+
+#include "tests.h"
+
+#define LOCK_TEST_NUM 1000000
+#define FUTEX_TEST_NUM 1000000
+/* Keep the futex words of different CPUs in different pages */
+#define FUTEX_TEST_STRIDE (PAGE_SIZE / sizeof(int))
+
+static struct test_barrier mutex_barrier;
+static struct lock mutex_test_lock;
+/* Mutex test count */
+static unsigned long mutex_test_count;
+static volatile u64 mutex_cycles[PLAT_CPU_NUM];
+static struct cap_group *volatile futex_cap_group;
+
+/* Never accessed, only used as futex keys */
+static int futex_words[PLAT_CPU_NUM * FUTEX_TEST_STRIDE];
+
+static void mutex_report(const char *name, int nr_ops)
+{
+        u64 max_cycles = 0;
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++)
+                max_cycles = MAX(max_cycles, mutex_cycles[i]);
+        kinfo("[TEST] %s: %ld cycles per op\n", name, max_cycles / nr_ops);
+}
+
+/* All CPUs take one lock, which is what one futex table lock costs */
+static void mutex_run(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 start;
+        int i;
+
+        test_barrier_wait(&mutex_barrier);
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < LOCK_TEST_NUM; i++) {
+                if (i % 2)
+                        while (try_lock(&mutex_test_lock) != 0)
+                                ;
+                else
+                        lock(&mutex_test_lock);
+                /* Critical Section */
+                mutex_test_count++;
+                unlock(&mutex_test_lock);
+        }
+        mutex_cycles[cpuid] = pmu_read_real_cycle() - start;
+
+        test_barrier_wait(&mutex_barrier);
+
+        BUG_ON(mutex_test_count != PLAT_CPU_NUM * LOCK_TEST_NUM);
+        if (cpuid == 0)
+                mutex_report("mutex on one lock", LOCK_TEST_NUM);
+}
+
+/*
+ * Waking a futex without waiters only locks and scans its bucket, which is
+ * all the contention there is on the futex table.
+ */
+static void futex_run(const char *name, int *uaddr)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 start;
+        int i;
+
+        test_barrier_wait(&mutex_barrier);
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < FUTEX_TEST_NUM; i++)
+                BUG_ON(futex_wake_bitset(futex_cap_group,
+                                         uaddr,
+                                         1,
+                                         FUTEX_BITSET_MATCH_ANY)
+                       != 0);
+        mutex_cycles[cpuid] = pmu_read_real_cycle() - start;
+
+        test_barrier_wait(&mutex_barrier);
+
+        if (cpuid == 0)
+                mutex_report(name, FUTEX_TEST_NUM);
+}
+
+/*
+ * The mutex result is the baseline of the futex ones. All CPUs wake one
+ * shared futex, then each CPU wakes its own futex. The latter only
+ * contends if the futexes happen to share a bucket.
+ */
+void tst_mutex(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct cap_group *cap_group;
+
+        if (cpuid == 0) {
+                lock_init(&mutex_test_lock);
+                cap_group = kzalloc(sizeof(*cap_group));
+                BUG_ON(!cap_group);
+                futex_init(cap_group);
+                futex_cap_group = cap_group;
+        }
+
+        mutex_run();
+        futex_run("futex wake on one futex", &futex_words[0]);
+        futex_run("futex wake on per-CPU futexes",
+                  &futex_words[cpuid * FUTEX_TEST_STRIDE]);
+
+        if (cpuid == 0) {
+                futex_deinit(futex_cap_group);
+                kfree(futex_cap_group);
+                kinfo("[TEST] mutex succ!\n");
+        }
+}
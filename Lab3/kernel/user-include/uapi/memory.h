@@ -12,6 +12,10 @@
 #ifndef UAPI_MEMORY_H
 #define UAPI_MEMORY_H
 
+#ifndef __ASSEMBLER__
+#include <uapi/types.h>
+#endif
+
 /* pmo types */
 #ifndef __ASSEMBLER__
 typedef unsigned pmo_type_t;
@@ -56,6 +60,31 @@ struct free_mem_info {
     unsigned long free_mem_size; // in bytes
     unsigned long total_mem_size; // in bytes
 };
+
+/* Max number of requests in one sys_create_pmos or sys_map_pmos */
+#define PMO_BATCH_MAX 64
+
+struct pmo_request {
+        /* input: args */
+        unsigned long size;
+        unsigned long type;
+        /* input: also map the new pmo into the caller if map_addr is not 0 */
+        unsigned long map_addr;
+        unsigned long map_perm;
+
+        /* output: return value */
+        cap_t ret_cap;
+};
+
+struct pmo_map_request {
+        /* input: args */
+        cap_t pmo_cap;
+        unsigned long addr;
+        unsigned long perm;
+
+        /* output: return value */
+        int ret;
+};
 #endif
 
 #endif /* UAPI_MEMORY_H */
@@ -26,6 +26,8 @@
 #define CHCORE_SYS_write_pmo         6
 #define CHCORE_SYS_read_pmo          7
 #define CHCORE_SYS_get_phys_addr     8
+#define CHCORE_SYS_create_pmos      61
+#define CHCORE_SYS_map_pmos         62
 
 /* Capability */
 #define CHCORE_SYS_revoke_cap        9
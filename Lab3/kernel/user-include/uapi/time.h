@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef UAPI_TIME_H
+#define UAPI_TIME_H
+
+/*
+ * The time page is a read-only page the kernel maps at TIME_PAGE_VADDR in
+ * every cap_group. It lets user space compute CLOCK_MONOTONIC from the
+ * counter without a syscall, the same way sys_clock_gettime does:
+ *   mono_ns = (cntpct_el0 - boot_tick) * 1000 / tick_per_us
+ * The fields never change after the page is mapped. The page is the last
+ * one below USER_SPACE_END, above the heap and the thread stacks.
+ */
+#define TIME_PAGE_VADDR 0x7FFFFFFFF000UL
+#define TIME_PAGE_MAGIC 0x454d4954 /* "TIME" */
+
+struct time_page {
+        /* TIME_PAGE_MAGIC once the fields are valid */
+        unsigned int magic;
+        unsigned int pad;
+        /* Counter ticks per microsecond */
+        unsigned long tick_per_us;
+        /* Counter value when the clock starts */
+        unsigned long boot_tick;
+};
+
+#endif /* UAPI_TIME_H */
@@ -13,30 +13,5 @@
 #pragma once
 
 #include <chcore/type.h>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-struct pmo_request {
-        /* input: args */
-        unsigned long size;
-        unsigned long type;
-
-        /* output: return value */
-        cap_t ret_cap;
-};
-
-struct pmo_map_request {
-        /* input: args */
-        cap_t pmo_cap;
-        unsigned long addr;
-        unsigned long perm;
-
-        /* output: return value */
-        int ret;
-};
-
-#ifdef __cplusplus
-}
-#endif
+/* struct pmo_request and struct pmo_map_request are shared with the kernel */
+#include <uapi/memory.h>
@@ -30,8 +30,10 @@ cap_t usys_create_device_pmo(unsigned long paddr, unsigned long size);
 cap_t usys_create_pmo_with_rights(unsigned long size, unsigned long type, cap_right_t rights);
 cap_t usys_create_pmo(unsigned long size, unsigned long type);
 cap_t usys_create_pmo_with_val(unsigned long size, unsigned long type, unsigned long val);
+int usys_create_pmos(struct pmo_request *reqs, int cnt);
 int usys_map_pmo(cap_t cap_group_cap, cap_t pmo_cap,
                  unsigned long addr, unsigned long perm);
+int usys_map_pmos(cap_t cap_group_cap, struct pmo_map_request *reqs, int cnt);
 int usys_unmap_pmo(cap_t cap_group_cap, cap_t pmo_cap,
                    unsigned long addr);
 int usys_write_pmo(cap_t pmo_cap, unsigned long offset,
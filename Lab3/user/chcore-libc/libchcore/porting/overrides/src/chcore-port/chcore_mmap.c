@@ -218,9 +218,9 @@ void *chcore_mmap(void *start, size_t length, int prot, int flags, int fd,
                   off_t off)
 {
         struct pmo_node *node;
+        struct pmo_request pmo_req;
         void *map_addr = NULL;
         cap_t pmo_cap;
-        int ret;
         vmr_prop_t map_perm = prot;
 
         if (fd != -1) {
@@ -271,12 +271,16 @@ void *chcore_mmap(void *start, size_t length, int prot, int flags, int fd,
                 goto err_exit;
         }
 
-        /* pmo create */
-        pmo_cap = usys_create_pmo(length, PMO_ANONYM);
-        if (pmo_cap <= 0) {
-                printf("Fail: cannot create the new pmo for mmap\n");
+        /* Create the pmo and map it in one syscall */
+        pmo_req.size = length;
+        pmo_req.type = PMO_ANONYM;
+        pmo_req.map_addr = (vaddr_t)map_addr;
+        pmo_req.map_perm = map_perm;
+        if (usys_create_pmos(&pmo_req, 1) < 0) {
+                printf("Fail: cannot create and map the new pmo for mmap\n");
                 goto err_free_addr;
         }
+        pmo_cap = pmo_req.ret_cap;
 
         node = new_pmo_node(pmo_cap, (vaddr_t)map_addr, length, NULL);
         if (node == NULL) {
@@ -287,19 +291,10 @@ void *chcore_mmap(void *start, size_t length, int prot, int flags, int fd,
         add_node_in_order(node);
         pthread_spin_unlock(&va2pmo_lock);
 
-        /* map pmo */
-        if ((ret = usys_map_pmo(SELF_CAP, pmo_cap, (vaddr_t)map_addr, map_perm))
-            != 0) {
-                goto err_free_node;
-        }
-
         return map_addr;
 
-err_free_node:
-        htable_del(&node->hash_node);
-        list_del(&node->list_node);
-        free_pmo_node(node);
 err_free_pmo:
+        usys_unmap_pmo(SELF_CAP, pmo_cap, (vaddr_t)map_addr);
         usys_revoke_cap(pmo_cap, false);
 err_free_addr:
         chcore_free_vaddr((unsigned long)map_addr, length);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <stdbool.h>
+#include <time.h>
+#include <raw_syscall.h>
+#include <uapi/time.h>
+
+#include <chcore/syscall.h>
+
+#include "clock.h"
+
+#define NS_IN_S  (1000000000UL)
+#define NS_IN_US (1000UL)
+
+/* 0: not probed yet, 1: the time page is mapped, -1: it is not */
+static volatile int time_page_state;
+
+/* The kernel computes the mono time from the physical counter as well */
+static inline unsigned long read_physical_counter(void)
+{
+        unsigned long cnt;
+
+        asm volatile("isb; mrs %0, cntpct_el0" : "=r"(cnt)::"memory");
+        return cnt;
+}
+
+static bool time_page_usable(void)
+{
+        volatile struct time_page *time_page =
+                (volatile struct time_page *)TIME_PAGE_VADDR;
+        unsigned long paddr;
+
+        /* Probe once: an older kernel does not map the time page */
+        if (time_page_state == 0)
+                time_page_state =
+                        usys_get_phys_addr((void *)TIME_PAGE_VADDR, &paddr) == 0 ?
+                                1 :
+                                -1;
+
+        return time_page_state == 1 && time_page->magic == TIME_PAGE_MAGIC
+               && time_page->tick_per_us != 0;
+}
+
+/*
+ * All clocks are the monotonic time since boot in the kernel. Compute it
+ * from the physical counter and the kernel-maintained time page instead of
+ * trapping, and fall back to the syscall if the page is unusable.
+ */
+long chcore_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+        volatile struct time_page *time_page =
+                (volatile struct time_page *)TIME_PAGE_VADDR;
+        unsigned long mono_ns;
+
+        if (ts == NULL || !time_page_usable())
+                return chcore_syscall2(
+                        CHCORE_SYS_clock_gettime, clock, (long)ts);
+
+        mono_ns = (read_physical_counter() - time_page->boot_tick) * NS_IN_US
+                  / time_page->tick_per_us;
+        ts->tv_sec = mono_ns / NS_IN_S;
+        ts->tv_nsec = mono_ns % NS_IN_S;
+
+        return 0;
+}
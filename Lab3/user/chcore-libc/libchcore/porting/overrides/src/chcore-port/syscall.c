@@ -82,6 +82,41 @@ int usys_map_pmo(cap_t cap_group_cap, cap_t pmo_cap,
                                -1 /* pmo size */);
 }
 
+/*
+ * Batched versions of usys_create_pmo and usys_map_pmo, which take one
+ * syscall per PMO_BATCH_MAX requests. The result of each request is returned
+ * in it, and the first error (if any) is returned.
+ */
+int usys_create_pmos(struct pmo_request *reqs, int cnt)
+{
+        int i, n, ret, first_err = 0;
+
+        for (i = 0; i < cnt; i += n) {
+                n = cnt - i < PMO_BATCH_MAX ? cnt - i : PMO_BATCH_MAX;
+                ret = chcore_syscall2(
+                        CHCORE_SYS_create_pmos, (unsigned long)&reqs[i], n);
+                if (ret < 0 && first_err == 0)
+                        first_err = ret;
+        }
+        return first_err;
+}
+
+int usys_map_pmos(cap_t cap_group_cap, struct pmo_map_request *reqs, int cnt)
+{
+        int i, n, ret, first_err = 0;
+
+        for (i = 0; i < cnt; i += n) {
+                n = cnt - i < PMO_BATCH_MAX ? cnt - i : PMO_BATCH_MAX;
+                ret = chcore_syscall3(CHCORE_SYS_map_pmos,
+                                      cap_group_cap,
+                                      (unsigned long)&reqs[i],
+                                      n);
+                if (ret < 0 && first_err == 0)
+                        first_err = ret;
+        }
+        return first_err;
+}
+
 int usys_unmap_pmo(cap_t cap_group_cap, cap_t pmo_cap, unsigned long addr)
 {
         return chcore_syscall4(
@@ -53,6 +53,7 @@
 #include "eventfd.h"
 #include "pipe.h"
 #include "timerfd.h"
+#include "clock.h"
 #include "socket.h"
 #include "file.h"
 #include "fs_client_defs.h"
@@ -497,7 +498,7 @@ long __syscall2(long n, long a, long b)
                 return chcore_ftruncate(a, b);
         }
         case SYS_clock_gettime: {
-                return chcore_syscall2(CHCORE_SYS_clock_gettime, a, b);
+                return chcore_clock_gettime(a, (struct timespec *)b);
         }
         case SYS_set_robust_list: {
                 /* TODO Futex not implemented! */
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <time.h>
+#include "syscall.h"
+
+#include "../chcore-port/clock.h"
+
+/*
+ * ChCore has no vDSO. Read the time page directly instead of going through
+ * __syscall and the syscall dispatcher.
+ */
+int __clock_gettime(clockid_t clk, struct timespec *ts)
+{
+        return __syscall_ret(chcore_clock_gettime(clk, ts));
+}
+
+weak_alias(__clock_gettime, clock_gettime);
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <time.h>
+#include <sys/time.h>
+#include "syscall.h"
+
+#include "../chcore-port/clock.h"
+
+int gettimeofday(struct timeval *restrict tv, void *restrict tz)
+{
+        struct timespec ts;
+        long ret;
+
+        if (!tv)
+                return 0;
+        ret = chcore_clock_gettime(CLOCK_REALTIME, &ts);
+        if (ret < 0)
+                return __syscall_ret(ret);
+        tv->tv_sec = ts.tv_sec;
+        tv->tv_usec = (int)ts.tv_nsec / 1000;
+        return 0;
+}
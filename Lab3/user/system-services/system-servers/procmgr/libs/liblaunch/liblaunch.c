@@ -203,27 +203,20 @@ static void construct_init_env(char *env, vaddr_t top_vaddr,
         env_buf_append_int_auxv(&env_buf, AT_NULL, 0);
 }
 
-/* A wrapper of usys_create_pmo. */
+/* A wrapper of usys_create_pmos, which creates all the pmos in one syscall. */
 static void create_pmos(struct pmo_request *req, int cnt)
 {
-        for (int i = 0; i < cnt; ++i) {
-                req[i].ret_cap = usys_create_pmo(req[i].size, req[i].type);
-        }
+        /* In case the syscall fails before reaching some of the requests */
+        for (int i = 0; i < cnt; ++i)
+                req[i].ret_cap = -EINVAL;
+        usys_create_pmos(req, cnt);
 }
 
-/* A wrapper of usys_map_pmo. */
+/* A wrapper of usys_map_pmos, which maps all the pmos in one syscall. */
 static int map_pmos(cap_t target_process_cap,
                     struct pmo_map_request *pmos_map_requests, int cnt)
 {
-        int ret = 0;
-        for (int i = 0; i < cnt; ++i) {
-                struct pmo_map_request *req = &pmos_map_requests[i];
-                req->ret = usys_map_pmo(
-                        target_process_cap, req->pmo_cap, req->addr, req->perm);
-                if (req->ret < 0)
-                        ret = req->ret;
-        }
-        return ret;
+        return usys_map_pmos(target_process_cap, pmos_map_requests, cnt);
 }
 
 /** All processes have 2 pmo for stack and stack overflow detection */
@@ -260,7 +253,7 @@ int launch_process_with_pmos_caps(struct launch_process_args *lp_args)
         int ret;
         vaddr_t pc;
         /* for creating pmos */
-        struct pmo_request pmo_requests[DEFAULT_PMO_CNT];
+        struct pmo_request pmo_requests[DEFAULT_PMO_CNT] = {0};
         cap_t main_stack_cap;
         cap_t forbid_area_cap;
         u64 offset;
@@ -12,6 +12,7 @@
 
 #include <irq/ipi.h>
 #include <sched/sched.h>
+#include <irq/timer.h>
 
 void arch_send_ipi(u32 cpu, u32 ipi)
 {
@@ -22,6 +23,8 @@ void arch_handle_ipi(u32 ipi_vector)
 {
 	switch (ipi_vector) {
 	case IPI_RESCHED:
+		/* A thread is enqueued here, resume time slicing */
+		timer_restart_tick();
 		add_pending_resched(smp_get_cpu_id());
 		break;
 	default:
@@ -55,6 +55,9 @@ struct ipc_server_handler_config {
          * Multiple connection can use the same handler_thread.
          */
         struct ipc_connection *active_conn;
+
+        /* PC for short (register-only) requests, 0 if not supported */
+        vaddr_t short_routine_entry;
 };
 
 /*
@@ -74,6 +77,9 @@ struct ipc_server_register_cb_config {
         /* Not used now (can be exposed to server in future) */
         cap_t conn_cap_in_server;
         cap_t shm_cap_in_server;
+
+        /* Inherited by the handler threads created by this callback */
+        vaddr_t short_routine_entry;
 };
 
 /*
@@ -171,7 +177,10 @@ int sys_ipc_register_cb_return(cap_t server_thread_cap,
                                unsigned long server_shm_addr);
 
 unsigned long sys_ipc_call(cap_t conn_cap, unsigned int cap_num);
+unsigned long sys_ipc_call_short(cap_t conn_cap, unsigned long w0,
+                                 unsigned long w1, unsigned long w2);
 int sys_ipc_return(unsigned long ret, unsigned int cap_num);
+int sys_ipc_register_short(cap_t register_cb_cap, unsigned long short_routine);
 void sys_ipc_exit_routine_return(void);
 
 cap_t sys_ipc_get_cap(cap_t conn_cap, int index);
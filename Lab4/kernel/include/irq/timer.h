@@ -62,6 +62,10 @@ int enqueue_sleeper(struct thread *thread, const struct timespec *timeout,
 bool try_dequeue_sleeper(struct thread *thread);
 
 void timer_init(void);
+/* Tickless mode: restart the periodic tick stopped on idle CPUs */
+void timer_restart_tick(void);
+void timer_kick_cpu(u32 cpuid);
+u64 timer_get_ticks_avoided(u32 cpuid);
 void plat_timer_init(void);
 void plat_set_next_timer(u64 tick_delta);
 void handle_timer_irq(void);
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS),
+ * Shanghai Jiao Tong University (SJTU) Licensed under the Mulan PSL v2. You can
+ * use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v2 for more details.
+ */
+
+#ifndef SCHED_POLICY_PB_H
+#define SCHED_POLICY_PB_H
+
+#include <sched/sched.h>
+#include <common/bitops.h>
+#include <common/lock.h>
+#include <common/macro.h>
+
+#define PRIOS_PER_LEVEL BITS_PER_INT
+#define PRIO_LVL1_NUM   (PRIO_NUM / PRIOS_PER_LEVEL)
+
+struct prio_bitmap {
+        unsigned int lvl0;
+        unsigned int lvl1[PRIO_LVL1_NUM];
+};
+
+/* The ready queue of one CPU under pbrr and pbfifo */
+struct pb_ready_queue {
+        struct list_head queues[PRIO_NUM];
+        struct prio_bitmap bitmap;
+        struct lock queue_lock;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+/*
+ * Operations on a single ready queue, called with its queue_lock held.
+ * They do not change the thread state, so that kernel tests can drive a
+ * private queue without touching the scheduler in use.
+ */
+void pb_ready_queue_init(struct pb_ready_queue *ready_queue);
+void pb_ready_queue_insert(struct pb_ready_queue *ready_queue,
+                           struct thread *thread, bool to_head);
+void pb_ready_queue_remove(struct pb_ready_queue *ready_queue,
+                           struct thread *thread);
+struct thread *pb_sched_choose_thread(struct pb_ready_queue *ready_queue,
+                                      unsigned int cpuid, struct thread *old,
+                                      bool enable_fifo);
+
+#endif /* SCHED_POLICY_PB_H */
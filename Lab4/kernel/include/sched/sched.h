@@ -95,6 +95,8 @@ extern struct sched_ops *cur_sched_ops;
 int switch_to_thread(struct thread *target);
 int get_cpubind(struct thread *thread);
 struct thread *find_runnable_thread(struct list_head *thread_list);
+bool rr_sched_tick_needed(unsigned int cpuid);
+bool pb_sched_tick_needed(unsigned int cpuid);
 
 /* Global interfaces */
 /* Print the thread information */
@@ -126,6 +128,8 @@ void sched_to_thread(struct thread *target);
 void add_pending_resched(unsigned int cpuid);
 /* Wait until the kernel stack of target thread is free */
 void wait_for_kernel_stack(struct thread *thread);
+/* Whether the local CPU still needs its periodic tick */
+bool sched_tick_needed(void);
 
 int sched_init(struct sched_ops *sched_ops);
 
@@ -48,6 +48,12 @@
  *	- switches to S3
  *  - S3 invokes **sys_ipc_return**
  *	- switches to C
+ *
+ * **Short IPC call (fast path)**
+ *  - S1 declares a short routine with **sys_ipc_register_short(S2)**
+ *  - C invokes **sys_ipc_call_short** with a few words in registers
+ *	- switches to S3 at the short routine, the shm is never touched
+ *  - S3 invokes **sys_ipc_return** as usual
  */
 
 #include <arch/sync.h>
@@ -145,6 +151,7 @@ static int register_server(struct thread *server, unsigned long ipc_routine,
         register_cb_config->register_cb_stack =
                 arch_get_thread_stack(register_cb_thread);
         register_cb_config->destructor = destructor;
+        register_cb_config->short_routine_entry = 0;
         obj_put(register_cb_thread);
 
 #if defined(CHCORE_ARCH_AARCH64)
@@ -434,6 +441,44 @@ static void thread_migrate_to_client(struct thread *client,
         BUG_ON(1);
 }
 
+/*
+ * Only the words and the badge are passed, so the handler thread starts
+ * from its initial SP without any shm or cap buffer being prepared.
+ */
+static void ipc_thread_migrate_to_server_short(struct ipc_connection *conn,
+                                               vaddr_t short_routine_entry,
+                                               unsigned long w0,
+                                               unsigned long w1,
+                                               unsigned long w2)
+{
+        struct thread *target;
+        struct ipc_server_handler_config *handler_config;
+
+        target = conn->server_handler_thread;
+        handler_config =
+                (struct ipc_server_handler_config *)target->general_ipc_config;
+
+        handler_config->active_conn = conn;
+        conn->current_client_thread = current_thread;
+
+        thread_set_ts_blocking(current_thread);
+        target->thread_ctx->sc = current_thread->thread_ctx->sc;
+
+        arch_set_thread_stack(target, handler_config->ipc_routine_stack);
+        arch_set_thread_next_ip(target, short_routine_entry);
+
+        /* see short_server_handler type in uapi/ipc.h */
+        arch_set_thread_arg0(target, w0);
+        arch_set_thread_arg1(target, w1);
+        arch_set_thread_arg2(target, w2);
+        arch_set_thread_arg3(target, conn->client_badge);
+        set_thread_arch_spec_state_ipc(target);
+
+        sched_to_thread(target);
+
+        BUG_ON(1);
+}
+
 struct client_shm_config {
         cap_t shm_cap;
         unsigned long shm_addr;
@@ -708,6 +753,59 @@ out_obj_put:
         return r;
 }
 
+/*
+ * Issue a short IPC request carried by registers only.
+ * The server replies with sys_ipc_return and cap_num 0.
+ */
+unsigned long sys_ipc_call_short(cap_t conn_cap, unsigned long w0,
+                                 unsigned long w1, unsigned long w2)
+{
+        struct ipc_connection *conn;
+        struct ipc_server_handler_config *handler_config;
+        vaddr_t short_routine_entry;
+        int r = 0;
+
+        conn = obj_get(current_cap_group, conn_cap, TYPE_CONNECTION);
+        if (unlikely(!conn)) {
+                return -ECAPBILITY;
+        }
+
+        if (try_lock(&conn->ownership) == 0) {
+                if (conn->state != CONN_VALID) {
+                        unlock(&conn->ownership);
+                        obj_put(conn);
+                        return -EINVAL;
+                }
+        } else {
+                obj_put(conn);
+                r = check_if_exiting();
+                return r;
+        }
+
+        if ((r = lock_ipc_handler_thread(conn)) != 0)
+                goto out_obj_put;
+
+        handler_config = (struct ipc_server_handler_config *)
+                                 conn->server_handler_thread->general_ipc_config;
+        short_routine_entry = handler_config->short_routine_entry;
+        if (!short_routine_entry) {
+                /* The server only serves requests through the shm */
+                unlock_ipc_handler_thread(conn);
+                r = -EINVAL;
+                goto out_obj_put;
+        }
+
+        ipc_thread_migrate_to_server_short(
+                conn, short_routine_entry, w0, w1, w2);
+
+        BUG("should not reach here\n");
+
+out_obj_put:
+        unlock(&conn->ownership);
+        obj_put(conn);
+        return r;
+}
+
 int sys_ipc_return(unsigned long ret, unsigned int cap_num)
 {
         struct ipc_server_handler_config *handler_config;
@@ -923,6 +1021,8 @@ int sys_ipc_register_cb_return(cap_t server_handler_thread_cap,
                 handler_config->ipc_exit_routine_entry =
                         server_thread_exit_routine;
                 handler_config->destructor = config->destructor;
+                handler_config->short_routine_entry =
+                        config->short_routine_entry;
         }
         obj_put(ipc_server_handler_thread);
         /* Initialize the ipc configuration for the handler_thread (end) */
@@ -963,6 +1063,38 @@ out_fail:
         return r;
 }
 
+/*
+ * A server declares the routine serving short requests on its
+ * register_cb_thread. Handler threads created afterwards inherit it,
+ * so this should be done before the service is announced.
+ */
+int sys_ipc_register_short(cap_t register_cb_cap, unsigned long short_routine)
+{
+        struct thread *register_cb_thread;
+        struct ipc_server_register_cb_config *config;
+        int r = 0;
+
+        register_cb_thread =
+                obj_get(current_cap_group, register_cb_cap, TYPE_THREAD);
+        if (!register_cb_thread)
+                return -ECAPBILITY;
+
+        config = (struct ipc_server_register_cb_config *)
+                         register_cb_thread->general_ipc_config;
+        if (register_cb_thread->thread_ctx->type != TYPE_REGISTER || !config) {
+                r = -EINVAL;
+                goto out_put_thread;
+        }
+
+        lock(&config->register_lock);
+        config->short_routine_entry = short_routine;
+        unlock(&config->register_lock);
+
+out_put_thread:
+        obj_put(register_cb_thread);
+        return r;
+}
+
 void sys_ipc_exit_routine_return(void)
 {
         struct ipc_server_handler_config *config;
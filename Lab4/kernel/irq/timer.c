@@ -18,87 +18,158 @@
 #include <common/kprint.h>
 #include <common/list.h>
 #include <common/lock.h>
+#include <common/bitops.h>
+#include <common/macro.h>
 #include <mm/uaccess.h>
 #include <sched/context.h>
+#include <irq/ipi.h>
+#include <arch/sync.h>
+
+/*
+ * Sleepers of each core are kept in a hierarchical timing wheel.
+ * A level 0 slot covers one granule of TIMER_WHEEL_GRAN_US and a slot of
+ * level n covers TIMER_WHEEL_SLOTS slots of level n - 1. Inserting and
+ * removing a sleeper are O(1). Whenever level 0 wraps around, the due slot
+ * of the upper level is cascaded into the lower levels.
+ *
+ * A sleeper is expired at the first granule boundary after its
+ * wakeup_tick, i.e., never early and at most one granule late.
+ */
+#define TIMER_WHEEL_GRAN_US 100
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS  4
+/* Sleepers further away are parked in the last level and cascaded again */
+#define TIMER_WHEEL_RANGE (1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/*
+ * Tickless mode: a CPU whose scheduler does not need time slicing stops
+ * the periodic tick and only programs the timer for its earliest sleeper.
+ * The timer still fires at least every TICKLESS_MAX_MS as a safety net.
+ */
+#define TICKLESS_MAX_MS 1000
+
+#define wheel_level_shift(level) (TIMER_WHEEL_BITS * (level))
+#define wheel_level_idx(granule, level) \
+        (((granule) >> wheel_level_shift(level)) & TIMER_WHEEL_MASK)
 
 /* Per-core timer states */
 struct time_state {
         /* The tick when the next timer irq will occur */
         u64 next_expire;
+        /* The next granule to expire, earlier granules are all expired */
+        u64 wheel_clk;
+        /* Number of sleepers in the wheel */
+        u64 nr_sleepers;
         /*
-         * Record all sleepers on each core.
-         * Threads in sleep_list are sorted by the time to wakeup.
-         * It is better to use more efficient data structure (tree)
+         * Non-empty slots of each level. A bit may stay set after its slot
+         * becomes empty by try_dequeue_sleeper, which is harmless.
          */
-        struct list_head sleep_list;
-        /* Protect per core sleep_list */
+        unsigned long pending[TIMER_WHEEL_LEVELS];
+        /* Record all sleepers on each core */
+        struct list_head wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+        /* Protect per core wheel */
         struct lock sleep_list_lock;
+        /* Whether the periodic tick is stopped on this core */
+        volatile bool tick_stopped;
+        /* The tick when the last timer irq occurred */
+        u64 last_irq_tick;
+        /* Periodic ticks skipped while the tick is stopped */
+        u64 nr_ticks_avoided;
 };
 
 struct time_state time_states[PLAT_CPU_NUM];
 
+/* Number of ticks in one granule */
+static u64 wheel_gran_ticks = 1;
+
 void timer_init(void)
 {
-        int i;
+        int i, level, idx;
+        struct time_state *local_time_state;
 
         if (smp_get_cpu_id() == 0) {
                 for (i = 0; i < PLAT_CPU_NUM; i++) {
-                        init_list_head(&time_states[i].sleep_list);
+                        for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+                                for (idx = 0; idx < TIMER_WHEEL_SLOTS; idx++)
+                                        init_list_head(
+                                                &time_states[i]
+                                                         .wheel[level][idx]);
                         lock_init(&time_states[i].sleep_list_lock);
                 }
         }
 
         /* Per-core timer init */
         plat_timer_init();
+
+        /* tick_per_us is known now */
+        wheel_gran_ticks = MAX(TIMER_WHEEL_GRAN_US * tick_per_us, 1UL);
+        local_time_state = &time_states[smp_get_cpu_id()];
+        local_time_state->wheel_clk =
+                plat_get_current_tick() / wheel_gran_ticks;
+}
+
+/* The granule in which the sleeper expires */
+static u64 sleeper_expires(struct sleep_state *sleeper)
+{
+        return DIV_ROUND_UP(sleeper->wakeup_tick, wheel_gran_ticks);
 }
 
 /* Should be called when holding sleep_list_lock */
-static u64 get_next_tick_delta(void)
+static void wheel_add(struct time_state *time_state,
+                      struct sleep_state *sleeper)
 {
-        u64 waiting_tick, current_tick;
-        struct list_head *local_sleep_list;
-        struct sleep_state *first_sleeper;
+        u64 expires, delta;
+        int level, idx;
+
+        expires = MAX(sleeper_expires(sleeper), time_state->wheel_clk);
+        delta = expires - time_state->wheel_clk;
+        if (delta >= TIMER_WHEEL_RANGE) {
+                expires = time_state->wheel_clk + TIMER_WHEEL_RANGE - 1;
+                delta = TIMER_WHEEL_RANGE - 1;
+        }
 
-        local_sleep_list = &time_states[smp_get_cpu_id()].sleep_list;
+        for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+                if (delta < (1UL << wheel_level_shift(level + 1)))
+                        break;
+        }
 
-        /* Default tick */
-        waiting_tick = TICK_MS * US_IN_MS * tick_per_us;
-        if (list_empty(local_sleep_list))
-                return waiting_tick;
+        idx = wheel_level_idx(expires, level);
+        list_append(&sleeper->sleep_node, &time_state->wheel[level][idx]);
+        set_bit_in_slot(time_state->pending[level], idx);
+}
 
-        current_tick = plat_get_current_tick();
-        first_sleeper = list_entry(
-                local_sleep_list->next, struct sleep_state, sleep_node);
-        /* If a thread will wake up before default tick, update the tick. */
-        if (current_tick + waiting_tick > first_sleeper->wakeup_tick)
-                waiting_tick =
-                        first_sleeper->wakeup_tick > current_tick ?
-                                first_sleeper->wakeup_tick - current_tick :
-                                0;
+/* Should be called when holding sleep_list_lock */
+static void wheel_cascade(struct time_state *time_state, int level, int idx)
+{
+        struct sleep_state *iter = NULL, *tmp = NULL;
 
-        return waiting_tick;
+        clear_bit_in_slot(time_state->pending[level], idx);
+        for_each_in_list_safe (
+                iter, tmp, sleep_node, &time_state->wheel[level][idx]) {
+                list_del(&iter->sleep_node);
+                wheel_add(time_state, iter);
+        }
 }
 
 static void sleep_timer_cb(struct thread *thread);
-void handle_timer_irq(void)
+
+/* Should be called when holding sleep_list_lock */
+static void wheel_expire_slot(struct time_state *time_state, int idx,
+                              u64 current_tick)
 {
-        u64 current_tick, tick_delta;
-        struct time_state *local_time_state;
-        struct list_head *local_sleep_list;
-        struct lock *local_sleep_list_lock;
         struct sleep_state *iter = NULL, *tmp = NULL;
         struct thread *wakeup_thread;
 
-        /* Remove the thread to wakeup from sleep list */
-        current_tick = plat_get_current_tick();
-        local_time_state = &time_states[smp_get_cpu_id()];
-        local_sleep_list = &local_time_state->sleep_list;
-        local_sleep_list_lock = &local_time_state->sleep_list_lock;
-
-        lock(local_sleep_list_lock);
-        for_each_in_list_safe (iter, tmp, sleep_node, local_sleep_list) {
-                if (iter->wakeup_tick > current_tick) {
-                        break;
+        clear_bit_in_slot(time_state->pending[0], idx);
+        for_each_in_list_safe (
+                iter, tmp, sleep_node, &time_state->wheel[0][idx]) {
+                /* Parked beyond TIMER_WHEEL_RANGE, not due yet */
+                if (sleeper_expires(iter) > time_state->wheel_clk) {
+                        list_del(&iter->sleep_node);
+                        wheel_add(time_state, iter);
+                        continue;
                 }
 
                 wakeup_thread = container_of(iter, struct thread, sleep_state);
@@ -111,6 +182,7 @@ void handle_timer_irq(void)
                 lock(&wakeup_thread->sleep_state.queue_lock);
 
                 list_del(&iter->sleep_node);
+                time_state->nr_sleepers--;
 
                 BUG_ON(wakeup_thread->sleep_state.cb == sleep_timer_cb
                        && !thread_is_ts_blocking(wakeup_thread));
@@ -122,6 +194,118 @@ void handle_timer_irq(void)
 
                 unlock(&wakeup_thread->sleep_state.queue_lock);
         }
+}
+
+/* Should be called when holding sleep_list_lock */
+static void wheel_expire(struct time_state *time_state, u64 current_tick)
+{
+        u64 now, clk;
+        int level;
+
+        now = current_tick / wheel_gran_ticks;
+        while (time_state->wheel_clk <= now) {
+                /* Nothing to expire, jump to the current granule */
+                if (time_state->nr_sleepers == 0) {
+                        time_state->wheel_clk = now + 1;
+                        break;
+                }
+
+                clk = time_state->wheel_clk;
+                for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                        if (wheel_level_idx(clk, level - 1) != 0)
+                                break;
+                        wheel_cascade(
+                                time_state, level, wheel_level_idx(clk, level));
+                }
+
+                if (get_bit_in_slot(time_state->pending[0],
+                                    wheel_level_idx(clk, 0)))
+                        wheel_expire_slot(time_state,
+                                          wheel_level_idx(clk, 0),
+                                          current_tick);
+                time_state->wheel_clk++;
+        }
+}
+
+/*
+ * The first granule with pending sleepers in level 0, or the next cascade
+ * if level 0 is empty. Should be called when holding sleep_list_lock.
+ */
+static u64 wheel_next_expire(struct time_state *time_state)
+{
+        unsigned long pending = time_state->pending[0];
+        int shift = wheel_level_idx(time_state->wheel_clk, 0);
+
+        /* Rotate the bitmap so that bit 0 is the slot of wheel_clk */
+        if (shift)
+                pending = (pending >> shift)
+                          | (pending << (TIMER_WHEEL_SLOTS - shift));
+        if (pending)
+                return time_state->wheel_clk + ctzl(pending);
+
+        return ROUND_UP(time_state->wheel_clk, TIMER_WHEEL_SLOTS);
+}
+
+/* Should be called when holding sleep_list_lock */
+static u64 get_next_tick_delta(void)
+{
+        u64 waiting_tick, current_tick, next_tick;
+        struct time_state *local_time_state;
+
+        local_time_state = &time_states[smp_get_cpu_id()];
+
+        /* Default tick */
+        waiting_tick = TICK_MS * US_IN_MS * tick_per_us;
+
+        /*
+         * Publish tick_stopped before checking the ready queues, pairs
+         * with the barrier in rr_sched_enqueue and __pb_sched_enqueue. An
+         * enqueue racing with us either is seen here or sees tick_stopped
+         * and kicks this core.
+         */
+        local_time_state->tick_stopped = true;
+        smp_mb();
+        if (sched_tick_needed())
+                local_time_state->tick_stopped = false;
+        else
+                waiting_tick = TICKLESS_MAX_MS * US_IN_MS * tick_per_us;
+
+        if (local_time_state->nr_sleepers == 0)
+                return waiting_tick;
+
+        current_tick = plat_get_current_tick();
+        next_tick = wheel_next_expire(local_time_state) * wheel_gran_ticks;
+        /* If a thread will wake up before default tick, update the tick. */
+        if (current_tick + waiting_tick > next_tick)
+                waiting_tick =
+                        next_tick > current_tick ? next_tick - current_tick : 0;
+
+        return waiting_tick;
+}
+
+void handle_timer_irq(void)
+{
+        u64 current_tick, tick_delta, period, elapsed;
+        struct time_state *local_time_state;
+        struct lock *local_sleep_list_lock;
+
+        /* Remove the threads to wakeup from the wheel */
+        current_tick = plat_get_current_tick();
+        local_time_state = &time_states[smp_get_cpu_id()];
+        local_sleep_list_lock = &local_time_state->sleep_list_lock;
+
+        lock(local_sleep_list_lock);
+        /* Count the periodic ticks which did not happen */
+        period = TICK_MS * US_IN_MS * tick_per_us;
+        if (local_time_state->tick_stopped && period != 0) {
+                elapsed = (current_tick - local_time_state->last_irq_tick)
+                          / period;
+                if (elapsed > 1)
+                        local_time_state->nr_ticks_avoided += elapsed - 1;
+        }
+        local_time_state->last_irq_tick = current_tick;
+
+        wheel_expire(local_time_state, current_tick);
 
         /* Set when the next timer irq will arrive */
         tick_delta = get_next_tick_delta();
@@ -136,6 +320,49 @@ void handle_timer_irq(void)
         /* LAB 4 TODO END (exercise 6) */
 }
 
+/*
+ * Resume the periodic tick on the local core, called when a thread is
+ * enqueued to it. It does not take sleep_list_lock since it may be called
+ * from a sleeper callback in handle_timer_irq, which reprograms the timer
+ * by itself afterwards.
+ */
+void timer_restart_tick(void)
+{
+        struct time_state *local_time_state;
+        u64 period, next_expire;
+
+        local_time_state = &time_states[smp_get_cpu_id()];
+        if (!local_time_state->tick_stopped)
+                return;
+
+        local_time_state->tick_stopped = false;
+        period = TICK_MS * US_IN_MS * tick_per_us;
+        next_expire = plat_get_current_tick() + period;
+        /* Keep the timer irq of a sleeper due before the next tick */
+        if (local_time_state->next_expire <= next_expire)
+                return;
+
+        local_time_state->next_expire = next_expire;
+        plat_set_next_timer(period);
+}
+
+/* Resume the periodic tick on @cpuid if it is stopped */
+void timer_kick_cpu(u32 cpuid)
+{
+        if (!time_states[cpuid].tick_stopped)
+                return;
+
+        if (cpuid == smp_get_cpu_id())
+                timer_restart_tick();
+        else
+                send_ipi(cpuid, IPI_RESCHED);
+}
+
+u64 timer_get_ticks_avoided(u32 cpuid)
+{
+        return time_states[cpuid].nr_ticks_avoided;
+}
+
 /*
  * clock_gettime:
  * - now we all clock sources are monotime
@@ -170,45 +397,41 @@ int enqueue_sleeper(struct thread *thread, const struct timespec *timeout,
                     timer_cb cb)
 {
         u64 s, ns, total_us;
-        u64 wakeup_tick;
+        u64 current_tick, wakeup_tick, expire_tick;
         struct time_state *local_time_state;
-        struct list_head *local_sleep_list;
         struct lock *local_sleep_list_lock;
-        struct sleep_state *iter;
 
         s = timeout->tv_sec;
         ns = timeout->tv_nsec;
         total_us = s * US_IN_S + ns / NS_IN_US;
 
-        wakeup_tick = plat_get_current_tick() + total_us * tick_per_us;
+        current_tick = plat_get_current_tick();
+        wakeup_tick = current_tick + total_us * tick_per_us;
         thread->sleep_state.wakeup_tick = wakeup_tick;
         thread->sleep_state.sleep_cpu = smp_get_cpu_id();
 
         local_time_state = &time_states[smp_get_cpu_id()];
-        local_sleep_list = &local_time_state->sleep_list;
         local_sleep_list_lock = &local_time_state->sleep_list_lock;
 
         lock(local_sleep_list_lock);
-        for_each_in_list (
-                iter, struct sleep_state, sleep_node, local_sleep_list) {
-                if (iter->wakeup_tick > wakeup_tick)
-                        break;
-        }
-        list_append(&thread->sleep_state.sleep_node, &iter->sleep_node);
+        wheel_add(local_time_state, &thread->sleep_state);
+        local_time_state->nr_sleepers++;
         thread->sleep_state.cb = cb;
 
         unlock(local_sleep_list_lock);
 
         /*
          * If the current sleep need to wake up earlier than when next timer
-         * irq occurs, update timer.
+         * irq occurs, update timer. The wheel expires it at the end of the
+         * granule, so fire the timer there.
          */
+        expire_tick = sleeper_expires(&thread->sleep_state) * wheel_gran_ticks;
         kdebug("next tick:%lld current tick:%lld\n",
-               wakeup_tick,
-               time_states[smp_get_cpu_id()].next_expire);
-        if (time_states[smp_get_cpu_id()].next_expire > wakeup_tick) {
-                time_states[smp_get_cpu_id()].next_expire = wakeup_tick;
-                plat_set_next_timer(total_us * tick_per_us);
+               expire_tick,
+               local_time_state->next_expire);
+        if (local_time_state->next_expire > expire_tick) {
+                local_time_state->next_expire = expire_tick;
+                plat_set_next_timer(expire_tick - current_tick);
         }
 
         return 0;
@@ -233,6 +456,7 @@ bool try_dequeue_sleeper(struct thread *thread)
                 BUG_ON(thread->sleep_state.cb == NULL);
 
                 list_del(&thread->sleep_state.sleep_node);
+                target_time_state->nr_sleepers--;
                 thread->sleep_state.cb = NULL;
                 ret = true;
 
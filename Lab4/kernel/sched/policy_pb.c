@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS),
+ * Shanghai Jiao Tong University (SJTU) Licensed under the Mulan PSL v2. You can
+ * use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v2 for more details.
+ */
+
+#include <sched/policy_pb.h>
+#include <common/kprint.h>
+#include <common/bitops.h>
+#include <common/util.h>
+#include <machine.h>
+#include <object/thread.h>
+#include <object/cap_group.h>
+#include <irq/timer.h>
+#include <arch/sync.h>
+
+/*
+ * Priority based policies: pbrr and pbfifo.
+ *
+ * Each CPU has one ready queue per priority and a two-level bitmap of the
+ * non-empty queues: bit i of lvl0 is set if lvl1[i] is not 0, and bit j of
+ * lvl1[i] is set if the queue of priority (i * PRIOS_PER_LEVEL + j) is not
+ * empty. The highest ready priority is found with two bsr, so picking the
+ * next thread does not depend on the number of ready threads.
+ *
+ * Like RR, idle threads are never in the ready queues.
+ */
+
+#if PRIO_NUM > 32 * 32 || PRIO_NUM % 32 != 0
+#error PRIO_NUM not supported by the priority bitmap
+#endif
+
+/*
+ * All the variables (except struct sched_ops pbrr and pbfifo) and functions
+ * are static. We omit the modifier due to they are used in kernel tests.
+ */
+
+/* pb_ready_queues: Per-CPU ready queues for ready tasks. */
+struct pb_ready_queue pb_ready_queues[PLAT_CPU_NUM];
+
+static inline void prio_bitmap_set(struct prio_bitmap *bitmap,
+                                   unsigned int prio)
+{
+        bitmap->lvl1[prio / PRIOS_PER_LEVEL] |= BIT(prio % PRIOS_PER_LEVEL);
+        bitmap->lvl0 |= BIT(prio / PRIOS_PER_LEVEL);
+}
+
+static inline void prio_bitmap_clear(struct prio_bitmap *bitmap,
+                                     unsigned int prio)
+{
+        unsigned int index = prio / PRIOS_PER_LEVEL;
+
+        bitmap->lvl1[index] &= ~BIT(prio % PRIOS_PER_LEVEL);
+        if (bitmap->lvl1[index] == 0)
+                bitmap->lvl0 &= ~BIT(index);
+}
+
+/* Return the highest priority with ready threads, or -1 if there is none */
+static inline int prio_bitmap_highest(struct prio_bitmap *bitmap)
+{
+        int index;
+
+        if (bitmap->lvl0 == 0)
+                return -1;
+
+        index = bsr(bitmap->lvl0);
+        return index * PRIOS_PER_LEVEL + bsr(bitmap->lvl1[index]);
+}
+
+void pb_ready_queue_init(struct pb_ready_queue *ready_queue)
+{
+        int prio;
+
+        for (prio = 0; prio < PRIO_NUM; prio++)
+                init_list_head(&ready_queue->queues[prio]);
+        memset(&ready_queue->bitmap, 0, sizeof(ready_queue->bitmap));
+        lock_init(&ready_queue->queue_lock);
+}
+
+void pb_ready_queue_insert(struct pb_ready_queue *ready_queue,
+                           struct thread *thread, bool to_head)
+{
+        unsigned int prio = thread->thread_ctx->sc->prio;
+
+        if (to_head)
+                list_add(&thread->ready_queue_node,
+                         &ready_queue->queues[prio]);
+        else
+                list_append(&thread->ready_queue_node,
+                            &ready_queue->queues[prio]);
+        prio_bitmap_set(&ready_queue->bitmap, prio);
+}
+
+void pb_ready_queue_remove(struct pb_ready_queue *ready_queue,
+                           struct thread *thread)
+{
+        unsigned int prio = thread->thread_ctx->sc->prio;
+
+        list_del(&thread->ready_queue_node);
+        if (list_empty(&ready_queue->queues[prio]))
+                prio_bitmap_clear(&ready_queue->bitmap, prio);
+}
+
+/*
+ * Put @thread into the ready queue of its priority, at the head if
+ * @to_head is set (a preempted pbfifo thread) or at the end otherwise.
+ * If affinity = NO_AFF, assign the core to the current cpu.
+ * If the thread is IDLE thread, do nothing!
+ */
+int __pb_sched_enqueue(struct thread *thread, bool to_head)
+{
+        struct pb_ready_queue *ready_queue;
+        unsigned int cpuid;
+        int cpubind;
+
+        BUG_ON(!thread);
+        BUG_ON(!thread->thread_ctx);
+        if (thread->thread_ctx->type == TYPE_IDLE)
+                return 0;
+
+        /* Already in the ready queue */
+        if (thread_is_ts_ready(thread))
+                return -EINVAL;
+
+        BUG_ON(thread->thread_ctx->sc->prio >= PRIO_NUM);
+
+        cpubind = get_cpubind(thread);
+        cpuid = cpubind == NO_AFF ? smp_get_cpu_id() : cpubind;
+        if (unlikely(cpuid >= PLAT_CPU_NUM))
+                return -EINVAL;
+
+        thread->thread_ctx->cpuid = cpuid;
+        thread_set_ts_ready(thread);
+
+        ready_queue = &pb_ready_queues[cpuid];
+        lock(&ready_queue->queue_lock);
+        pb_ready_queue_insert(ready_queue, thread, to_head);
+        unlock(&ready_queue->queue_lock);
+
+        add_pending_resched(cpuid);
+
+        /*
+         * Make the enqueue visible before checking whether the target CPU
+         * has stopped its tick, pairs with get_next_tick_delta().
+         */
+        smp_mb();
+        timer_kick_cpu(cpuid);
+        return 0;
+}
+
+int pb_sched_enqueue(struct thread *thread)
+{
+        return __pb_sched_enqueue(thread, false);
+}
+
+/* dequeue w/o lock */
+void __pb_sched_dequeue(struct thread *thread)
+{
+        /* IDLE thread will **not** be in any ready queue */
+        BUG_ON(thread->thread_ctx->type == TYPE_IDLE);
+
+        pb_ready_queue_remove(&pb_ready_queues[thread->thread_ctx->cpuid],
+                              thread);
+}
+
+/*
+ * remove @thread from its current residual ready queue
+ */
+int pb_sched_dequeue(struct thread *thread)
+{
+        struct pb_ready_queue *ready_queue;
+        int ret = 0;
+
+        BUG_ON(!thread);
+        BUG_ON(!thread->thread_ctx);
+
+        ready_queue = &pb_ready_queues[thread->thread_ctx->cpuid];
+        lock(&ready_queue->queue_lock);
+        if (thread_is_ts_ready(thread))
+                __pb_sched_dequeue(thread);
+        else
+                ret = -EINVAL;
+        unlock(&ready_queue->queue_lock);
+
+        return ret;
+}
+
+/* Whether @old may go on running on @cpuid rather than being preempted */
+static bool pb_can_keep_running(struct thread *old, unsigned int cpuid)
+{
+        int affinity;
+
+        if (!old || !thread_is_ts_running(old) || thread_is_suspend(old)
+            || thread_is_exited(old))
+                return false;
+
+        affinity = old->thread_ctx->affinity;
+        return affinity == NO_AFF || affinity == cpuid;
+}
+
+/*
+ * Choose the thread to run next on @cpuid from @ready_queue and remove it.
+ * @old is the current thread if it may keep running, otherwise NULL. It
+ * keeps the CPU against ready threads of a lower priority, and of the same
+ * priority as long as it has budget left or the policy is FIFO.
+ * Should be called with the queue_lock of @ready_queue held.
+ */
+struct thread *pb_sched_choose_thread(struct pb_ready_queue *ready_queue,
+                                      unsigned int cpuid, struct thread *old,
+                                      bool enable_fifo)
+{
+        struct thread *thread;
+        int prio, old_prio;
+
+again:
+        prio = prio_bitmap_highest(&ready_queue->bitmap);
+        if (old) {
+                old_prio = old->thread_ctx->sc->prio;
+                if (old_prio > prio
+                    || (old_prio == prio
+                        && (enable_fifo || old->thread_ctx->sc->budget != 0)))
+                        return old;
+        }
+
+        for (; prio > IDLE_PRIO; prio--) {
+                if (list_empty(&ready_queue->queues[prio]))
+                        continue;
+                /*
+                 * When the thread is just moved from another cpu and
+                 * the kernel stack is used by the original core, try
+                 * to find another thread.
+                 */
+                thread = find_runnable_thread(&ready_queue->queues[prio]);
+                if (!thread)
+                        continue;
+
+                pb_ready_queue_remove(ready_queue, thread);
+                if (thread_is_exiting(thread) || thread_is_exited(thread)) {
+                        /* Thread need to exit. Set the state to TE_EXITED */
+                        thread_set_exited(thread);
+                        goto again;
+                }
+                return thread;
+        }
+
+        return old ? old : &idle_threads[cpuid];
+}
+
+int __pb_sched(bool enable_fifo)
+{
+        /* WITH IRQ Disabled */
+        struct thread *old = current_thread;
+        struct thread *new;
+        unsigned int cpuid = smp_get_cpu_id();
+
+        /* Check whether the thread is going to exit */
+        if (old && thread_is_exiting(old)) {
+                /* Set the state to TE_EXITED */
+                thread_set_exited(old);
+        }
+
+        lock(&pb_ready_queues[cpuid].queue_lock);
+        new = pb_sched_choose_thread(
+                &pb_ready_queues[cpuid],
+                cpuid,
+                pb_can_keep_running(old, cpuid) ? old : NULL,
+                enable_fifo);
+        unlock(&pb_ready_queues[cpuid].queue_lock);
+
+        /* A preempted thread keeps its place in the queue under FIFO */
+        if (old && old != new && !thread_is_exited(old)
+            && thread_is_ts_running(old))
+                BUG_ON(__pb_sched_enqueue(old, enable_fifo));
+
+        if (new->thread_ctx->sc->budget == 0)
+                new->thread_ctx->sc->budget = DEFAULT_BUDGET;
+
+        switch_to_thread(new);
+        return 0;
+}
+
+int pbrr_sched(void)
+{
+        return __pb_sched(false);
+}
+
+int pbfifo_sched(void)
+{
+        return __pb_sched(true);
+}
+
+/*
+ * The periodic tick of @cpuid is needed to slice time between ready
+ * threads. Unlike RR, pb never steals from remote queues, so an idle CPU
+ * with an empty queue can stop it.
+ */
+bool pb_sched_tick_needed(unsigned int cpuid)
+{
+        return pb_ready_queues[cpuid].bitmap.lvl0 != 0;
+}
+
+int pb_sched_init(void)
+{
+        unsigned int cpuid;
+
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++)
+                pb_ready_queue_init(&pb_ready_queues[cpuid]);
+
+        return 0;
+}
+
+#define MAX_CAP_GROUP_BUF 128
+
+static void pb_top_record_cap_group(struct cap_group **cap_group_buf,
+                                    unsigned int *cap_group_num,
+                                    struct cap_group *cap_group)
+{
+        unsigned int i;
+
+        for (i = 0; i < *cap_group_num; i++)
+                if (cap_group_buf[i] == cap_group)
+                        return;
+        if (*cap_group_num < MAX_CAP_GROUP_BUF)
+                cap_group_buf[(*cap_group_num)++] = cap_group;
+}
+
+void pb_top(void)
+{
+        struct cap_group *cap_group_buf[MAX_CAP_GROUP_BUF] = {0};
+        unsigned int cap_group_num = 0;
+        unsigned int cpuid, i;
+        struct thread *thread;
+        int prio;
+
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                lock(&pb_ready_queues[cpuid].queue_lock);
+        }
+
+        printk("\n*****CPU RQ Info*****\n");
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                printk("== CPU %d RQ ==\n", cpuid);
+                thread = current_threads[cpuid];
+                if (thread != NULL) {
+                        pb_top_record_cap_group(
+                                cap_group_buf, &cap_group_num, thread->cap_group);
+                        printk("Current ");
+                        print_thread(thread);
+                }
+                for (prio = MAX_PRIO; prio >= 0; prio--) {
+                        for_each_in_list (
+                                thread,
+                                struct thread,
+                                ready_queue_node,
+                                &pb_ready_queues[cpuid].queues[prio]) {
+                                pb_top_record_cap_group(cap_group_buf,
+                                                        &cap_group_num,
+                                                        thread->cap_group);
+                                print_thread(thread);
+                        }
+                }
+                printk("\n");
+        }
+
+        printk("\n*****CAP GROUP Info*****\n");
+        for (i = 0; i < cap_group_num; i++) {
+                printk("== CAP GROUP:%s ==\n",
+                       cap_group_buf[i]->cap_group_name);
+                for_each_in_list (thread,
+                                  struct thread,
+                                  node,
+                                  &(cap_group_buf[i]->thread_list)) {
+                        print_thread(thread);
+                }
+                printk("\n");
+        }
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                unlock(&pb_ready_queues[cpuid].queue_lock);
+        }
+}
+
+struct sched_ops pbrr = {.sched_init = pb_sched_init,
+                         .sched = pbrr_sched,
+                         .sched_periodic = pbrr_sched,
+                         .sched_enqueue = pb_sched_enqueue,
+                         .sched_dequeue = pb_sched_dequeue,
+                         .sched_top = pb_top};
+
+/*
+ * Only the periodic tick keeps a preempted thread at the head of its queue,
+ * a thread giving up the CPU still goes to the end.
+ */
+struct sched_ops pbfifo = {.sched_init = pb_sched_init,
+                           .sched = pbrr_sched,
+                           .sched_periodic = pbfifo_sched,
+                           .sched_enqueue = pb_sched_enqueue,
+                           .sched_dequeue = pb_sched_dequeue,
+                           .sched_top = pb_top};
@@ -15,6 +15,8 @@
 #include <machine.h>
 #include <mm/kmalloc.h>
 #include <object/thread.h>
+#include <irq/timer.h>
+#include <arch/sync.h>
 #include <runtime/tests.h>
 
 /*
@@ -42,6 +44,18 @@ struct queue_meta {
 /* rr_ready_queue: Per-CPU ready queue for ready tasks. */
 struct queue_meta rr_ready_queue_meta[PLAT_CPU_NUM];
 
+/* Load balancing statistics, each entry is only updated by its own CPU. */
+struct rr_balance_stats {
+        /* Threads pulled from a remote ready queue instead of idling */
+        unsigned long nr_steals;
+        /* Steal attempts given up because the remote queue was locked */
+        unsigned long nr_steal_contended;
+        /* Threads placed on a remote ready queue at enqueue time */
+        unsigned long nr_migrations;
+};
+
+struct rr_balance_stats rr_balance_stats[PLAT_CPU_NUM];
+
 int __rr_sched_enqueue(struct thread *thread, int cpuid)
 {
         if (thread->thread_ctx->type == TYPE_IDLE) {
@@ -96,6 +110,8 @@ unsigned int rr_sched_choose_cpu(void)
                 }
         }
 
+        if (cpuid != local_cpuid)
+                rr_balance_stats[local_cpuid].nr_migrations++;
         return cpuid;
 }
 
@@ -129,6 +145,14 @@ int rr_sched_enqueue(struct thread *thread)
         lock(&(rr_ready_queue_meta[cpuid].queue_lock));
         ret = __rr_sched_enqueue(thread, cpuid);
         unlock(&(rr_ready_queue_meta[cpuid].queue_lock));
+
+        /*
+         * Make the enqueue visible before checking whether the target CPU
+         * has stopped its tick, pairs with get_next_tick_delta().
+         */
+        smp_mb();
+        if (ret == 0)
+                timer_kick_cpu(cpuid);
         return ret;
 }
 
@@ -174,6 +198,55 @@ int rr_sched_dequeue(struct thread *thread)
         return ret;
 }
 
+/*
+ * Work stealing: called when the ready queue of @cpuid is empty, pull one
+ * thread from the longest remote ready queue instead of running the idle
+ * thread. Only threads without affinity whose kernel stack is free can
+ * move. The remote queue is only try-locked so that idle CPUs never
+ * contend with a busy one.
+ */
+struct thread *rr_sched_steal(unsigned int cpuid)
+{
+        struct queue_meta *victim = NULL;
+        struct thread *thread;
+        unsigned int i, max_len = 0;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                if (i == cpuid)
+                        continue;
+                if (rr_ready_queue_meta[i].queue_len > max_len) {
+                        max_len = rr_ready_queue_meta[i].queue_len;
+                        victim = &rr_ready_queue_meta[i];
+                }
+        }
+
+        if (victim == NULL)
+                return NULL;
+
+        if (try_lock(&victim->queue_lock) != 0) {
+                rr_balance_stats[cpuid].nr_steal_contended++;
+                return NULL;
+        }
+
+        for_each_in_list (
+                thread, struct thread, ready_queue_node, &victim->queue_head) {
+                if (get_cpubind(thread) != NO_AFF
+                    || thread->thread_ctx->is_suspended
+                    || thread->thread_ctx->kernel_stack_state != KS_FREE
+                    || thread_is_exiting(thread) || thread_is_exited(thread))
+                        continue;
+
+                BUG_ON(__rr_sched_dequeue(thread));
+                thread->thread_ctx->cpuid = cpuid;
+                unlock(&victim->queue_lock);
+                rr_balance_stats[cpuid].nr_steals++;
+                return thread;
+        }
+
+        unlock(&victim->queue_lock);
+        return NULL;
+}
+
 /*
  * Choose an appropriate thread and dequeue from ready queue
  */
@@ -210,9 +283,35 @@ struct thread *rr_sched_choose_thread(void)
                 return thread;
         }
 out:
+        thread = rr_sched_steal(cpuid);
+        if (thread)
+                return thread;
+
         return &idle_threads[cpuid];
 }
 
+/*
+ * The periodic tick of @cpuid is needed to slice time between ready
+ * threads and, when the CPU is idle, to keep stealing from remote queues.
+ */
+bool rr_sched_tick_needed(unsigned int cpuid)
+{
+        unsigned int i;
+
+        if (!list_empty(&(rr_ready_queue_meta[cpuid].queue_head)))
+                return true;
+
+        if (current_thread->thread_ctx->type != TYPE_IDLE)
+                return false;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                if (i != cpuid && rr_ready_queue_meta[i].queue_len != 0)
+                        return true;
+        }
+
+        return false;
+}
+
 static inline void rr_sched_refill_budget(struct thread *target,
                                           unsigned int budget)
 {
@@ -314,6 +413,11 @@ void rr_top(void)
                 printk("== CPU %d RQ LEN %lu==\n",
                        cpuid,
                        rr_ready_queue_meta[cpuid].queue_len);
+                printk("steals %lu (contended %lu) migrations %lu\n",
+                       rr_balance_stats[cpuid].nr_steals,
+                       rr_balance_stats[cpuid].nr_steal_contended,
+                       rr_balance_stats[cpuid].nr_migrations);
+                printk("ticks avoided %lu\n", timer_get_ticks_avoided(cpuid));
                 thread = current_threads[cpuid];
                 if (thread != NULL) {
                         for (i = 0; i < cap_group_num; i++)
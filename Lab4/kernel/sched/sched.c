@@ -367,6 +367,22 @@ void add_pending_resched(unsigned int cpuid)
         resched_bitmaps[smp_get_cpu_id()] |= BIT(cpuid);
 }
 
+/*
+ * The periodic tick only drives time slicing, so a CPU running the idle
+ * thread or its only runnable thread can stop it.
+ */
+bool sched_tick_needed(void)
+{
+        if (current_thread == NULL)
+                return true;
+
+        if (cur_sched_ops == &rr)
+                return rr_sched_tick_needed(smp_get_cpu_id());
+        if (cur_sched_ops == &pbrr || cur_sched_ops == &pbfifo)
+                return pb_sched_tick_needed(smp_get_cpu_id());
+        return true;
+}
+
 void wait_for_kernel_stack(struct thread *thread)
 {
         /*
@@ -18,4 +18,8 @@ TEST_SUITE(lab4, test_sched_enqueue, struct thread *root_thread);
 TEST_SUITE(lab4, test_sched_dequeue, void);
 TEST_SUITE(lab4, test_scheduler_meta, void);
 TEST_SUITE(lab4, test_timer_init, void);
+
+void run_test(void);
+void tst_sched(void);
+void tst_timer(void);
 #endif /* KERNEL_TESTS_RUNTIME_TESTS_H */
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <mm/kmalloc.h>
+#include <object/object.h>
+#include <object/thread.h>
+#include <sched/context.h>
+#include <sched/sched.h>
+#include <sched/policy_pb.h>
+#include <arch/machine/smp.h>
+#include <arch/machine/pmu.h>
+
+#include "tests.h"
+
+/* Ready threads in each benchmark phase */
+#define SCHED_BENCH_SHORT 16
+#define SCHED_BENCH_LONG  4096
+#define SCHED_BENCH_ROUND 4096
+/*
+ * Half of the threads take turns at this priority, the others are spread
+ * over the lower ones so that most of the priority bitmap is in use.
+ */
+#define SCHED_BENCH_PRIO (MAX_PRIO - 1)
+
+static struct thread *sched_bench_alloc(unsigned int prio, unsigned int cpuid)
+{
+        struct thread *thread;
+
+        thread = obj_alloc(TYPE_THREAD, sizeof(*thread));
+        BUG_ON(!thread);
+        thread->thread_ctx = create_thread_ctx(TYPE_TESTS);
+        BUG_ON(!thread->thread_ctx);
+        init_thread_ctx(thread, 0, 0, prio, TYPE_TESTS, cpuid);
+        return thread;
+}
+
+static void sched_bench_free(struct thread *thread)
+{
+        destroy_thread_ctx(thread);
+        kfree(container_of(thread, struct object, opaque));
+}
+
+/*
+ * Time pbrr picks on a private ready queue holding @nr_threads threads.
+ * Like __pb_sched(), every pick puts the previous thread back, so the queue
+ * length stays constant during the measurement. The queue is not the one
+ * of any CPU, so the scheduler in use is left alone.
+ */
+static u64 sched_bench_run(unsigned int nr_threads)
+{
+        unsigned int cpuid = smp_get_cpu_id();
+        struct pb_ready_queue *ready_queue;
+        struct thread **threads;
+        struct thread *old, *new;
+        unsigned int i, prio;
+        u64 start, cycles;
+
+        ready_queue = kmalloc(sizeof(*ready_queue));
+        threads = kmalloc(sizeof(*threads) * nr_threads);
+        BUG_ON(!ready_queue || !threads);
+        pb_ready_queue_init(ready_queue);
+
+        lock(&ready_queue->queue_lock);
+        for (i = 0; i < nr_threads; i++) {
+                prio = i % 2 == 0 ? SCHED_BENCH_PRIO :
+                                    i % (SCHED_BENCH_PRIO - 1) + 1;
+                threads[i] = sched_bench_alloc(prio, cpuid);
+                pb_ready_queue_insert(ready_queue, threads[i], false);
+        }
+
+        /* The first pick has no previous thread to give up the CPU */
+        old = pb_sched_choose_thread(ready_queue, cpuid, NULL, false);
+        BUG_ON(old->thread_ctx->type != TYPE_TESTS);
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < SCHED_BENCH_ROUND; i++) {
+                old->thread_ctx->sc->budget = 0;
+                new = pb_sched_choose_thread(ready_queue, cpuid, old, false);
+                BUG_ON(new == old || new->thread_ctx->type != TYPE_TESTS);
+                pb_ready_queue_insert(ready_queue, old, false);
+                old = new;
+        }
+        cycles = pmu_read_real_cycle() - start;
+
+        /* The last picked thread is not in the ready queue */
+        for (i = 0; i < nr_threads; i++) {
+                if (threads[i] != old)
+                        pb_ready_queue_remove(ready_queue, threads[i]);
+                sched_bench_free(threads[i]);
+        }
+        unlock(&ready_queue->queue_lock);
+        kfree(threads);
+        kfree(ready_queue);
+
+        return cycles / SCHED_BENCH_ROUND;
+}
+
+/*
+ * Compare the cost of a scheduling decision of pbrr with a short and a long
+ * ready queue, which should not depend on the queue length.
+ */
+void tst_sched(void)
+{
+        u64 short_cycles, long_cycles;
+
+        /* One CPU is enough to time the picks */
+        if (smp_get_cpu_id() != 0)
+                return;
+
+        short_cycles = sched_bench_run(SCHED_BENCH_SHORT);
+        long_cycles = sched_bench_run(SCHED_BENCH_LONG);
+
+        kinfo("[TEST] pbrr: %ld cycles per pick with %d ready threads, "
+              "%ld cycles with %d\n",
+              short_cycles,
+              SCHED_BENCH_SHORT,
+              long_cycles,
+              SCHED_BENCH_LONG);
+        kinfo("[TEST] sched bench succ!\n");
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <common/lock.h>
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <mm/kmalloc.h>
+#include <object/thread.h>
+#include <irq/timer.h>
+#include <arch/machine/pmu.h>
+
+#include "tests.h"
+
+/* Timed waiters, half of them are cancelled before expiring */
+#define TIMER_STRESS_WAITERS 32768
+#define TIMER_STRESS_MAX_US  20000
+/* Extra time allowed for the last waiter to expire */
+#define TIMER_STRESS_SLACK_US 10000
+
+static u64 timer_stress_fired;
+
+static void timer_stress_cb(struct thread *thread)
+{
+        /* A waiter must never expire early */
+        BUG_ON(plat_get_current_tick() < thread->sleep_state.wakeup_tick);
+        timer_stress_fired++;
+}
+
+/*
+ * Enqueue TIMER_STRESS_WAITERS timed waiters with spread timeouts, cancel
+ * every other one and then expire the rest by driving the timer irq
+ * handler. Cancelled waiters have no callback and would hit a BUG_ON in
+ * handle_timer_irq if they ever expired.
+ */
+void tst_timer(void)
+{
+        struct thread *threads;
+        struct timespec timeout;
+        u64 start, insert_cycles, cancel_cycles, deadline;
+        u64 expected = TIMER_STRESS_WAITERS / 2;
+        int i;
+
+        threads = kzalloc(sizeof(*threads) * TIMER_STRESS_WAITERS);
+        BUG_ON(!threads);
+        for (i = 0; i < TIMER_STRESS_WAITERS; i++)
+                lock_init(&threads[i].sleep_state.queue_lock);
+        timer_stress_fired = 0;
+
+        start = pmu_read_real_cycle();
+        for (i = 0; i < TIMER_STRESS_WAITERS; i++) {
+                timeout.tv_sec = 0;
+                timeout.tv_nsec =
+                        ((i * 7919UL) % TIMER_STRESS_MAX_US + 1) * NS_IN_US;
+                lock(&threads[i].sleep_state.queue_lock);
+                BUG_ON(enqueue_sleeper(&threads[i], &timeout, timer_stress_cb));
+                unlock(&threads[i].sleep_state.queue_lock);
+        }
+        insert_cycles = pmu_read_real_cycle() - start;
+
+        start = pmu_read_real_cycle();
+        for (i = 1; i < TIMER_STRESS_WAITERS; i += 2) {
+                lock(&threads[i].sleep_state.queue_lock);
+                BUG_ON(!try_dequeue_sleeper(&threads[i]));
+                unlock(&threads[i].sleep_state.queue_lock);
+        }
+        cancel_cycles = pmu_read_real_cycle() - start;
+
+        deadline = plat_get_current_tick()
+                   + (TIMER_STRESS_MAX_US + TIMER_STRESS_SLACK_US)
+                             * tick_per_us;
+        while (timer_stress_fired != expected) {
+                BUG_ON(plat_get_current_tick() > deadline);
+                handle_timer_irq();
+        }
+
+        kfree(threads);
+        kinfo("[TEST] %d timed waiters: %ld cycles per insert, "
+              "%ld cycles per cancel\n",
+              TIMER_STRESS_WAITERS,
+              insert_cycles / TIMER_STRESS_WAITERS,
+              cancel_cycles / (TIMER_STRESS_WAITERS / 2));
+        kinfo("[TEST] timer stress succ!\n");
+}
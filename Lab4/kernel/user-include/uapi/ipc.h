@@ -55,6 +55,18 @@ struct ipc_response_hdr {
  */
 typedef void (*server_handler)(void *shm_ptr, unsigned int max_data_len, unsigned int send_cap_num, badge_t client_badge);
 
+/* Number of words carried by registers in a short IPC request. */
+#define IPC_SHORT_MSG_WORDS 3
+
+/**
+ * @brief This type specifies the function signature of the routine serving
+ * short IPC requests, which carry no shared memory or capabilities.
+ * 
+ * @param w0-w2: the words sent by client.
+ * @param client_badge: badge of client.
+ */
+typedef void (*short_server_handler)(unsigned long w0, unsigned long w1, unsigned long w2, badge_t client_badge);
+
 #ifdef CHCORE_OPENTRUSTEE
 #define PID_OFFSET 16U
 #define PID_MASK   ((0x1 << PID_OFFSET) - 1)
@@ -62,6 +62,8 @@
 #define CHCORE_SYS_ipc_exit_routine_return 31
 #define CHCORE_SYS_ipc_get_cap             32
 #define CHCORE_SYS_ipc_set_cap             33
+#define CHCORE_SYS_ipc_call_short          62
+#define CHCORE_SYS_ipc_register_short      63
 /* - notification */
 #define CHCORE_SYS_create_notifc           34
 #define CHCORE_SYS_wait                    35
@@ -32,6 +32,12 @@ enum system_server_identifier {
         PROC_MANAGER,
 };
 
+/*
+ * Size of the ipc_msg_t preallocated in each ipc_struct, checked at compile
+ * time in chcore-port/ipc.c like SERVER_IPC_MSG_BUF_SIZE.
+ */
+#define CLIENT_IPC_MSG_BUF_SIZE (64)
+
 /*
  * ipc_struct is created in **ipc_register_client** and
  * thus only used at client side.
@@ -46,8 +52,22 @@ typedef struct ipc_struct {
         /* A spin lock: used to coordinate the access to shared memory */
         volatile int lock;
         enum system_server_identifier server_id;
+
+        /*
+         * Lanes of an ipc_struct created by **ipc_register_client_pool**.
+         * Each lane is a connection with its own shm and server handler
+         * thread, and a message is built on whichever lane is free.
+         */
+        struct ipc_struct *lanes;
+        int nr_lanes;
+
+        /* The ipc_msg_t returned by ipc_create_msg (protected by lock) */
+        char msg_buf[CLIENT_IPC_MSG_BUF_SIZE]
+                __attribute__((aligned(sizeof(void *))));
 } ipc_struct_t;
 
+#define IPC_MAX_LANES 16
+
 extern cap_t fsm_server_cap;
 extern cap_t lwip_server_cap;
 extern cap_t procmgr_server_cap;
@@ -142,10 +162,28 @@ void name(void *shm_ptr, unsigned int max_data_len, unsigned int cap_num, unsign
 static void __##name(ipc_msg_t *ipc_msg, pid_t pid, cap_t tid)
 #endif /* CHCORE_OPENTRUSTEE */
 
+/*
+ * A short handler receives the words of ipc_call_short in registers and
+ * must finish with ipc_return_short.
+ */
+#ifdef CHCORE_ARCH_X86_64
+#define DEFINE_SHORT_SERVER_HANDLER(name) \
+__attribute__((visibility("hidden"))) void _##name(unsigned long w0, unsigned long w1, unsigned long w2, badge_t client_badge); \
+__attribute__((naked)) void name(unsigned long w0, unsigned long w1, unsigned long w2, badge_t badge) { \
+        __asm__ volatile("mov %%r10, %%rcx \n" \
+                         "jmp _" #name:::"rcx"); \
+} \
+__attribute__((visibility("hidden"))) void _##name(unsigned long w0, unsigned long w1, unsigned long w2, badge_t client_badge)
+#else
+#define DEFINE_SHORT_SERVER_HANDLER(name) \
+void name(unsigned long w0, unsigned long w1, unsigned long w2, badge_t client_badge)
+#endif
+
 typedef void (*server_destructor)(badge_t);
 
 /* Registeration interfaces */
 ipc_struct_t *ipc_register_client(cap_t server_thread_cap);
+ipc_struct_t *ipc_register_client_pool(cap_t server_thread_cap, int nr_lanes);
 
 void *register_cb(void *ipc_handler);
 void *register_cb_single(void *ipc_handler);
@@ -158,6 +196,10 @@ int ipc_register_server(server_handler server_handler,
 int ipc_register_server_with_destructor(server_handler server_handler,
                                         void *(*client_register_handler)(void *),
                                         server_destructor server_destructor);
+int ipc_register_server_with_short(server_handler server_handler,
+                                   short_server_handler short_handler,
+                                   void *(*client_register_handler)(void *),
+                                   server_destructor server_destructor);
 
 /* IPC message operating interfaces */
 ipc_msg_t *ipc_create_msg(ipc_struct_t *icb, unsigned int data_len);
@@ -172,12 +214,16 @@ unsigned int ipc_get_msg_send_cap_num(ipc_msg_t *ipc_msg);
 void ipc_set_msg_send_cap_num(ipc_msg_t *ipc_msg, unsigned int cap_num);
 unsigned int ipc_get_msg_return_cap_num(ipc_msg_t *ipc_msg);
 void ipc_set_msg_return_cap_num(ipc_msg_t *ipc_msg, unsigned int cap_num);
+/* The ipc_msg must not be used after it is destroyed (see chcore-port/ipc.c) */
 int ipc_destroy_msg(ipc_msg_t *ipc_msg);
 
 /* IPC issue/finish interfaces */
 long ipc_call(ipc_struct_t *icb, ipc_msg_t *ipc_msg);
 _Noreturn void ipc_return(ipc_msg_t *ipc_msg, long ret);
 _Noreturn void ipc_return_with_cap(ipc_msg_t *ipc_msg, long ret);
+long ipc_call_short(ipc_struct_t *icb, unsigned long w0, unsigned long w1,
+                    unsigned long w2);
+_Noreturn void ipc_return_short(long ret);
 int ipc_client_close_connection(ipc_struct_t *ipc_struct);
 
 int simple_ipc_forward(ipc_struct_t *ipc_struct, void *data, int len);
@@ -60,10 +60,13 @@ int usys_register_server(unsigned long ipc_handler,
                                    unsigned long destructor);
 cap_t usys_register_client(cap_t server_cap, unsigned long vm_config_ptr);
 long usys_ipc_call(cap_t conn_cap, unsigned int cap_num);
+long usys_ipc_call_short(cap_t conn_cap, unsigned long w0, unsigned long w1,
+                         unsigned long w2);
 _Noreturn void usys_ipc_return(unsigned long ret, unsigned long cap_num);
 void usys_ipc_register_cb_return(cap_t server_thread_cap,
                                  unsigned long server_thread_exit_routine,
                                  unsigned long server_shm_addr);
+int usys_ipc_register_short(cap_t register_cb_cap, unsigned long short_handler);
 _Noreturn void usys_ipc_exit_routine_return(void);
 cap_t usys_ipc_get_cap(cap_t conn, int index);
 int usys_ipc_set_cap(cap_t conn, int index, cap_t cap);
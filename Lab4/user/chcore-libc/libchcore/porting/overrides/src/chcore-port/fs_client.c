@@ -30,53 +30,53 @@ int cwd_len;
 
 /* For client side mounted fs metadata */
 cap_t mounted_fs_cap[MAX_MOUNT_ID] = {-1};
-pthread_key_t mounted_fs_key;
+
+/*
+ * One connection per mounted fs is shared by all threads. It is a pool of
+ * FS_CLIENT_IPC_LANES lanes, so the fs server serves up to that many
+ * threads of this process in parallel, and the handler threads it creates
+ * for us do not grow with (or leak on exit of) our threads.
+ */
+static ipc_struct_t *mounted_fs_ipc_struct[MAX_MOUNT_ID];
+static pthread_mutex_t mounted_fs_lock = PTHREAD_MUTEX_INITIALIZER;
 
 ipc_struct_t *get_ipc_struct_by_mount_id(int mount_id)
 {
-        ipc_struct_t **mounted_fs_ipc_struct;
         ipc_struct_t *res;
 
-        /* Get thread local  */
-        mounted_fs_ipc_struct = pthread_getspecific(mounted_fs_key);
-        if (!mounted_fs_ipc_struct) {
-                mounted_fs_ipc_struct =
-                        calloc(1, MAX_MOUNT_ID * sizeof(ipc_struct_t *));
-                BUG_ON(!mounted_fs_ipc_struct);
-                pthread_setspecific(mounted_fs_key, mounted_fs_ipc_struct);
-        }
-
-        /* Find thread local ipc struct, register one if it's not existed */
-        if (!mounted_fs_ipc_struct[mount_id]) {
-                mounted_fs_ipc_struct[mount_id] =
-                        ipc_register_client(mounted_fs_cap[mount_id]);
-                BUG_ON(!mounted_fs_ipc_struct[mount_id]);
-        }
+        res = __atomic_load_n(&mounted_fs_ipc_struct[mount_id],
+                              __ATOMIC_ACQUIRE);
+        if (res)
+                return res;
 
+        /* Register the pool on first use */
+        pthread_mutex_lock(&mounted_fs_lock);
         res = mounted_fs_ipc_struct[mount_id];
+        if (!res) {
+                res = ipc_register_client_pool(mounted_fs_cap[mount_id],
+                                               FS_CLIENT_IPC_LANES);
+                BUG_ON(!res);
+                __atomic_store_n(&mounted_fs_ipc_struct[mount_id],
+                                 res,
+                                 __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&mounted_fs_lock);
 
-        /* Do sanity check here. */
-        BUG_ON(!res);
         return res;
 }
 
 void disconnect_mounted_fs(void)
 {
         int i;
-        ipc_struct_t **mounted_fs_ipc_struct;
-        /* Get thread local  */
-        mounted_fs_ipc_struct = pthread_getspecific(mounted_fs_key);
-        if (!mounted_fs_ipc_struct) {
-                return;
-        }
 
+        pthread_mutex_lock(&mounted_fs_lock);
         for (i = 0; i < MAX_MOUNT_ID; i++) {
                 if (mounted_fs_ipc_struct[i]) {
                         ipc_client_close_connection(mounted_fs_ipc_struct[i]);
+                        mounted_fs_ipc_struct[i] = NULL;
                 }
         }
-
-        free(mounted_fs_ipc_struct);
+        pthread_mutex_unlock(&mounted_fs_lock);
 }
 
 /*
@@ -231,8 +231,7 @@ struct fsm_request *fsm_parse_path_forward(ipc_msg_t *ipc_msg,
 
         assert(mounted_fs_cap[mount_id] > 0);
 
-        /* Call this for initialize tls ipc data, and we don't need return value
-         */
+        /* Connect to the fs now, and we don't need return value */
         get_ipc_struct_by_mount_id(mount_id);
 
         return fsm_req;
@@ -242,8 +241,6 @@ struct fsm_request *fsm_parse_path_forward(ipc_msg_t *ipc_msg,
 
 void init_fs_client_side(void)
 {
-        pthread_key_create(&mounted_fs_key, NULL);
-
         /* Initialize cwd as ROOT */
         cwd_path[0] = '/';
         cwd_path[1] = '\0';
@@ -37,8 +37,9 @@ extern int cwd_len;
 /* ++++++++++++++++++++++++ Client IPC Pool +++++++++++++++++++++++++++++++ */
 
 #define MAX_MOUNT_ID 32
+/* Lanes of the connection shared by all threads to one mounted fs */
+#define FS_CLIENT_IPC_LANES 4
 extern cap_t mounted_fs_cap[MAX_MOUNT_ID];
-extern pthread_key_t mounted_fs_key;
 
 ipc_struct_t *get_ipc_struct_by_mount_id(int mount_id);
 void disconnect_mounted_fs(void);
@@ -83,10 +83,38 @@ ipc_struct_t *__procmgr_ipc_struct_location(void)
 }
 
 static int connect_system_server(ipc_struct_t *ipc_struct);
+static void ipc_struct_copy(ipc_struct_t *dst, ipc_struct_t *src);
 static int disconnect_system_servers();
 
 /* Interfaces for operate the ipc message (begin here) */
 
+/*
+ * Grab a lane of @icb with its lock held. Start from a per-thread lane so
+ * that threads sharing the icb spread over the lanes, and only wait when
+ * all of them are busy.
+ */
+static ipc_struct_t *ipc_lock_lane(ipc_struct_t *icb)
+{
+        ipc_struct_t *lane;
+        int i, start;
+
+        if (icb->nr_lanes == 0) {
+                chcore_spin_lock(&(icb->lock));
+                return icb;
+        }
+
+        start = (unsigned int)__pthread_self()->tid % icb->nr_lanes;
+        for (i = 0; i < icb->nr_lanes; i++) {
+                lane = &icb->lanes[(start + i) % icb->nr_lanes];
+                if (chcore_spin_trylock(&(lane->lock)) == 0)
+                        return lane;
+        }
+
+        lane = &icb->lanes[start];
+        chcore_spin_lock(&(lane->lock));
+        return lane;
+}
+
 ipc_msg_t *ipc_create_msg(ipc_struct_t *icb, unsigned int data_len)
 {
         return ipc_create_msg_with_cap(icb, data_len, 0);
@@ -95,11 +123,18 @@ ipc_msg_t *ipc_create_msg(ipc_struct_t *icb, unsigned int data_len)
  * ipc_msg_t is constructed on the shm pointed by
  * ipc_struct_t->shared_buf.
  * A new ips_msg will override the old one.
+ *
+ * The ipc_msg_t itself lives in ipc_struct_t->msg_buf instead of being
+ * malloc-ed. The ipc lock is held from here to ipc_destroy_msg, so the
+ * msg_buf of an ipc_struct holds one message at a time, just as its shm
+ * does. What changes for callers is only what a stale ipc_msg points to
+ * after ipc_destroy_msg: the next message rather than freed memory.
  */
 ipc_msg_t *ipc_create_msg_with_cap(ipc_struct_t *icb, unsigned int data_len,
                           unsigned int send_cap_num)
 {
         BUILD_BUG_ON(sizeof(ipc_msg_t) > SERVER_IPC_MSG_BUF_SIZE);
+        BUILD_BUG_ON(sizeof(ipc_msg_t) > CLIENT_IPC_MSG_BUF_SIZE);
         ipc_msg_t *ipc_msg;
         unsigned long buf_len;
 
@@ -111,8 +146,11 @@ ipc_msg_t *ipc_create_msg_with_cap(ipc_struct_t *icb, unsigned int data_len,
                 }
         }
 
-        /* Grab the ipc lock before setting ipc msg */
-        chcore_spin_lock(&(icb->lock));
+        /*
+         * Grab the ipc lock before setting ipc msg.
+         * The msg is then bound to the lane (if any) it is built on.
+         */
+        icb = ipc_lock_lane(icb);
 
         buf_len = icb->shared_buf_len;
 
@@ -130,19 +168,14 @@ ipc_msg_t *ipc_create_msg_with_cap(ipc_struct_t *icb, unsigned int data_len,
                 goto out_unlock;
         }
 
-        ipc_msg = (ipc_msg_t *)malloc(sizeof(ipc_msg_t));
-
-        if (!ipc_msg) {
-                goto out_unlock;
-        }
-
+        ipc_msg = (ipc_msg_t *)icb->msg_buf;
         ipc_msg->data_ptr = SHM_PTR_TO_CUSTOM_DATA_PTR(icb->shared_buf);
         ipc_msg->max_data_len = buf_len;
         ipc_msg->send_cap_num = send_cap_num;
         ipc_msg->response_hdr = (struct ipc_response_hdr *)icb->shared_buf;
         ipc_msg->icb = icb;
         ipc_msg->thread_type = THREAD_CLIENT;
-                  
+
         return ipc_msg;
 out_unlock:
         chcore_spin_unlock(&(icb->lock));
@@ -254,10 +287,13 @@ void ipc_set_msg_return_cap_num(ipc_msg_t *ipc_msg, unsigned int cap_num)
 
 int ipc_destroy_msg(ipc_msg_t *ipc_msg)
 {
-        /* Release the ipc lock */
-        chcore_spin_unlock(&(ipc_msg->icb->lock));
+        ipc_struct_t *icb = ipc_msg->icb;
+
+        /* Make a use after destroy fault instead of reading the next msg */
+        ipc_msg->icb = NULL;
 
-        free(ipc_msg);
+        /* Release the ipc lock (and the msg_buf holding ipc_msg) */
+        chcore_spin_unlock(&(icb->lock));
 
         return 0;
 }
@@ -410,6 +446,22 @@ int ipc_register_server(server_handler server_handler,
 int ipc_register_server_with_destructor(server_handler server_handler,
                                         void *(*client_register_handler)(void *),
                                         server_destructor server_destructor)
+{
+        return ipc_register_server_with_short(server_handler,
+                                              NULL,
+                                              client_register_handler,
+                                              server_destructor);
+}
+
+/*
+ * Besides @server_handler, the server also serves ipc_call_short with
+ * @short_handler (if not NULL). Only clients registered after this
+ * returns get the short path, so announce the service afterwards.
+ */
+int ipc_register_server_with_short(server_handler server_handler,
+                                   short_server_handler short_handler,
+                                   void *(*client_register_handler)(void *),
+                                   server_destructor server_destructor)
 {
         cap_t register_cb_thread_cap;
         int ret;
@@ -436,6 +488,19 @@ int ipc_register_server_with_destructor(server_handler server_handler,
                                    (unsigned long)server_destructor);
         if (ret != 0) {
                 printf("%s failed (retval is %d)\n", __func__, ret);
+                return ret;
+        }
+
+        /* Handler threads created on client registration inherit it */
+        if (short_handler) {
+                ret = usys_ipc_register_short(register_cb_thread_cap,
+                                              (unsigned long)short_handler);
+                if (ret != 0) {
+                        printf("%s failed to register short handler "
+                               "(retval is %d)\n",
+                               __func__,
+                               ret);
+                }
         }
         return ret;
 }
@@ -514,6 +579,8 @@ ipc_struct_t *ipc_register_client(cap_t server_thread_cap)
         client_ipc_struct->shared_buf = shm_config.shm_addr;
         client_ipc_struct->shared_buf_len = IPC_PER_SHM_SIZE;
         client_ipc_struct->conn_cap = conn_cap;
+        client_ipc_struct->lanes = NULL;
+        client_ipc_struct->nr_lanes = 0;
 
         return client_ipc_struct;
 
@@ -527,9 +594,80 @@ out_free_client_ipc_struct:
         return NULL;
 }
 
+/*
+ * Connect to the server @nr_lanes times and bundle the connections as the
+ * lanes of one ipc_struct_t. The server serves each lane with a different
+ * handler thread (unless it uses register_cb_single), so client threads
+ * sharing the returned ipc_struct_t are served in parallel.
+ */
+ipc_struct_t *ipc_register_client_pool(cap_t server_thread_cap, int nr_lanes)
+{
+        ipc_struct_t *client_ipc_struct, *lane;
+        int i;
+
+        if (nr_lanes <= 0 || nr_lanes > IPC_MAX_LANES)
+                return NULL;
+
+        client_ipc_struct = calloc(1, sizeof(ipc_struct_t));
+        if (client_ipc_struct == NULL)
+                return NULL;
+
+        client_ipc_struct->lanes = calloc(nr_lanes, sizeof(ipc_struct_t));
+        if (client_ipc_struct->lanes == NULL)
+                goto out_free_client_ipc_struct;
+
+        for (i = 0; i < nr_lanes; i++) {
+                lane = ipc_register_client(server_thread_cap);
+                if (lane == NULL)
+                        goto out_close_lanes;
+                ipc_struct_copy(&client_ipc_struct->lanes[i], lane);
+                free(lane);
+                client_ipc_struct->nr_lanes++;
+        }
+
+        /* Not 0, so that no on-demand connection is made for the icb */
+        client_ipc_struct->conn_cap = client_ipc_struct->lanes[0].conn_cap;
+
+        return client_ipc_struct;
+
+out_close_lanes:
+        ipc_client_close_connection(client_ipc_struct);
+        return NULL;
+
+out_free_client_ipc_struct:
+        free(client_ipc_struct);
+        return NULL;
+}
+
+static int ipc_close_lanes(ipc_struct_t *ipc_struct)
+{
+        ipc_struct_t *lane;
+        int ret;
+
+        while (ipc_struct->nr_lanes > 0) {
+                lane = &ipc_struct->lanes[ipc_struct->nr_lanes - 1];
+                while ((ret = usys_ipc_close_connection(lane->conn_cap))
+                       == -EAGAIN) {
+                        usys_yield();
+                }
+                if (ret < 0)
+                        return ret;
+                chcore_free_vaddr(lane->shared_buf, lane->shared_buf_len);
+                ipc_struct->nr_lanes--;
+        }
+
+        free(ipc_struct->lanes);
+        free(ipc_struct);
+        return 0;
+}
+
 int ipc_client_close_connection(ipc_struct_t *ipc_struct)
 {
         int ret;
+
+        if (ipc_struct->lanes)
+                return ipc_close_lanes(ipc_struct);
+
         while (1) {
                 ret = usys_ipc_close_connection(ipc_struct->conn_cap);
 
@@ -559,6 +697,9 @@ long ipc_call(ipc_struct_t *icb, ipc_msg_t *ipc_msg)
                         return ret;
         }
 
+        /* The msg has been bound to a lane of the icb */
+        icb = ipc_msg->icb;
+
         do {
                 ret = usys_ipc_call(icb->conn_cap, 
                                     ipc_get_msg_send_cap_num(ipc_msg));
@@ -587,6 +728,46 @@ void ipc_return_with_cap(ipc_msg_t *ipc_msg, long ret)
         usys_ipc_return((unsigned long)ret, ipc_get_msg_return_cap_num(ipc_msg));
 }
 
+/*
+ * Client uses **ipc_call_short** to issue a request which fits in
+ * IPC_SHORT_MSG_WORDS words. Neither the shm nor the icb lock is touched.
+ * Returns -EINVAL if the server has no short handler.
+ */
+long ipc_call_short(ipc_struct_t *icb, unsigned long w0, unsigned long w1,
+                    unsigned long w2)
+{
+        long ret;
+        int lane;
+
+        if (unlikely(icb->conn_cap == 0)) {
+                if ((ret = connect_system_server(icb)) != 0)
+                        return ret;
+        }
+
+        if (icb->nr_lanes == 0) {
+                do {
+                        ret = usys_ipc_call_short(icb->conn_cap, w0, w1, w2);
+                } while (ret == -EIPCRETRY);
+                return ret;
+        }
+
+        /* Move on to the next lane while the handler of one is busy */
+        lane = (unsigned int)__pthread_self()->tid % icb->nr_lanes;
+        while ((ret = usys_ipc_call_short(
+                        icb->lanes[lane].conn_cap, w0, w1, w2))
+               == -EIPCRETRY) {
+                lane = (lane + 1) % icb->nr_lanes;
+        }
+
+        return ret;
+}
+
+/* Short handler uses **ipc_return_short** to finish a short request */
+void ipc_return_short(long ret)
+{
+        usys_ipc_return((unsigned long)ret, 0);
+}
+
 int simple_ipc_forward(ipc_struct_t *ipc_struct, void *data, int len)
 {
         ipc_msg_t *ipc_msg;
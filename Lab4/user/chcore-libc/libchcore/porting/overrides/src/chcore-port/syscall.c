@@ -159,6 +159,12 @@ long usys_ipc_call(cap_t conn_cap, unsigned int cap_num)
                 CHCORE_SYS_ipc_call, conn_cap, cap_num);
 }
 
+long usys_ipc_call_short(cap_t conn_cap, unsigned long w0, unsigned long w1,
+                         unsigned long w2)
+{
+        return chcore_syscall4(CHCORE_SYS_ipc_call_short, conn_cap, w0, w1, w2);
+}
+
 _Noreturn void usys_ipc_return(unsigned long ret, unsigned long cap_num)
 {
         chcore_syscall2(CHCORE_SYS_ipc_return, ret, cap_num);
@@ -175,6 +181,12 @@ void usys_ipc_register_cb_return(cap_t server_thread_cap,
                         server_shm_addr);
 }
 
+int usys_ipc_register_short(cap_t register_cb_cap, unsigned long short_handler)
+{
+        return chcore_syscall2(
+                CHCORE_SYS_ipc_register_short, register_cb_cap, short_handler);
+}
+
 _Noreturn void usys_ipc_exit_routine_return(void)
 {
         chcore_syscall0(CHCORE_SYS_ipc_exit_routine_return);
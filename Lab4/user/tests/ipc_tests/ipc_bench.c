@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * IPC round-trip latency: the shm based ipc_call versus the register-only
+ * ipc_call_short, both carrying IPC_SHORT_MSG_WORDS words to a server in
+ * the same process. Then the throughput of client threads sharing one
+ * connection, sharing a pool of lanes, or using per-thread connections.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <chcore/ipc.h>
+#include <chcore/pthread.h>
+#include <chcore/syscall.h>
+
+#define IPC_BENCH_WARMUP 1000
+#define IPC_BENCH_ROUND  100000
+#define IPC_BENCH_THREADS 4
+
+static volatile int ipc_bench_server_ready;
+static cap_t ipc_bench_server_cap;
+
+DEFINE_SERVER_HANDLER(ipc_bench_handler)
+{
+        unsigned long *words = (unsigned long *)ipc_get_msg_data(ipc_msg);
+
+        ipc_return(ipc_msg, words[0] + words[1] + words[2]);
+}
+
+DEFINE_SHORT_SERVER_HANDLER(ipc_bench_short_handler)
+{
+        ipc_return_short(w0 + w1 + w2);
+}
+
+static void *ipc_bench_server(void *arg)
+{
+        int ret;
+
+        ret = ipc_register_server_with_short(ipc_bench_handler,
+                                             ipc_bench_short_handler,
+                                             DEFAULT_CLIENT_REGISTER_HANDLER,
+                                             DEFAULT_DESTRUCTOR);
+        if (ret != 0) {
+                printf("ipc_bench: register server failed %d\n", ret);
+                ipc_bench_server_ready = -1;
+        } else {
+                ipc_bench_server_ready = 1;
+        }
+        return NULL;
+}
+
+static long ipc_bench_call(ipc_struct_t *icb, unsigned long i)
+{
+        unsigned long words[IPC_SHORT_MSG_WORDS] = {i, i + 1, i + 2};
+        ipc_msg_t *ipc_msg;
+        long ret;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(words));
+        ipc_set_msg_data(ipc_msg, words, 0, sizeof(words));
+        ret = ipc_call(icb, ipc_msg);
+        ipc_destroy_msg(ipc_msg);
+
+        return ret;
+}
+
+static long ipc_bench_call_short(ipc_struct_t *icb, unsigned long i)
+{
+        return ipc_call_short(icb, i, i + 1, i + 2);
+}
+
+static unsigned long ipc_bench_now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int ipc_bench_run(const char *name, ipc_struct_t *icb,
+                         long (*call)(ipc_struct_t *, unsigned long))
+{
+        unsigned long i, start = 0, ns;
+        long ret;
+
+        for (i = 0; i < IPC_BENCH_WARMUP + IPC_BENCH_ROUND; i++) {
+                if (i == IPC_BENCH_WARMUP)
+                        start = ipc_bench_now_ns();
+                ret = call(icb, i);
+                if (ret != 3 * i + 3) {
+                        printf("ipc_bench: %s returns %ld for %lu\n",
+                               name,
+                               ret,
+                               i);
+                        return -1;
+                }
+        }
+        ns = ipc_bench_now_ns() - start;
+
+        printf("ipc_bench: %-15s %lu calls in %lu us, %lu ns per round trip\n",
+               name,
+               (unsigned long)IPC_BENCH_ROUND,
+               ns / 1000,
+               ns / IPC_BENCH_ROUND);
+        return 0;
+}
+
+static void *ipc_bench_client(void *arg)
+{
+        ipc_struct_t *icb = arg, *own = NULL;
+        unsigned long i;
+        void *ret = NULL;
+
+        /* No shared icb: connect on behalf of this thread only */
+        if (icb == NULL) {
+                own = icb = ipc_register_client(ipc_bench_server_cap);
+                if (icb == NULL)
+                        return (void *)-1;
+        }
+
+        for (i = 0; i < IPC_BENCH_ROUND / IPC_BENCH_THREADS; i++) {
+                if (ipc_bench_call(icb, i) != 3 * i + 3) {
+                        ret = (void *)-1;
+                        break;
+                }
+        }
+
+        if (own)
+                ipc_client_close_connection(own);
+        return ret;
+}
+
+static int ipc_bench_run_parallel(const char *name, ipc_struct_t *icb)
+{
+        pthread_t clients[IPC_BENCH_THREADS];
+        unsigned long start, ns;
+        void *ret;
+        int i, err = 0;
+
+        start = ipc_bench_now_ns();
+        for (i = 0; i < IPC_BENCH_THREADS; i++)
+                pthread_create(&clients[i], NULL, ipc_bench_client, icb);
+        for (i = 0; i < IPC_BENCH_THREADS; i++) {
+                pthread_join(clients[i], &ret);
+                if (ret != NULL)
+                        err = -1;
+        }
+        ns = ipc_bench_now_ns() - start;
+
+        if (err) {
+                printf("ipc_bench: %s returns wrong results\n", name);
+                return err;
+        }
+        printf("ipc_bench: %-15s %d threads, %lu calls in %lu us\n",
+               name,
+               IPC_BENCH_THREADS,
+               (unsigned long)IPC_BENCH_ROUND,
+               ns / 1000);
+        return 0;
+}
+
+int main(int argc, char *argv[], char *envp[])
+{
+        pthread_t server_thread_id;
+        ipc_struct_t *icb, *pool;
+        cap_t server_cap;
+
+        server_cap = chcore_pthread_create(
+                &server_thread_id, NULL, ipc_bench_server, NULL);
+        ipc_bench_server_cap = server_cap;
+        if (server_cap < 0) {
+                printf("ipc_bench: create server thread failed %d\n",
+                       server_cap);
+                return -1;
+        }
+
+        /* Connections made before the short handler is declared lack it */
+        while (ipc_bench_server_ready == 0)
+                usys_yield();
+        if (ipc_bench_server_ready < 0)
+                return -1;
+
+        icb = ipc_register_client(server_cap);
+        if (icb == NULL) {
+                printf("ipc_bench: register client failed\n");
+                return -1;
+        }
+
+        if (ipc_bench_run("ipc_call", icb, ipc_bench_call) != 0
+            || ipc_bench_run("ipc_call_short", icb, ipc_bench_call_short) != 0)
+                return -1;
+
+        pool = ipc_register_client_pool(server_cap, IPC_BENCH_THREADS);
+        if (pool == NULL) {
+                printf("ipc_bench: register client pool failed\n");
+                return -1;
+        }
+
+        if (ipc_bench_run_parallel("one connection", icb) != 0
+            || ipc_bench_run_parallel("lane pool", pool) != 0
+            || ipc_bench_run_parallel("per-thread", NULL) != 0)
+                return -1;
+
+        ipc_client_close_connection(pool);
+        ipc_client_close_connection(icb);
+
+        printf("ipc_bench: finished\n");
+        return 0;
+}
@@ -25,6 +25,12 @@ static inline void chcore_spin_lock(volatile int *lk)
 	}
 }
 
+/* Returns 0 on success */
+static inline int chcore_spin_trylock(volatile int *lk)
+{
+	return __atomic_test_and_set(lk, __ATOMIC_ACQUIRE) ? -1 : 0;
+}
+
 static inline void chcore_spin_unlock(volatile int *lk)
 {
 	__asm__ __volatile__("dmb ish" ::: "memory");
@@ -78,6 +78,10 @@ enum fs_req_type {
         /* Test the page cache miss/hit count，disk I/O count . */
         FS_REQ_TEST_PERF,
 
+        /* Set up / tear down an asynchronous request ring, see fs_ring */
+        FS_REQ_RING_SETUP,
+        FS_REQ_RING_TEARDOWN,
+
         FS_REQ_MAX
 
 };
@@ -230,9 +234,53 @@ struct fs_request {
                         char buf[FS_REQ_PATH_BUF_LEN];
                         size_t bufsiz;
                 } readlinkat;
+                struct {
+                        int nr_entries;
+                        int ring_id;
+                } ring;
         };
 };
 
+/*
+ * Asynchronous request ring between a client and a fs server.
+ *
+ * The client creates one PMO_DATA of FS_RING_SIZE(nr_entries) bytes and
+ * passes it, together with a doorbell and a completion notification, in
+ * FS_REQ_RING_SETUP. The first page holds struct fs_ring_hdr and two ring
+ * buffers: the client produces fs_ring_sqe into the SQ and the server
+ * produces fs_ring_cqe into the CQ. Each following page is a request slot
+ * laid out like an IPC shm (struct ipc_response_hdr, then the fs_request
+ * and its data), so the server handles it just like an ipc_msg.
+ *
+ * Each side only rings the other's notification when the flag in the
+ * header says that the other side is about to sleep, so a busy ring
+ * submits and completes requests without any context switch.
+ */
+#define FS_RING_MAX_ENTRIES        32
+#define FS_RING_SQ_OFFSET          64
+#define FS_RING_CQ_OFFSET          2048
+#define FS_RING_SLOT_OFFSET(index) (((index) + 1) * IPC_PER_SHM_SIZE)
+#define FS_RING_SIZE(nr_entries)   FS_RING_SLOT_OFFSET(nr_entries)
+
+struct fs_ring_hdr {
+        int nr_entries;
+        /* Set by the server before waiting on the doorbell */
+        volatile int server_idle;
+        /* Set by the client before waiting on the completion */
+        volatile int client_waiting;
+};
+
+struct fs_ring_sqe {
+        unsigned long user_data;
+        unsigned int slot;
+};
+
+struct fs_ring_cqe {
+        unsigned long user_data;
+        long ret;
+        unsigned int slot;
+};
+
 struct fsm_request {
         /* Request Type */
         enum fsm_req_type req;
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#pragma once
+
+#include <chcore/ipc.h>
+#include <chcore-internal/fs_defs.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous file requests: prepare pread/pwrite/fstat requests on files
+ * of one mounted fs, submit them in a batch and reap the completions later.
+ * A ring must only be used by one thread at a time.
+ */
+struct fs_ring;
+
+/* Return NULL on failure, with errno ENOSYS if the fs serves no rings */
+struct fs_ring *fs_ring_create(int fd, int nr_entries);
+void fs_ring_destroy(struct fs_ring *ring);
+
+/* Return 0 on success, -EBUSY if all entries are in flight */
+int fs_ring_prep_pread(struct fs_ring *ring, int fd, void *buf, size_t count,
+                       off_t offset, unsigned long user_data);
+int fs_ring_prep_pwrite(struct fs_ring *ring, int fd, const void *buf,
+                        size_t count, off_t offset, unsigned long user_data);
+int fs_ring_prep_fstat(struct fs_ring *ring, int fd, struct stat *statbuf,
+                       unsigned long user_data);
+
+/* Return the number of requests submitted */
+int fs_ring_submit(struct fs_ring *ring);
+/*
+ * Return the number of completions stored in @cqes. If @wait is true,
+ * block until there is at least one, unless nothing is in flight.
+ */
+int fs_ring_reap(struct fs_ring *ring, struct fs_ring_cqe *cqes, int max,
+                 bool wait);
+
+#ifdef __cplusplus
+}
+#endif
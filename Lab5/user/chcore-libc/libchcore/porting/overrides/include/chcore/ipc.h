@@ -32,6 +32,12 @@ enum system_server_identifier {
         PROC_MANAGER,
 };
 
+/*
+ * Size of the ipc_msg_t preallocated in each ipc_struct, checked at compile
+ * time in chcore-port/ipc.c like SERVER_IPC_MSG_BUF_SIZE.
+ */
+#define CLIENT_IPC_MSG_BUF_SIZE (64)
+
 /*
  * ipc_struct is created in **ipc_register_client** and
  * thus only used at client side.
@@ -46,8 +52,22 @@ typedef struct ipc_struct {
         /* A spin lock: used to coordinate the access to shared memory */
         volatile int lock;
         enum system_server_identifier server_id;
+
+        /*
+         * Lanes of an ipc_struct created by **ipc_register_client_pool**.
+         * Each lane is a connection with its own shm and server handler
+         * thread, and a message is built on whichever lane is free.
+         */
+        struct ipc_struct *lanes;
+        int nr_lanes;
+
+        /* The ipc_msg_t returned by ipc_create_msg (protected by lock) */
+        char msg_buf[CLIENT_IPC_MSG_BUF_SIZE]
+                __attribute__((aligned(sizeof(void *))));
 } ipc_struct_t;
 
+#define IPC_MAX_LANES 16
+
 extern cap_t fsm_server_cap;
 extern cap_t lwip_server_cap;
 extern cap_t procmgr_server_cap;
@@ -146,6 +166,7 @@ typedef void (*server_destructor)(badge_t);
 
 /* Registeration interfaces */
 ipc_struct_t *ipc_register_client(cap_t server_thread_cap);
+ipc_struct_t *ipc_register_client_pool(cap_t server_thread_cap, int nr_lanes);
 
 void *register_cb(void *ipc_handler);
 void *register_cb_single(void *ipc_handler);
@@ -172,6 +193,7 @@ unsigned int ipc_get_msg_send_cap_num(ipc_msg_t *ipc_msg);
 void ipc_set_msg_send_cap_num(ipc_msg_t *ipc_msg, unsigned int cap_num);
 unsigned int ipc_get_msg_return_cap_num(ipc_msg_t *ipc_msg);
 void ipc_set_msg_return_cap_num(ipc_msg_t *ipc_msg, unsigned int cap_num);
+/* The ipc_msg must not be used after it is destroyed (see chcore-port/ipc.c) */
 int ipc_destroy_msg(ipc_msg_t *ipc_msg);
 
 /* IPC issue/finish interfaces */
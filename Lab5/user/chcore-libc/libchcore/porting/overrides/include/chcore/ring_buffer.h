@@ -38,3 +38,26 @@ int set_one_msg(struct ring_buffer *ring_buf, void *msg);
 int if_buffer_full(struct ring_buffer *ring_buf);
 struct ring_buffer *new_ringbuffer(int msg_num, size_t msg_size);
 void free_ringbuffer(struct ring_buffer *ring_buf);
+size_t ringbuffer_size(int msg_num, size_t msg_size);
+struct ring_buffer *init_ringbuffer_at(void *addr, int msg_num,
+                                       size_t msg_size);
+
+/*
+ * One end of a ring buffer shared with another process.
+ * The geometry and the offset owned by this end are kept privately, so a
+ * misbehaving peer can only make the ring look empty or full, but never
+ * redirect accesses out of the buffer.
+ */
+struct ring_buffer_end {
+        struct ring_buffer *ring_buf;
+        size_t buffer_size;
+        size_t msg_size;
+        /* consumer_offset for the consumer end, producer_offset otherwise */
+        off_t off;
+};
+
+void attach_ringbuffer_end(struct ring_buffer_end *end,
+                           struct ring_buffer *ring_buf, int msg_num,
+                           size_t msg_size);
+int get_one_msg_shared(struct ring_buffer_end *consumer, void *msg);
+int set_one_msg_shared(struct ring_buffer_end *producer, void *msg);
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chcore/defs.h>
+#include <chcore/fs_ring.h>
+#include <chcore/memory.h>
+#include <chcore/ring_buffer.h>
+#include <chcore/syscall.h>
+
+#include "fd.h"
+#include "fs_client_defs.h"
+
+/* The request held by an entry until its completion is reaped */
+struct fs_ring_pending {
+        enum fs_req_type req;
+        void *buf;
+        size_t count;
+        unsigned long user_data;
+};
+
+struct fs_ring {
+        int ring_id;
+        int mount_id;
+        int nr_entries;
+
+        vaddr_t addr;
+        cap_t pmo_cap;
+        cap_t doorbell_cap;
+        cap_t completion_cap;
+
+        struct fs_ring_hdr *hdr;
+        struct ring_buffer_end sq;
+        struct ring_buffer_end cq;
+
+        /* Bit i is set when entry i is in flight */
+        unsigned long busy;
+        int nr_inflight;
+        struct fs_ring_pending pending[FS_RING_MAX_ENTRIES];
+        /* Entries prepared but not published to the SQ yet */
+        int nr_unsubmitted;
+        unsigned int unsubmitted[FS_RING_MAX_ENTRIES];
+};
+
+static inline void *fs_ring_slot(struct fs_ring *ring, unsigned int slot)
+{
+        return (void *)(ring->addr + FS_RING_SLOT_OFFSET(slot));
+}
+
+static inline struct fs_request *fs_ring_slot_req(struct fs_ring *ring,
+                                                  unsigned int slot)
+{
+        return (struct fs_request *)SHM_PTR_TO_CUSTOM_DATA_PTR(
+                fs_ring_slot(ring, slot));
+}
+
+static int fs_ring_call(int mount_id, enum fs_req_type req, int nr_entries,
+                        int ring_id, cap_t *caps, int nr_caps)
+{
+        ipc_struct_t *fs_ipc_struct;
+        ipc_msg_t *ipc_msg;
+        struct fs_request *fr_ptr;
+        int i, ret;
+
+        fs_ipc_struct = get_ipc_struct_by_mount_id(mount_id);
+        ipc_msg = ipc_create_msg_with_cap(
+                fs_ipc_struct, sizeof(struct fs_request), nr_caps);
+        fr_ptr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
+
+        fr_ptr->req = req;
+        fr_ptr->ring.nr_entries = nr_entries;
+        fr_ptr->ring.ring_id = ring_id;
+        for (i = 0; i < nr_caps; i++)
+                ipc_set_msg_cap(ipc_msg, i, caps[i]);
+
+        ret = ipc_call(fs_ipc_struct, ipc_msg);
+        ipc_destroy_msg(ipc_msg);
+        return ret;
+}
+
+static int fs_ring_mount_id(int fd)
+{
+        struct fd_record_extension *fd_ext;
+
+        if (fd < MIN_FD || fd >= MAX_FD || fd_dic[fd] == NULL
+            || fd_dic[fd]->type != FD_TYPE_FILE)
+                return -EBADF;
+
+        fd_ext = (struct fd_record_extension *)fd_dic[fd]->private_data;
+        return fd_ext->mount_id;
+}
+
+static void fs_ring_free(struct fs_ring *ring)
+{
+        size_t size = FS_RING_SIZE(ring->nr_entries);
+
+        if (ring->completion_cap > 0)
+                usys_revoke_cap(ring->completion_cap, false);
+        if (ring->doorbell_cap > 0)
+                usys_revoke_cap(ring->doorbell_cap, false);
+        if (ring->addr) {
+                usys_unmap_pmo(SELF_CAP, ring->pmo_cap, ring->addr);
+                chcore_free_vaddr(ring->addr, size);
+        }
+        if (ring->pmo_cap > 0)
+                usys_revoke_cap(ring->pmo_cap, false);
+        free(ring);
+}
+
+struct fs_ring *fs_ring_create(int fd, int nr_entries)
+{
+        struct fs_ring *ring;
+        size_t size;
+        cap_t caps[3];
+        int mount_id, ret;
+
+        BUILD_BUG_ON(sizeof(struct fs_ring_hdr) > FS_RING_SQ_OFFSET);
+        BUILD_BUG_ON(FS_RING_SQ_OFFSET + sizeof(struct ring_buffer)
+                             + (FS_RING_MAX_ENTRIES + 1)
+                                       * sizeof(struct fs_ring_sqe)
+                     > FS_RING_CQ_OFFSET);
+        BUILD_BUG_ON(FS_RING_CQ_OFFSET + sizeof(struct ring_buffer)
+                             + (FS_RING_MAX_ENTRIES + 1)
+                                       * sizeof(struct fs_ring_cqe)
+                     > IPC_PER_SHM_SIZE);
+
+        mount_id = fs_ring_mount_id(fd);
+        if (mount_id < 0 || nr_entries <= 0
+            || nr_entries > FS_RING_MAX_ENTRIES)
+                return NULL;
+
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL)
+                return NULL;
+        ring->mount_id = mount_id;
+        ring->nr_entries = nr_entries;
+        size = FS_RING_SIZE(nr_entries);
+
+        ring->pmo_cap = usys_create_pmo(size, PMO_DATA);
+        if (ring->pmo_cap < 0)
+                goto out_free;
+        ring->addr = chcore_alloc_vaddr(size);
+        ret = usys_map_pmo(
+                SELF_CAP, ring->pmo_cap, ring->addr, VM_READ | VM_WRITE);
+        if (ret < 0) {
+                chcore_free_vaddr(ring->addr, size);
+                ring->addr = 0;
+                goto out_free;
+        }
+
+        ring->hdr = (struct fs_ring_hdr *)ring->addr;
+        ring->hdr->nr_entries = nr_entries;
+        /* One more message in each ring, which always keeps a slot empty */
+        attach_ringbuffer_end(
+                &ring->sq,
+                init_ringbuffer_at((void *)(ring->addr + FS_RING_SQ_OFFSET),
+                                   nr_entries + 1,
+                                   sizeof(struct fs_ring_sqe)),
+                nr_entries + 1,
+                sizeof(struct fs_ring_sqe));
+        attach_ringbuffer_end(
+                &ring->cq,
+                init_ringbuffer_at((void *)(ring->addr + FS_RING_CQ_OFFSET),
+                                   nr_entries + 1,
+                                   sizeof(struct fs_ring_cqe)),
+                nr_entries + 1,
+                sizeof(struct fs_ring_cqe));
+
+        ring->doorbell_cap = usys_create_notifc();
+        if (ring->doorbell_cap < 0)
+                goto out_free;
+        ring->completion_cap = usys_create_notifc();
+        if (ring->completion_cap < 0)
+                goto out_free;
+
+        caps[0] = ring->pmo_cap;
+        caps[1] = ring->doorbell_cap;
+        caps[2] = ring->completion_cap;
+        ret = fs_ring_call(
+                mount_id, FS_REQ_RING_SETUP, nr_entries, -1, caps, 3);
+        if (ret < 0) {
+                fs_ring_free(ring);
+                errno = -ret;
+                return NULL;
+        }
+        ring->ring_id = ret;
+
+        return ring;
+
+out_free:
+        fs_ring_free(ring);
+        return NULL;
+}
+
+void fs_ring_destroy(struct fs_ring *ring)
+{
+        /* The server stops touching the PMO before the teardown returns */
+        fs_ring_call(ring->mount_id,
+                     FS_REQ_RING_TEARDOWN,
+                     ring->nr_entries,
+                     ring->ring_id,
+                     NULL,
+                     0);
+        fs_ring_free(ring);
+}
+
+/* Take a free entry and return the fs_request in its slot */
+static struct fs_request *fs_ring_get_entry(struct fs_ring *ring,
+                                            enum fs_req_type req, void *buf,
+                                            size_t count,
+                                            unsigned long user_data)
+{
+        struct fs_request *fr_ptr;
+        unsigned int slot;
+
+        for (slot = 0; ring->busy & (1UL << slot); slot++)
+                ;
+        ring->busy |= 1UL << slot;
+        ring->nr_inflight++;
+        ring->pending[slot].req = req;
+        ring->pending[slot].buf = buf;
+        ring->pending[slot].count = count;
+        ring->pending[slot].user_data = user_data;
+        ring->unsubmitted[ring->nr_unsubmitted++] = slot;
+
+        fr_ptr = fs_ring_slot_req(ring, slot);
+        fr_ptr->req = req;
+        return fr_ptr;
+}
+
+static int fs_ring_check_entry(struct fs_ring *ring, int fd)
+{
+        if (fs_ring_mount_id(fd) != ring->mount_id)
+                return -EBADF;
+        if (ring->nr_inflight == ring->nr_entries)
+                return -EBUSY;
+        return 0;
+}
+
+int fs_ring_prep_pread(struct fs_ring *ring, int fd, void *buf, size_t count,
+                       off_t offset, unsigned long user_data)
+{
+        struct fs_request *fr_ptr;
+        int ret;
+
+        if ((ret = fs_ring_check_entry(ring, fd)) < 0)
+                return ret;
+        if (count > FS_SINGLE_REQ_READ_BUF_SIZE)
+                return -EINVAL;
+
+        fr_ptr = fs_ring_get_entry(
+                ring, FS_REQ_PREAD, buf, count, user_data);
+        fr_ptr->pread.fd = fd;
+        fr_ptr->pread.count = count;
+        fr_ptr->pread.offset = offset;
+        return 0;
+}
+
+int fs_ring_prep_pwrite(struct fs_ring *ring, int fd, const void *buf,
+                        size_t count, off_t offset, unsigned long user_data)
+{
+        struct fs_request *fr_ptr;
+        int ret;
+
+        if ((ret = fs_ring_check_entry(ring, fd)) < 0)
+                return ret;
+        if (count > FS_SINGLE_REQ_WRITE_BUF_SIZE)
+                return -EINVAL;
+
+        fr_ptr = fs_ring_get_entry(
+                ring, FS_REQ_PWRITE, NULL, count, user_data);
+        fr_ptr->pwrite.fd = fd;
+        fr_ptr->pwrite.count = count;
+        fr_ptr->pwrite.offset = offset;
+        memcpy((void *)fr_ptr + sizeof(struct fs_request), buf, count);
+        return 0;
+}
+
+int fs_ring_prep_fstat(struct fs_ring *ring, int fd, struct stat *statbuf,
+                       unsigned long user_data)
+{
+        struct fs_request *fr_ptr;
+        int ret;
+
+        if ((ret = fs_ring_check_entry(ring, fd)) < 0)
+                return ret;
+
+        fr_ptr = fs_ring_get_entry(
+                ring, FS_REQ_FSTAT, statbuf, sizeof(*statbuf), user_data);
+        /* Same as __xstatxx without a path */
+        fr_ptr->stat.fd = fr_ptr->stat.dirfd = fd;
+        fr_ptr->stat.flags = 0;
+        return 0;
+}
+
+int fs_ring_submit(struct fs_ring *ring)
+{
+        struct fs_ring_sqe sqe;
+        int i, nr = ring->nr_unsubmitted;
+
+        /* The SQ holds nr_entries messages, so it never overflows */
+        for (i = 0; i < nr; i++) {
+                sqe.slot = ring->unsubmitted[i];
+                sqe.user_data = ring->pending[sqe.slot].user_data;
+                BUG_ON(set_one_msg_shared(&ring->sq, &sqe) != MSG_OP_SUCCESS);
+        }
+        ring->nr_unsubmitted = 0;
+
+        /*
+         * Pairs with the barrier in the server between setting server_idle
+         * and checking the SQ for the last time: either the server sees the
+         * new SQEs, or the client sees it idle and rings the doorbell.
+         */
+        __sync_synchronize();
+        if (nr > 0 && ring->hdr->server_idle)
+                usys_notify(ring->doorbell_cap);
+        return nr;
+}
+
+/* Copy the results out of the slot and release it */
+static void fs_ring_complete(struct fs_ring *ring, struct fs_ring_cqe *cqe)
+{
+        struct fs_ring_pending *pending = &ring->pending[cqe->slot];
+        char *data = (char *)fs_ring_slot_req(ring, cqe->slot);
+
+        cqe->user_data = pending->user_data;
+        if (pending->req == FS_REQ_PREAD && cqe->ret > 0)
+                memcpy(pending->buf, data, MIN((size_t)cqe->ret, pending->count));
+        else if (pending->req == FS_REQ_FSTAT && cqe->ret == 0)
+                memcpy(pending->buf, data, pending->count);
+
+        ring->busy &= ~(1UL << cqe->slot);
+        ring->nr_inflight--;
+}
+
+static int fs_ring_reap_nowait(struct fs_ring *ring, struct fs_ring_cqe *cqes,
+                               int max)
+{
+        int nr = 0;
+
+        while (nr < max && get_one_msg_shared(&ring->cq, &cqes[nr])) {
+                /* Drop completions of entries which are not in flight */
+                if (cqes[nr].slot >= ring->nr_entries
+                    || !(ring->busy & (1UL << cqes[nr].slot)))
+                        continue;
+                fs_ring_complete(ring, &cqes[nr]);
+                nr++;
+        }
+        return nr;
+}
+
+int fs_ring_reap(struct fs_ring *ring, struct fs_ring_cqe *cqes, int max,
+                 bool wait)
+{
+        int nr;
+
+        for (;;) {
+                nr = fs_ring_reap_nowait(ring, cqes, max);
+                /* Nothing submitted is in flight, there is nothing to wait */
+                if (nr > 0 || !wait
+                    || ring->nr_inflight == ring->nr_unsubmitted)
+                        return nr;
+
+                ring->hdr->client_waiting = 1;
+                /* Pairs with the barrier in the server after posting CQEs */
+                __sync_synchronize();
+                nr = fs_ring_reap_nowait(ring, cqes, max);
+                if (nr == 0)
+                        usys_wait(ring->completion_cap, true, NULL);
+                ring->hdr->client_waiting = 0;
+                if (nr > 0)
+                        return nr;
+        }
+}
@@ -105,4 +105,86 @@ void free_ringbuffer(struct ring_buffer *ring_buf)
 {
         int page_num = ROUND_UP(ring_buf->buffer_size, 0x1000);
         munmap(ring_buf, page_num * 0x1000);
-}
\ No newline at end of file
+}
+size_t ringbuffer_size(int msg_num, size_t msg_size)
+{
+        return msg_num * msg_size + sizeof(struct ring_buffer);
+}
+
+/* Build a ring buffer in memory provided by the caller, e.g., a shared PMO */
+struct ring_buffer *init_ringbuffer_at(void *addr, int msg_num,
+                                       size_t msg_size)
+{
+        struct ring_buffer *ring_buf = (struct ring_buffer *)addr;
+        size_t buffer_size = ringbuffer_size(msg_num, msg_size);
+
+        if (msg_num <= 0 || addr == NULL)
+                return NULL;
+
+        memset(ring_buf, 0, buffer_size);
+        ring_buf->msg_size = msg_size;
+        ring_buf->buffer_size = buffer_size;
+        ring_buf->producer_offset = (off_t)sizeof(struct ring_buffer);
+        ring_buf->consumer_offset = (off_t)sizeof(struct ring_buffer);
+        return ring_buf;
+}
+
+void attach_ringbuffer_end(struct ring_buffer_end *end,
+                           struct ring_buffer *ring_buf, int msg_num,
+                           size_t msg_size)
+{
+        end->ring_buf = ring_buf;
+        end->buffer_size = ringbuffer_size(msg_num, msg_size);
+        end->msg_size = msg_size;
+        end->off = (off_t)sizeof(struct ring_buffer);
+}
+
+static inline off_t next_slot_of_end(struct ring_buffer_end *end, off_t off)
+{
+        return ((off == end->buffer_size - end->msg_size) ?
+                        (sizeof(struct ring_buffer)) :
+                        (off + end->msg_size));
+}
+
+/* Whether an offset written by the peer points to a slot of the buffer */
+static inline bool peer_off_valid(struct ring_buffer_end *end, off_t off)
+{
+        return off >= (off_t)sizeof(struct ring_buffer)
+               && off < (off_t)end->buffer_size
+               && (off - sizeof(struct ring_buffer)) % end->msg_size == 0;
+}
+
+int get_one_msg_shared(struct ring_buffer_end *consumer, void *msg)
+{
+        struct ring_buffer *ring_buf = consumer->ring_buf;
+        off_t p_off;
+
+        /* Pairs with the release in set_one_msg_shared */
+        p_off = __atomic_load_n(&ring_buf->producer_offset, __ATOMIC_ACQUIRE);
+        if (p_off == consumer->off || !peer_off_valid(consumer, p_off))
+                return MSG_OP_FAILURE;
+
+        memcpy(msg, (void *)ring_buf + consumer->off, consumer->msg_size);
+        consumer->off = next_slot_of_end(consumer, consumer->off);
+        __atomic_store_n(
+                &ring_buf->consumer_offset, consumer->off, __ATOMIC_RELEASE);
+        return MSG_OP_SUCCESS;
+}
+
+int set_one_msg_shared(struct ring_buffer_end *producer, void *msg)
+{
+        struct ring_buffer *ring_buf = producer->ring_buf;
+        off_t c_off;
+
+        /* The consumer must be done with the slot before it is reused */
+        c_off = __atomic_load_n(&ring_buf->consumer_offset, __ATOMIC_ACQUIRE);
+        if (!peer_off_valid(producer, c_off)
+            || c_off == next_slot_of_end(producer, producer->off))
+                return MSG_OP_FAILURE;
+
+        memcpy((void *)ring_buf + producer->off, msg, producer->msg_size);
+        producer->off = next_slot_of_end(producer, producer->off);
+        __atomic_store_n(
+                &ring_buf->producer_offset, producer->off, __ATOMIC_RELEASE);
+        return MSG_OP_SUCCESS;
+}
@@ -163,6 +163,13 @@ static int handle_one_fault(badge_t fault_badge, vaddr_t fault_va)
                         fs_debug_warn("vnode->size=0x%lx, offset=0x%lx\n",
                                       vnode->size,
                                       file_offset + area_off);
+                        /*
+                         * E.g. the file was truncated after it is mapped.
+                         * The kernel maps a zeroed page if there is no page
+                         * to copy, so the client reads zeros rather than
+                         * blocking on the fault forever.
+                         */
+                        copy = 1;
                 }
         }
 
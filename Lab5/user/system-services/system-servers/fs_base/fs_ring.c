@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Asynchronous request rings (see fs_defs.h).
+ *
+ * Each ring is served by a drainer thread, which handles all the SQEs it
+ * finds in one batch and only sleeps on the doorbell when the SQ is empty.
+ * The requests go through fs_server_handle_request like IPC requests, but
+ * on a private copy of the slot, since the client can write the PMO at any
+ * time. Only pread, pwrite and fstat are accepted.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <chcore/defs.h>
+#include <chcore/memory.h>
+#include <chcore/ring_buffer.h>
+#include <chcore/syscall.h>
+#include <chcore/container/list.h>
+#include "fs_wrapper_defs.h"
+
+#define FS_RING_MAX_PER_CLIENT 4
+
+struct fs_ring {
+        badge_t client_badge;
+        int ring_id;
+        int nr_entries;
+
+        vaddr_t addr;
+        cap_t pmo_cap;
+        cap_t doorbell_cap;
+        cap_t completion_cap;
+
+        struct fs_ring_hdr *hdr;
+        struct ring_buffer_end sq;
+        struct ring_buffer_end cq;
+
+        /* Private copy of the slot being handled */
+        char *buf;
+
+        volatile bool stopped;
+        pthread_t drainer;
+        struct list_head node;
+};
+
+static struct list_head fs_rings;
+static pthread_mutex_t fs_rings_lock;
+static int fs_ring_next_id;
+
+void fs_ring_init(void)
+{
+        init_list_head(&fs_rings);
+        pthread_mutex_init(&fs_rings_lock, NULL);
+}
+
+static long fs_ring_handle(struct fs_ring *ring, unsigned int slot)
+{
+        char msg_buf[SERVER_IPC_MSG_BUF_SIZE];
+        ipc_msg_t *ipc_msg = (ipc_msg_t *)msg_buf;
+        struct fs_request *fr;
+        enum fs_req_type req;
+        bool ret_with_cap = false;
+        char *data;
+        long ret;
+
+        if (slot >= ring->nr_entries)
+                return -EINVAL;
+        data = SHM_PTR_TO_CUSTOM_DATA_PTR(ring->addr
+                                          + FS_RING_SLOT_OFFSET(slot));
+
+        __ipc_server_init_raw_msg(ipc_msg, ring->buf, IPC_SHM_AVAILABLE, 0);
+        fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
+        memcpy(fr, data, sizeof(*fr));
+
+        req = fr->req;
+        switch (req) {
+        case FS_REQ_PREAD:
+        case FS_REQ_FSTAT:
+                break;
+        case FS_REQ_PWRITE:
+                if (fr->pwrite.count > FS_SINGLE_REQ_WRITE_BUF_SIZE)
+                        return -EINVAL;
+                memcpy((char *)fr + sizeof(*fr),
+                       data + sizeof(*fr),
+                       fr->pwrite.count);
+                break;
+        default:
+                return -EINVAL;
+        }
+
+        ret = fs_server_handle_request(
+                ring->client_badge, ipc_msg, fr, &ret_with_cap);
+
+        /* pread returns the data in place of the request */
+        if (req == FS_REQ_PREAD && ret > 0)
+                memcpy(data, fr, ret);
+        else if (req == FS_REQ_FSTAT && ret == 0)
+                memcpy(data, fr, sizeof(struct stat));
+
+        return ret;
+}
+
+/* Handle all the SQEs in the SQ and return how many there were */
+static int fs_ring_drain(struct fs_ring *ring)
+{
+        struct fs_ring_sqe sqe;
+        struct fs_ring_cqe cqe;
+        int nr = 0;
+
+        while (!ring->stopped && get_one_msg_shared(&ring->sq, &sqe)) {
+                cqe.user_data = sqe.user_data;
+                cqe.slot = sqe.slot;
+                cqe.ret = fs_ring_handle(ring, sqe.slot);
+                /* Only full if the client has more in flight than entries */
+                set_one_msg_shared(&ring->cq, &cqe);
+                nr++;
+        }
+
+        if (nr > 0) {
+                /* Pairs with the barrier in fs_ring_reap */
+                __sync_synchronize();
+                if (ring->hdr->client_waiting)
+                        usys_notify(ring->completion_cap);
+        }
+        return nr;
+}
+
+static void *fs_ring_drainer(void *arg)
+{
+        struct fs_ring *ring = (struct fs_ring *)arg;
+
+        while (!ring->stopped) {
+                if (fs_ring_drain(ring) > 0)
+                        continue;
+
+                ring->hdr->server_idle = 1;
+                /* Pairs with the barrier in fs_ring_submit */
+                __sync_synchronize();
+                if (fs_ring_drain(ring) == 0 && !ring->stopped)
+                        usys_wait(ring->doorbell_cap, true, NULL);
+                ring->hdr->server_idle = 0;
+        }
+        return NULL;
+}
+
+static void fs_ring_free(struct fs_ring *ring)
+{
+        if (ring->addr) {
+                usys_unmap_pmo(SELF_CAP, ring->pmo_cap, ring->addr);
+                chcore_free_vaddr(ring->addr, FS_RING_SIZE(ring->nr_entries));
+        }
+        if (ring->pmo_cap >= 0)
+                usys_revoke_cap(ring->pmo_cap, false);
+        if (ring->doorbell_cap >= 0)
+                usys_revoke_cap(ring->doorbell_cap, false);
+        if (ring->completion_cap >= 0)
+                usys_revoke_cap(ring->completion_cap, false);
+        free(ring->buf);
+        free(ring);
+}
+
+static void fs_ring_stop(struct fs_ring *ring)
+{
+        ring->stopped = true;
+        usys_notify(ring->doorbell_cap);
+        pthread_join(ring->drainer, NULL);
+        fs_ring_free(ring);
+}
+
+int fs_wrapper_ring_setup(badge_t client_badge, ipc_msg_t *ipc_msg,
+                          struct fs_request *fr)
+{
+        struct fs_ring *ring, *iter;
+        int nr_entries = fr->ring.nr_entries;
+        int nr_rings = 0, ret;
+        char probe;
+
+        if (nr_entries <= 0 || nr_entries > FS_RING_MAX_ENTRIES)
+                return -EINVAL;
+
+        ring = (struct fs_ring *)calloc(1, sizeof(*ring));
+        if (ring == NULL)
+                return -ENOMEM;
+        ring->client_badge = client_badge;
+        ring->nr_entries = nr_entries;
+        ring->pmo_cap = ipc_get_msg_cap(ipc_msg, 0);
+        ring->doorbell_cap = ipc_get_msg_cap(ipc_msg, 1);
+        ring->completion_cap = ipc_get_msg_cap(ipc_msg, 2);
+        if (ring->pmo_cap < 0 || ring->doorbell_cap < 0
+            || ring->completion_cap < 0) {
+                ret = -EINVAL;
+                goto out_free;
+        }
+
+        ring->buf = (char *)malloc(IPC_PER_SHM_SIZE);
+        if (ring->buf == NULL) {
+                ret = -ENOMEM;
+                goto out_free;
+        }
+
+        /*
+         * Reading the last byte fails unless the PMO is a PMO_DATA covering
+         * the whole ring, so accessing the mapping below never faults.
+         */
+        if (usys_read_pmo(ring->pmo_cap,
+                          FS_RING_SIZE(nr_entries) - 1,
+                          &probe,
+                          sizeof(probe))
+            < 0) {
+                ret = -EINVAL;
+                goto out_free;
+        }
+
+        ring->addr = chcore_alloc_vaddr(FS_RING_SIZE(nr_entries));
+        ret = usys_map_pmo(
+                SELF_CAP, ring->pmo_cap, ring->addr, VM_READ | VM_WRITE);
+        if (ret < 0) {
+                chcore_free_vaddr(ring->addr, FS_RING_SIZE(nr_entries));
+                ring->addr = 0;
+                goto out_free;
+        }
+
+        /* The geometry comes from nr_entries, never from the shared pages */
+        ring->hdr = (struct fs_ring_hdr *)ring->addr;
+        attach_ringbuffer_end(
+                &ring->sq,
+                (struct ring_buffer *)(ring->addr + FS_RING_SQ_OFFSET),
+                nr_entries + 1,
+                sizeof(struct fs_ring_sqe));
+        attach_ringbuffer_end(
+                &ring->cq,
+                (struct ring_buffer *)(ring->addr + FS_RING_CQ_OFFSET),
+                nr_entries + 1,
+                sizeof(struct fs_ring_cqe));
+
+        pthread_mutex_lock(&fs_rings_lock);
+        for_each_in_list (iter, struct fs_ring, node, &fs_rings) {
+                if (iter->client_badge == client_badge)
+                        nr_rings++;
+        }
+        if (nr_rings >= FS_RING_MAX_PER_CLIENT) {
+                pthread_mutex_unlock(&fs_rings_lock);
+                ret = -ENOSPC;
+                goto out_free;
+        }
+
+        ret = pthread_create(&ring->drainer, NULL, fs_ring_drainer, ring);
+        if (ret != 0) {
+                pthread_mutex_unlock(&fs_rings_lock);
+                ret = -ret;
+                goto out_free;
+        }
+        ring->ring_id = fs_ring_next_id++;
+        list_add(&ring->node, &fs_rings);
+        pthread_mutex_unlock(&fs_rings_lock);
+
+        return ring->ring_id;
+
+out_free:
+        fs_ring_free(ring);
+        return ret;
+}
+
+int fs_wrapper_ring_teardown(badge_t client_badge, struct fs_request *fr)
+{
+        struct fs_ring *ring;
+        bool found = false;
+
+        pthread_mutex_lock(&fs_rings_lock);
+        for_each_in_list (ring, struct fs_ring, node, &fs_rings) {
+                if (ring->client_badge == client_badge
+                    && ring->ring_id == fr->ring.ring_id) {
+                        list_del(&ring->node);
+                        found = true;
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&fs_rings_lock);
+
+        if (!found)
+                return -ENOENT;
+        fs_ring_stop(ring);
+        return 0;
+}
+
+/* Called when the client exits, before its fds are released */
+void fs_ring_destroy_client(badge_t client_badge)
+{
+        struct fs_ring *ring, *tmp;
+        struct list_head stopping;
+
+        init_list_head(&stopping);
+        pthread_mutex_lock(&fs_rings_lock);
+        for_each_in_list_safe (ring, tmp, node, &fs_rings) {
+                if (ring->client_badge == client_badge) {
+                        list_del(&ring->node);
+                        list_add(&ring->node, &stopping);
+                }
+        }
+        pthread_mutex_unlock(&fs_rings_lock);
+
+        for_each_in_list_safe (ring, tmp, node, &stopping) {
+                list_del(&ring->node);
+                fs_ring_stop(ring);
+        }
+}
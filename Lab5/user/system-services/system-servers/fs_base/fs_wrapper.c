@@ -78,6 +78,31 @@ int real_file_writer(char *buffer, pidx_t file_page_idx, int page_block_idx,
         return server_ops.write(vnode->private, offset, size, buffer);
 }
 
+/*
+ * Stubs for builds without the rings, overridden by fs_ring.c.
+ *
+ * fs_ring.c is only linked in because fs_server_destructor in
+ * fs_wrapper_ops.c calls fs_ring_destroy_client. A build that links a
+ * prebuilt fs_wrapper_ops object (or leaves fs_ring.c out) keeps these
+ * stubs and refuses FS_REQ_RING_SETUP, so no ring outlives its client.
+ */
+__attribute__((weak)) void fs_ring_init(void)
+{
+}
+
+__attribute__((weak)) int fs_wrapper_ring_setup(badge_t client_badge,
+                                                ipc_msg_t *ipc_msg,
+                                                struct fs_request *fr)
+{
+        return -ENOSYS;
+}
+
+__attribute__((weak)) int fs_wrapper_ring_teardown(badge_t client_badge,
+                                                   struct fs_request *fr)
+{
+        return -ENOSYS;
+}
+
 void init_fs_wrapper(void)
 {
         struct user_defined_funcs uf;
@@ -98,6 +123,9 @@ void init_fs_wrapper(void)
         /* Module: fmap fault */
         fs_page_fault_init();
 
+        /* Module: asynchronous request rings */
+        fs_ring_init();
+
 #ifdef TEST_COUNT_PAGE_CACHE
         count.hit = 0;
         count.miss = 0;
@@ -228,17 +256,14 @@ int translate_fd_to_fid(badge_t client_badge, struct fs_request *fr)
         return ret;
 }
 
-DEFINE_SERVER_HANDLER(fs_server_dispatch)
+/*
+ * Handle one fs_request, which comes from an IPC or from an fs_ring slot.
+ * The ring requests are not handled here since they are not fs operations.
+ */
+long fs_server_handle_request(badge_t client_badge, ipc_msg_t *ipc_msg,
+                              struct fs_request *fr, bool *ret_with_cap)
 {
-        struct fs_request *fr;
         long ret;
-        bool ret_with_cap = false;
-
-        if (ipc_msg == NULL) {
-                ipc_return(ipc_msg, -EINVAL);
-        }
-
-        fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
 
         /* We only support concurrent READ and WRITE */
         if (fr->req != FS_REQ_READ && fr->req != FS_REQ_WRITE) {
@@ -354,7 +379,7 @@ DEFINE_SERVER_HANDLER(fs_server_dispatch)
                 ret = fs_wrapper_fcntl(client_badge, ipc_msg, fr);
                 break;
         case FS_REQ_FMAP:
-                ret = fs_wrapper_fmap(client_badge, ipc_msg, fr, &ret_with_cap);
+                ret = fs_wrapper_fmap(client_badge, ipc_msg, fr, ret_with_cap);
                 break;
         case FS_REQ_FUNMAP:
                 ret = fs_wrapper_funmap(client_badge, ipc_msg, fr);
@@ -378,6 +403,38 @@ DEFINE_SERVER_HANDLER(fs_server_dispatch)
 
 out:
         pthread_rwlock_unlock(&fs_wrapper_meta_rwlock);
+        return ret;
+}
+
+DEFINE_SERVER_HANDLER(fs_server_dispatch)
+{
+        struct fs_request *fr;
+        long ret;
+        bool ret_with_cap = false;
+
+        if (ipc_msg == NULL) {
+                ipc_return(ipc_msg, -EINVAL);
+        }
+
+        fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
+
+        /*
+         * Tearing down a ring waits for its drainer, which may be waiting
+         * for fs_wrapper_meta_rwlock, so never take the lock for them.
+         */
+        switch (fr->req) {
+        case FS_REQ_RING_SETUP:
+                ret = fs_wrapper_ring_setup(client_badge, ipc_msg, fr);
+                break;
+        case FS_REQ_RING_TEARDOWN:
+                ret = fs_wrapper_ring_teardown(client_badge, fr);
+                break;
+        default:
+                ret = fs_server_handle_request(
+                        client_badge, ipc_msg, fr, &ret_with_cap);
+                break;
+        }
+
         if (ret_with_cap)
                 ipc_return_with_cap(ipc_msg, ret);
         else
@@ -157,8 +157,18 @@ int fs_wrapper_mount(ipc_msg_t *ipc_msg, struct fs_request *fr);
 int fs_wrapper_umount(ipc_msg_t *ipc_msg, struct fs_request *fr);
 void fs_server_destructor(badge_t client_badge);
 
+long fs_server_handle_request(badge_t client_badge, ipc_msg_t *ipc_msg,
+                              struct fs_request *fr, bool *ret_with_cap);
 DECLARE_SERVER_HANDLER(fs_server_dispatch);
 
+/* +++++++++++++++++++++++ Asynchronous Request Rings +++++++++++++++++++++ */
+
+void fs_ring_init(void);
+int fs_wrapper_ring_setup(badge_t client_badge, ipc_msg_t *ipc_msg,
+                          struct fs_request *fr);
+int fs_wrapper_ring_teardown(badge_t client_badge, struct fs_request *fr);
+void fs_ring_destroy_client(badge_t client_badge);
+
 /* ++++++++++++++++++++++++ Concurrency Control ++++++++++++++++++++++++++ */
 
 extern pthread_rwlock_t fs_wrapper_meta_rwlock;
@@ -925,6 +925,9 @@ void fs_server_destructor(badge_t client_badge)
         int i, fd;
         struct fs_vnode *vnode;
 
+        /* The drainers may wait for the rwlock, so stop them before */
+        fs_ring_destroy_client(client_badge);
+
         pthread_rwlock_wrlock(&fs_wrapper_meta_rwlock);
 
         pthread_spin_lock(&server_entry_mapping_lock);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chcore/container/list.h>
+#include <chcore/memory.h>
+
+#include "elf_cache.h"
+#include "librefcnt.h"
+
+/*
+ * Launching the same program again reuses the segment pmos loaded last
+ * time, instead of reading the whole file into new pmos. Like the loader
+ * (see elf_so_loader_init), writable segments are turned into VMR_COW, so
+ * each process gets private copies of the pages it writes. The segment caps
+ * handed to processes only carry the rights of their VMR permissions (see
+ * launch_process_with_pmos_caps), so none of them holds PMO_WRITE.
+ *
+ * A cached ELF is identified by its path and the dev, ino, size and mtime
+ * of the file, and is reloaded if any of them changes. The ramdisk tmpfs
+ * does not maintain mtime, so rewriting a file in place with the same size
+ * is not noticed, but replacing it with a new file is.
+ */
+
+/* The least recently used ELF is evicted when the cache is full */
+#define ELF_CACHE_MAX_ENTRIES 32
+
+/*
+ * The list holds one reference to each cached ELF, the most recently used
+ * first. Launches hold their own references, so an evicted or stale ELF is
+ * only freed after all the launches using it finish.
+ */
+static struct list_head elf_cache_list;
+static int elf_cache_nr;
+static pthread_mutex_t elf_cache_lock;
+static pthread_once_t elf_cache_ctrl = PTHREAD_ONCE_INIT;
+
+static void __init_elf_cache(void)
+{
+        init_list_head(&elf_cache_list);
+        pthread_mutex_init(&elf_cache_lock, NULL);
+}
+
+static void cached_elf_deinit(void *ptr)
+{
+        struct cached_elf *cached = (struct cached_elf *)ptr;
+
+        if (cached->elf) {
+                free_user_elf(cached->elf);
+        }
+}
+
+static bool cached_elf_match(struct cached_elf *cached, struct stat *st)
+{
+        return cached->dev == st->st_dev && cached->ino == st->st_ino
+               && cached->size == st->st_size
+               && cached->mtime.tv_sec == st->st_mtim.tv_sec
+               && cached->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* Should be called with elf_cache_lock held */
+static void __del_cached_elf(struct cached_elf *cached)
+{
+        list_del(&cached->node);
+        elf_cache_nr--;
+        obj_put(cached);
+}
+
+/*
+ * Find the cached ELF of @path and make it the most recently used. Stale
+ * entries of @path found on the way are dropped.
+ * Should be called with elf_cache_lock held.
+ */
+static struct cached_elf *__find_cached_elf(const char *path, struct stat *st)
+{
+        struct cached_elf *iter, *tmp;
+
+        for_each_in_list_safe (iter, tmp, node, &elf_cache_list) {
+                if (strncmp(path, iter->elf->path, ELF_PATH_LEN) != 0) {
+                        continue;
+                }
+                if (!cached_elf_match(iter, st)) {
+                        __del_cached_elf(iter);
+                        continue;
+                }
+                list_del(&iter->node);
+                list_add(&iter->node, &elf_cache_list);
+                return iter;
+        }
+        return NULL;
+}
+
+static int load_cached_elf(const char *path, struct elf_header *elf_header,
+                           struct stat *st, struct cached_elf **cached)
+{
+        struct cached_elf *new_cached;
+        struct user_elf_seg *cur_seg;
+        int ret, i;
+
+        new_cached = obj_alloc(sizeof(*new_cached), cached_elf_deinit);
+        if (!new_cached) {
+                return -ENOMEM;
+        }
+        new_cached->elf = NULL;
+
+        /*
+         * The file may change after @st is taken. Then the cached ELF looks
+         * stale on the next launch and is loaded again, which is safe.
+         */
+        ret = load_elf_by_header_from_fs(path, elf_header, &new_cached->elf);
+        if (ret < 0) {
+                obj_put(new_cached);
+                return ret;
+        }
+
+        for (i = 0; i < new_cached->elf->segs_nr; i++) {
+                cur_seg = &new_cached->elf->user_elf_segs[i];
+                if (cur_seg->perm & VMR_WRITE) {
+                        cur_seg->perm &= (~VMR_WRITE);
+                        cur_seg->perm |= VMR_COW;
+                }
+        }
+
+        new_cached->dev = st->st_dev;
+        new_cached->ino = st->st_ino;
+        new_cached->size = st->st_size;
+        new_cached->mtime = st->st_mtim;
+        *cached = new_cached;
+        return 0;
+}
+
+int get_cached_elf(const char *path, struct elf_header *elf_header,
+                   struct cached_elf **cached)
+{
+        struct cached_elf *iter, *new_cached;
+        struct stat st;
+        int ret;
+
+        pthread_once(&elf_cache_ctrl, __init_elf_cache);
+
+        if (stat(path, &st) < 0) {
+                return -errno;
+        }
+
+        pthread_mutex_lock(&elf_cache_lock);
+        iter = __find_cached_elf(path, &st);
+        if (iter) {
+                *cached = obj_get(iter);
+                pthread_mutex_unlock(&elf_cache_lock);
+                return 0;
+        }
+        pthread_mutex_unlock(&elf_cache_lock);
+
+        /* Load without the lock, so that other launches are not blocked */
+        ret = load_cached_elf(path, elf_header, &st, &new_cached);
+        if (ret < 0) {
+                return ret;
+        }
+
+        pthread_mutex_lock(&elf_cache_lock);
+        /* Another launch may have loaded the same file meanwhile */
+        iter = __find_cached_elf(path, &st);
+        if (iter) {
+                *cached = obj_get(iter);
+                pthread_mutex_unlock(&elf_cache_lock);
+                obj_put(new_cached);
+                return 0;
+        }
+
+        if (elf_cache_nr >= ELF_CACHE_MAX_ENTRIES) {
+                __del_cached_elf(list_entry(
+                        elf_cache_list.prev, struct cached_elf, node));
+        }
+        /* The reference from obj_alloc is held by the list */
+        list_add(&new_cached->node, &elf_cache_list);
+        elf_cache_nr++;
+        *cached = obj_get(new_cached);
+        pthread_mutex_unlock(&elf_cache_lock);
+
+        return 0;
+}
+
+void put_cached_elf(struct cached_elf *cached)
+{
+        obj_put(cached);
+}
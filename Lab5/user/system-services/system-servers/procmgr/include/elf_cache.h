@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#ifndef ELF_CACHE_H
+#define ELF_CACHE_H
+
+#include <sys/stat.h>
+#include <chcore/container/list.h>
+#include "libchcoreelf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A statically linked ELF file loaded from the file system, whose segment
+ * pmos are shared by all the processes launched from it. Read-only segments
+ * are mapped shared, and writable ones are mapped copy-on-write.
+ */
+struct cached_elf {
+        struct list_head node;
+        /** identity of the file the segments were loaded from */
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        struct user_elf *elf;
+};
+
+/**
+ * @brief Get the cached ELF of @path, loading it according to @elf_header
+ * if it is not cached or the file has changed since. Thread-Safe.
+ *
+ * @param path [In]
+ * @param elf_header [In] this function only borrow the pointer.
+ * @param cached [Out] a new reference to the cached ELF, which should be
+ * released with put_cached_elf. Caller is not allowed to modify
+ * (*cached)->elf, since it is shared by other launches.
+ * @return 0 if success, otherwise -errno is returned.
+ */
+int get_cached_elf(const char *path, struct elf_header *elf_header,
+                   struct cached_elf **cached);
+
+void put_cached_elf(struct cached_elf *cached);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ELF_CACHE_H */
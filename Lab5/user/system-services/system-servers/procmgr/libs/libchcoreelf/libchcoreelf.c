@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <malloc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <chcore/syscall.h>
 #include <chcore/bug.h>
 
@@ -368,6 +370,74 @@ static int memory_range_loader(void *param, off_t offset, size_t len, char *buf)
         return 0;
 }
 
+/**
+ * A file mapped as a whole with fmap. Its pages are mapped from the page
+ * cache of the file system server when they are first accessed, so loading
+ * from it skips the fs IPC and the copy through the IPC shared memory.
+ *
+ * If the file is truncated after it is mapped, the pages beyond its end
+ * are mapped as zeroed pages by fs_base, so loading never faults procmgr.
+ * The truncated part is loaded as zeros, like a file changed while read.
+ */
+struct fmap_range {
+        char *addr;
+        size_t size;
+};
+
+/**
+ * @brief Same as file_range_loader, but copies from the fmap of the file.
+ *
+ * @param param [In] struct fmap_range of the file to be read
+ */
+static int fmap_range_loader(void *param, off_t offset, size_t len, char *buf)
+{
+        struct fmap_range *range = (struct fmap_range *)param;
+
+        if (offset < 0 || (size_t)offset > range->size
+            || len > range->size - (size_t)offset) {
+                return -EINVAL;
+        }
+        memcpy(buf, range->addr + offset, len);
+        return 0;
+}
+
+/**
+ * @brief Map the whole file of @fd read-only. Callers fall back to
+ * file_range_loader if this fails, e.g. the file system does not implement
+ * fmap.
+ */
+static int fmap_range_init(int fd, struct fmap_range *range)
+{
+        struct stat st;
+        void *addr;
+
+        if (fstat(fd, &st) < 0) {
+                return -errno;
+        }
+        if (st.st_size <= 0) {
+                return -EINVAL;
+        }
+
+        addr = mmap(NULL,
+                    ROUND_UP(st.st_size, PAGE_SIZE),
+                    PROT_READ,
+                    MAP_PRIVATE,
+                    fd,
+                    0);
+        if (addr == MAP_FAILED) {
+                return -errno;
+        }
+
+        range->addr = addr;
+        range->size = st.st_size;
+        return 0;
+}
+
+static void fmap_range_deinit(struct fmap_range *range)
+{
+        munmap(range->addr, ROUND_UP(range->size, PAGE_SIZE));
+}
+
 #define MALLOC_OR_FAIL(ptr, size)       \
         do {                            \
                 (ptr) = malloc(size);   \
@@ -721,6 +791,9 @@ int load_elf_by_header_from_fs(const char *path, struct elf_header *elf_header,
 {
         int ret = 0, fd;
         struct elf_file *elf_file;
+        struct fmap_range range;
+        range_loader_t loader;
+        void *param;
         ret = open(path, O_RDONLY);
 
         if (ret < 0) {
@@ -729,14 +802,20 @@ int load_elf_by_header_from_fs(const char *path, struct elf_header *elf_header,
         }
 
         fd = ret;
-        ret = __load_elf_ph_sh(
-                elf_header, file_range_loader, (void *)(long)fd, &elf_file);
+        if (fmap_range_init(fd, &range) == 0) {
+                loader = fmap_range_loader;
+                param = &range;
+        } else {
+                loader = file_range_loader;
+                param = (void *)(long)fd;
+        }
+
+        ret = __load_elf_ph_sh(elf_header, loader, param, &elf_file);
         if (ret < 0) {
                 goto out_ph_sh_failed;
         }
 
-        ret = __load_elf_into_pmos(
-                elf_file, file_range_loader, (void *)(long)fd, elf);
+        ret = __load_elf_into_pmos(elf_file, loader, param, elf);
 
         if (ret == 0) {
                 strncpy((*elf)->path, path, ELF_PATH_LEN);
@@ -744,6 +823,9 @@ int load_elf_by_header_from_fs(const char *path, struct elf_header *elf_header,
 
         elf_free(elf_file);
 out_ph_sh_failed:
+        if (loader == fmap_range_loader) {
+                fmap_range_deinit(&range);
+        }
         close(fd);
 out:
         return ret;
@@ -811,6 +893,8 @@ out:
 int load_elf_from_fs(const char *path, struct user_elf **elf)
 {
         int ret = 0, fd;
+        struct fmap_range range;
+
         ret = open(path, O_RDONLY);
         if (ret < 0) {
                 return -errno;
@@ -818,7 +902,13 @@ int load_elf_from_fs(const char *path, struct user_elf **elf)
 
         fd = ret;
 
-        ret = load_elf_from_range(file_range_loader, (void *)(long)fd, elf);
+        if (fmap_range_init(fd, &range) == 0) {
+                ret = load_elf_from_range(fmap_range_loader, &range, elf);
+                fmap_range_deinit(&range);
+        } else {
+                ret = load_elf_from_range(
+                        file_range_loader, (void *)(long)fd, elf);
+        }
 
         if (ret == 0) {
                 strncpy((*elf)->path, path, ELF_PATH_LEN);
@@ -412,14 +412,14 @@ int launch_process_with_pmos_caps(struct launch_process_args *lp_args)
                 origin_pmos[i] = user_elf->user_elf_segs[i].elf_pmo;
                 /*
                  * Drop CAP_RIGHT_REVOKE_ALL to prevent applications from
-                 * maliciously revoking all of this file PMO.
+                 * maliciously revoking all of this file PMO, and keep only
+                 * the rights needed to map the segment. Segment pmos of
+                 * cached ELFs are shared, and their writable segments are
+                 * VMR_COW without VMR_WRITE, so PMO_WRITE is dropped and
+                 * no process can write the shared pages directly.
                  */
-                if (user_elf->user_elf_segs[i].perm & VMR_COW) {
-                        masks[i] = CAP_RIGHT_REVOKE_ALL;
-                } else {
-                        masks[i] = CAP_RIGHT_NO_RIGHTS;
-                }
-                rests[i] = CAP_RIGHT_NO_RIGHTS;
+                masks[i] = CAP_RIGHT_REVOKE_ALL | PMO_ALL_RIGHTS;
+                rests[i] = user_elf->user_elf_segs[i].perm & PMO_ALL_RIGHTS;
         }
 
         ret = usys_transfer_caps_restrict(SELF_CAP,
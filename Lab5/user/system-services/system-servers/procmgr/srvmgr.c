@@ -33,6 +33,7 @@
 #include "libchcoreelf.h"
 #include "liblaunch.h"
 #include "loader.h"
+#include "elf_cache.h"
 #include "uthash.h"
 #include "readyaml_conf.h"
 
@@ -387,7 +388,7 @@ int procmgr_launch_process(int argc, char **argv, char *name,
 {
         int ret;
         struct elf_header *elf_header;
-        struct user_elf *user_elf = NULL;
+        struct cached_elf *cached_elf = NULL;
         struct proc_node *node = NULL;
         struct loader *loader = NULL;
 
@@ -402,13 +403,13 @@ int procmgr_launch_process(int argc, char **argv, char *name,
 
         /**
          * For dynamically linked programs, launch it using CHCORE_LOADER,
-         * otherwise load remaining ELF content and launch it directly.
+         * otherwise load remaining ELF content (or reuse the content loaded
+         * by previous launches) and launch it directly.
          */
         if (elf_header->e_type == ET_DYN) {
                 ret = find_loader(CHCORE_LOADER, &loader);
         } else {
-                ret = load_elf_by_header_from_fs(
-                        argv[0], elf_header, &user_elf);
+                ret = get_cached_elf(argv[0], elf_header, &cached_elf);
         }
 
         if (ret < 0) {
@@ -421,7 +422,7 @@ int procmgr_launch_process(int argc, char **argv, char *name,
                                 name,
                                 if_has_parent,
                                 parent_badge,
-                                user_elf,
+                                cached_elf ? cached_elf->elf : NULL,
                                 loader,
                                 np_args,
                                 proc_type,
@@ -438,8 +439,8 @@ int procmgr_launch_process(int argc, char **argv, char *name,
         ret = 0;
 
 out_free:
-        if (user_elf) {
-                free_user_elf(user_elf);
+        if (cached_elf) {
+                put_cached_elf(cached_elf);
         }
         free(elf_header);
 out:
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include "fs_tools/fs_test.h"
+#include "fs_tools/fs_test_lib.h"
+#include "fs_tools/fstest_utils.h"
+#include "unistd.h"
+#include <assert.h>
+#include <chcore/fs_ring.h>
+
+#define RING_ENTRIES 8
+#define RING_CHUNK   1024
+
+static char chunks[RING_ENTRIES][RING_CHUNK];
+
+/*
+ * Reap until all @nr requests complete. Each of them transfers a chunk,
+ * except the fstat tagged with @stat_tag.
+ */
+static void reap_all(struct fs_ring *ring, int nr, unsigned long stat_tag)
+{
+        struct fs_ring_cqe cqes[RING_ENTRIES];
+        int i, got;
+
+        while (nr > 0) {
+                got = fs_ring_reap(ring, cqes, RING_ENTRIES, true);
+                fs_assert(got > 0);
+                for (i = 0; i < got; i++)
+                        fs_test_eq(cqes[i].ret,
+                                   cqes[i].user_data == stat_tag ? 0 :
+                                                                   RING_CHUNK);
+                nr -= got;
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        struct fs_ring *ring;
+        struct stat st;
+        int fd, i, j;
+        char *fname;
+
+        assert(argc == 2);
+        chdir(argv[1]);
+
+        fname = "test_ring.txt";
+        fd = init_file(fname, RING_ENTRIES * RING_CHUNK);
+        ring = fs_ring_create(fd, RING_ENTRIES);
+        if (ring == NULL && errno == ENOSYS) {
+                printf("fs_test_ring skipped: no rings in this fs build\n");
+                return 0;
+        }
+        fs_assert(ring != NULL);
+
+        /* Overwrite every chunk with its index in one batch */
+        for (i = 0; i < RING_ENTRIES; i++) {
+                memset(chunks[i], i, RING_CHUNK);
+                fs_assert_zero(fs_ring_prep_pwrite(
+                        ring, fd, chunks[i], RING_CHUNK, i * RING_CHUNK, i));
+        }
+        fs_test_eq(fs_ring_prep_fstat(ring, fd, &st, 0), -EBUSY);
+        fs_test_eq(fs_ring_submit(ring), RING_ENTRIES);
+        reap_all(ring, RING_ENTRIES, RING_ENTRIES);
+
+        /* Read them back, together with the size of the file */
+        memset(chunks, 0xff, sizeof(chunks));
+        for (i = 0; i < RING_ENTRIES - 1; i++)
+                fs_assert_zero(fs_ring_prep_pread(
+                        ring, fd, chunks[i], RING_CHUNK, i * RING_CHUNK, i));
+        fs_assert_zero(fs_ring_prep_fstat(ring, fd, &st, RING_ENTRIES - 1));
+        fs_test_eq(fs_ring_submit(ring), RING_ENTRIES);
+        reap_all(ring, RING_ENTRIES, RING_ENTRIES - 1);
+
+        for (i = 0; i < RING_ENTRIES - 1; i++)
+                for (j = 0; j < RING_CHUNK; j++)
+                        fs_test_eq(chunks[i][j], i);
+        fs_test_eq(st.st_size, RING_ENTRIES * RING_CHUNK);
+
+        fs_ring_destroy(ring);
+        deinit_file(fd, fname);
+        printf("fs_test_ring finished\n");
+        return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2023 Institute of Parallel And Distributed Systems (IPADS), Shanghai Jiao Tong University (SJTU)
+ * Licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+/*
+ * Latency and memory cost of launching the same program repeatedly. procmgr
+ * only loads the program from the file system on the first launch, and later
+ * launches share its cached segments.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chcore/launcher.h>
+#include <chcore/proc.h>
+#include <chcore/syscall.h>
+
+#define SPAWN_BENCH_PATH  "/spawn_bench.bin"
+#define SPAWN_BENCH_ROUND 100
+/* Children alive at the same time when measuring memory */
+#define SPAWN_BENCH_ALIVE 16
+
+static unsigned long spawn_bench_now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static pid_t spawn_bench_spawn(char *mode)
+{
+        char *args[2] = {SPAWN_BENCH_PATH, mode};
+
+        return create_process(2, args, NULL);
+}
+
+static unsigned long spawn_bench_free_mem(void)
+{
+        struct free_mem_info info;
+
+        usys_get_free_mem_size(&info);
+        return info.free_mem_size;
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned long start, first_ns, rest_ns, free_before, free_after;
+        pid_t pids[SPAWN_BENCH_ALIVE];
+        int i, status;
+
+        if (argc == 2 && strcmp(argv[1], "exit") == 0) {
+                return 0;
+        }
+        if (argc == 2 && strcmp(argv[1], "sleep") == 0) {
+                sleep(1);
+                return 0;
+        }
+
+        /* The parent itself is a launch, so this one may already be cached */
+        start = spawn_bench_now_ns();
+        chcore_waitpid(spawn_bench_spawn("exit"), &status, 0, 0);
+        first_ns = spawn_bench_now_ns() - start;
+
+        start = spawn_bench_now_ns();
+        for (i = 1; i < SPAWN_BENCH_ROUND; i++) {
+                chcore_waitpid(spawn_bench_spawn("exit"), &status, 0, 0);
+        }
+        rest_ns = (spawn_bench_now_ns() - start) / (SPAWN_BENCH_ROUND - 1);
+
+        printf("spawn_bench: first launch %lu us, then %lu us per launch\n",
+               first_ns / 1000,
+               rest_ns / 1000);
+
+        free_before = spawn_bench_free_mem();
+        for (i = 0; i < SPAWN_BENCH_ALIVE; i++) {
+                pids[i] = spawn_bench_spawn("sleep");
+                if (pids[i] < 0) {
+                        printf("spawn_bench: launch failed %d\n", pids[i]);
+                        return -1;
+                }
+        }
+        free_after = spawn_bench_free_mem();
+        for (i = 0; i < SPAWN_BENCH_ALIVE; i++) {
+                chcore_waitpid(pids[i], &status, 0, 0);
+        }
+
+        printf("spawn_bench: %lu KB per live process\n",
+               (free_before - free_after) / SPAWN_BENCH_ALIVE / 1024);
+        printf("spawn_bench finished\n");
+        return 0;
+}